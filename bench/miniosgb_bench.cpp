@@ -0,0 +1,62 @@
+// Parser throughput: loads the tiles into memory once, then times Data::read() over all of them.
+#include "miniosgb.h"
+#include "miniosgb_io.h"
+#include "miniosgb_parallel.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+int main(int argc, char** argv)
+{
+	if (argc < 2) {
+		printf("  Usage:\n");
+		printf("    miniosgb_bench <file | dir> [-n <iterations>] [-j <threads>]\n");
+		printf("\n");
+		return 0;
+	}
+	int iterations = 5;
+	unsigned int threads = 1;
+	for (int i = 2; i + 1 < argc; i += 2) {
+		if (strcmp(argv[i], "-n") == 0) {
+			iterations = std::max(1, atoi(argv[i + 1]));
+		} else if (strcmp(argv[i], "-j") == 0) {
+			threads = miniosgb::defaultThreadCount((unsigned int)atoi(argv[i + 1]));
+		}
+	}
+
+	const auto files = std::filesystem::is_directory(argv[1]) ? miniosgb::findFiles(argv[1]) : std::vector<std::string>{ argv[1] };
+	std::vector<std::vector<unsigned char>> buffers(files.size());
+	size_t bytes = 0;
+	for (size_t i = 0; i < files.size(); ++i) {
+		std::string error;
+		if (!miniosgb::readFile(files[i].c_str(), buffers[i], &error)) {
+			printf("FAILED: %s\n", error.c_str());
+			return 1;
+		}
+		bytes += buffers[i].size();
+	}
+	printf("%zu files, %.1f MB, %u threads\n", files.size(), bytes / 1e6, threads);
+
+	std::vector<double> seconds;
+	for (int iteration = 0; iteration < iterations; ++iteration) {
+		std::atomic<size_t> failed(0);
+		const auto start = std::chrono::steady_clock::now();
+		miniosgb::parallelFor(buffers.size(), threads, [&](size_t i, unsigned int) {
+			const auto data = miniosgb::Data::read(buffers[i].data(), buffers[i].size());
+			if (!data) {
+				++failed;
+			}
+		});
+		seconds.push_back(std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+		printf("  run %d: %.3f ms%s\n", iteration + 1, seconds.back() * 1e3, failed ? " (with failures)" : "");
+	}
+
+	std::sort(seconds.begin(), seconds.end());
+	const auto best = std::max(seconds.front(), 1e-9);
+	const auto median = std::max(seconds[seconds.size() / 2], 1e-9);
+	printf("best:   %.1f files/s, %.1f MB/s, %.0f ns/file\n", files.size() / best, bytes / best / 1e6, best * 1e9 / std::max<size_t>(files.size(), 1));
+	printf("median: %.1f files/s, %.1f MB/s, %.0f ns/file\n", files.size() / median, bytes / median / 1e6, median * 1e9 / std::max<size_t>(files.size(), 1));
+	return 0;
+}
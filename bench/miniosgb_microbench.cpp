@@ -0,0 +1,440 @@
+// Reader hot path microbenchmarks. The content of a tile (synthetic, or real files) is re-encoded with the writer
+// into one stream per case, so each case decodes only what the Reader function it names reads.
+#include "miniosgb.h"
+#include "miniosgb_io.h"
+#include "miniosgb_synth.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+
+using miniosgb::details::Reader;
+using miniosgb::details::Writer;
+
+static double g_minSeconds = 0.2; // measuring time per case
+static const char* g_filter = nullptr; // only cases whose name contains this
+static volatile size_t g_sink; // keeps the results of the timed loops alive
+
+struct Tile {
+	std::string label;
+	std::vector<unsigned char> buffer;
+	miniosgb::WriteOptions options; // version and bracket mode of the file
+	size_t headerSize = 0;
+	miniosgb::ObjectArena arena; // owns the objects below
+	std::map<unsigned int, miniosgb::Object*> objects; // by id, so the streams are deterministic
+	std::map<unsigned int, miniosgb::Array*> arrays;
+	std::map<unsigned int, miniosgb::Image*> images;
+};
+
+static bool LoadTile(Tile& tile, std::string* error)
+{
+	try {
+		Reader reader(tile.buffer.data(), tile.buffer.size(), tile.arena);
+		reader.readHeader();
+		tile.headerSize = reader._pos;
+		tile.options.version = reader._version;
+		tile.options.useBinaryBrackets = reader._useBinaryBrackets;
+		if (!reader.readObject() || !reader.ended()) {
+			*error = "no root object";
+			return false;
+		}
+		tile.objects.insert(reader._objects.begin(), reader._objects.end());
+		tile.arrays.insert(reader._arrays.begin(), reader._arrays.end());
+		tile.images.insert(reader._images.begin(), reader._images.end());
+		return true;
+	} catch (const std::exception& ex) {
+		*error = ex.what();
+		return false;
+	}
+}
+
+// Encodes what `fn` writes, without file header, with the same measure-then-stream passes as writeOsgb().
+template<typename Fn> static std::vector<unsigned char> Encode(const miniosgb::WriteOptions& options, Fn fn)
+{
+	Writer measure(options, nullptr);
+	fn(measure);
+	std::vector<unsigned char> stream;
+	const miniosgb::WriteSink sink = [&stream](const unsigned char* p, size_t n) {
+		stream.insert(stream.end(), p, p + n);
+		return true;
+	};
+	Writer writer(options, &sink);
+	writer._bracketSizes = std::move(measure._bracketSizes);
+	fn(writer);
+	writer.flush();
+	return stream;
+}
+
+static Reader MakeReader(const std::vector<unsigned char>& stream, const miniosgb::WriteOptions& options, miniosgb::ObjectArena& arena)
+{
+	Reader reader(stream.data(), stream.size(), arena);
+	reader._version = options.version;
+	reader._useBinaryBrackets = options.useBinaryBrackets;
+	return reader;
+}
+
+// Seconds of the fastest single run of `fn`: runs are batched to at least 2 ms, batches repeat for g_minSeconds.
+template<typename Fn> static double BestSeconds(Fn fn)
+{
+	using Clock = std::chrono::steady_clock;
+	size_t repeat = 1;
+	double elapsed = 0;
+	for (;;) {
+		const auto start = Clock::now();
+		for (size_t i = 0; i < repeat; ++i) {
+			g_sink = g_sink + fn();
+		}
+		elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+		if ((elapsed >= 0.002) || (repeat >= (size_t(1) << 24))) {
+			break;
+		}
+		repeat *= 2;
+	}
+	auto best = elapsed / repeat;
+	for (auto total = elapsed; total < g_minSeconds; total += elapsed) {
+		const auto start = Clock::now();
+		for (size_t i = 0; i < repeat; ++i) {
+			g_sink = g_sink + fn();
+		}
+		elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+		best = std::min(best, elapsed / repeat);
+	}
+	return best;
+}
+
+// Times `fn`, one pass over `items` items of `bytes` bytes, and prints a result row.
+template<typename Fn> static void RunCase(const std::string& name, size_t items, size_t bytes, Fn fn)
+{
+	if ((g_filter && (name.find(g_filter) == std::string::npos)) || (items == 0)) {
+		return;
+	}
+	try {
+		const auto seconds = std::max(BestSeconds(fn), 1e-12);
+		printf("  %-38s %10zu %12.1f %10.2f\n", name.c_str(), items, seconds * 1e9 / items, bytes / seconds / 1e9);
+	} catch (const std::exception& ex) {
+		printf("  %-38s FAILED: %s\n", name.c_str(), ex.what());
+	}
+}
+
+static void RunTile(const Tile& tile)
+{
+	printf("%s: v%u%s, %.1f KB, %zu objects, %zu arrays, %zu images\n", tile.label.c_str(), tile.options.version,
+		tile.options.useBinaryBrackets ? " with brackets" : "", tile.buffer.size() / 1e3, tile.objects.size(), tile.arrays.size(), tile.images.size());
+	printf("  %-38s %10s %12s %10s\n", "case", "items", "ns/item", "GB/s");
+
+	std::vector<miniosgb::Array*> arrays;
+	std::vector<miniosgb::Geometry*> geometries;
+	for (const auto& [id, obj] : tile.objects) {
+		if (const auto arr = miniosgb::objectCast<miniosgb::Array>(obj)) {
+			arrays.push_back(arr);
+		} else if (const auto geometry = miniosgb::objectCast<miniosgb::Geometry>(obj)) {
+			geometries.push_back(geometry);
+		}
+	}
+	for (const auto& [id, arr] : tile.arrays) {
+		arrays.push_back(arr);
+	}
+	const auto objectCount = tile.objects.size() + tile.arrays.size() + tile.images.size();
+
+	// the whole object graph, as Data::read() parses it after the header, and its teardown
+	RunCase("readObject (tile graph)", objectCount, tile.buffer.size() - tile.headerSize, [&tile] {
+		miniosgb::ObjectArena arena;
+		Reader reader(tile.buffer.data(), tile.buffer.size(), arena);
+		reader._pos = tile.headerSize;
+		reader._version = tile.options.version;
+		reader._useBinaryBrackets = tile.options.useBinaryBrackets;
+		return (size_t)reader.readObject();
+	});
+
+	// objects met again: class name, bracket and id, then an _objects hit
+	try {
+		size_t referencesStart = 0;
+		const auto stream = Encode(tile.options, [&](Writer& writer) {
+			for (const auto& [id, obj] : tile.objects) {
+				writer.writeObject(obj);
+			}
+			referencesStart = writer._pos;
+			for (const auto& [id, obj] : tile.objects) {
+				writer.writeObject(obj);
+			}
+		});
+		miniosgb::ObjectArena arena;
+		auto reader = MakeReader(stream, tile.options, arena);
+		for (size_t i = 0; i < tile.objects.size(); ++i) {
+			reader.readObject();
+		}
+		const auto count = tile.objects.size();
+		RunCase("readObject (shared reference)", count, stream.size() - referencesStart, [&reader, referencesStart, count] {
+			reader._pos = referencesStart;
+			size_t sum = 0;
+			for (size_t i = 0; i < count; ++i) {
+				sum += (size_t)reader.readObject();
+			}
+			return sum;
+		});
+	} catch (const std::exception& ex) {
+		printf("  %-38s FAILED: %s\n", "readObject (shared reference)", ex.what());
+	}
+
+	// _objects/_arrays/_images lookups, half of them hits
+	{
+		miniosgb::ObjectArena arena;
+		Reader reader(tile.buffer.data(), tile.buffer.size(), arena);
+		reader._objects.insert(tile.objects.begin(), tile.objects.end());
+		reader._arrays.insert(tile.arrays.begin(), tile.arrays.end());
+		reader._images.insert(tile.images.begin(), tile.images.end());
+		std::vector<unsigned int> objectIds, arrayIds, imageIds;
+		const auto addIds = [](std::vector<unsigned int>& ids, unsigned int id) {
+			ids.push_back(id);
+			ids.push_back(id + 0x40000000);
+		};
+		for (const auto& it : tile.objects) {
+			addIds(objectIds, it.first);
+		}
+		for (const auto& it : tile.arrays) {
+			addIds(arrayIds, it.first);
+		}
+		for (const auto& it : tile.images) {
+			addIds(imageIds, it.first);
+		}
+		const auto count = objectIds.size() + arrayIds.size() + imageIds.size();
+		RunCase("id-map lookup", count, count * sizeof(unsigned int), [&] {
+			size_t hits = 0;
+			for (const auto id : objectIds) {
+				hits += (reader._objects.find(id) != reader._objects.end());
+			}
+			for (const auto id : arrayIds) {
+				hits += (reader._arrays.find(id) != reader._arrays.end());
+			}
+			for (const auto id : imageIds) {
+				hits += (reader._images.find(id) != reader._images.end());
+			}
+			return hits;
+		});
+	}
+
+	// class names and PagedLOD file names
+	{
+		std::vector<std::string> strings;
+		for (const auto& [id, obj] : tile.objects) {
+			strings.push_back(std::string("osg::") + obj->className());
+			if (const auto plod = miniosgb::objectCast<miniosgb::PagedLOD>(obj)) {
+				for (const auto& rangeData : plod->rangeDataList) {
+					strings.push_back(std::string(rangeData.filename));
+				}
+			}
+		}
+		for (size_t i = 0; i < tile.images.size(); ++i) {
+			strings.push_back("osg::Image");
+		}
+		const auto stream = Encode(tile.options, [&strings](Writer& writer) {
+			for (const auto& s : strings) {
+				writer.write(s);
+			}
+		});
+		const auto count = strings.size();
+		RunCase("read<std::string>", count, stream.size(), [&stream, &tile, count] {
+			miniosgb::ObjectArena arena;
+			auto reader = MakeReader(stream, tile.options, arena);
+			size_t sum = 0;
+			for (size_t i = 0; i < count; ++i) {
+				sum += reader.read<std::string>().size();
+			}
+			return sum;
+		});
+		RunCase("read<std::string_view>", count, stream.size(), [&stream, &tile, count] {
+			miniosgb::ObjectArena arena;
+			auto reader = MakeReader(stream, tile.options, arena);
+			size_t sum = 0;
+			for (size_t i = 0; i < count; ++i) {
+				sum += reader.read<std::string_view>().size();
+			}
+			return sum;
+		});
+	}
+
+	// the Geometry fields of each version branch: pre-112 inline arrays with 32-bit brackets, 112+ array objects with
+	// 64-bit brackets (149+), and 154+ Geometry Node fields
+	for (const unsigned int version : { 100u, 150u, 161u }) {
+		auto options = tile.options;
+		options.version = version;
+		try {
+			const auto stream = Encode(options, [&geometries](Writer& writer) {
+				for (const auto& geometry : geometries) {
+					writer.writeObjectFields<miniosgb::Geometry>(*geometry);
+				}
+			});
+			const auto count = geometries.size();
+			RunCase("readObjectFields<Geometry> v" + std::to_string(version), count, stream.size(), [&stream, &options, count] {
+				miniosgb::ObjectArena arena;
+				auto reader = MakeReader(stream, options, arena);
+				size_t sum = 0;
+				for (size_t i = 0; i < count; ++i) {
+					miniosgb::Geometry geometry;
+					reader.readObjectFields<miniosgb::Geometry>(geometry);
+					sum += geometry.primitives.size();
+				}
+				return sum;
+			});
+		} catch (const std::exception& ex) {
+			printf("  readObjectFields<Geometry> v%u FAILED: %s\n", version, ex.what());
+		}
+	}
+
+	// pre-112 array records, payload skipped in place
+	{
+		const auto stream = Encode(tile.options, [&arrays](Writer& writer) {
+			for (const auto& arr : arrays) {
+				writer.writeArray(arr);
+			}
+		});
+		const auto count = arrays.size();
+		RunCase("ReadArray", count, stream.size(), [&stream, &tile, count] {
+			miniosgb::ObjectArena arena;
+			auto reader = MakeReader(stream, tile.options, arena);
+			size_t sum = 0;
+			for (size_t i = 0; i < count; ++i) {
+				sum += reader.ReadArray()->elementCount;
+			}
+			return sum;
+		});
+	}
+
+	{
+		const auto stream = Encode(tile.options, [&tile](Writer& writer) {
+			for (const auto& [id, image] : tile.images) {
+				writer.writeImage(image);
+			}
+		});
+		const auto count = tile.images.size();
+		RunCase("readImage", count, stream.size(), [&stream, &tile, count] {
+			miniosgb::ObjectArena arena;
+			auto reader = MakeReader(stream, tile.options, arena);
+			size_t sum = 0;
+			for (size_t i = 0; i < count; ++i) {
+				sum += reader.readImage()->dataLength;
+			}
+			return sum;
+		});
+	}
+
+	// every element of every array, one virtual call each
+	{
+		size_t elements = 0, bytes = 0;
+		for (const auto& arr : arrays) {
+			elements += arr->elementCount;
+			bytes += size_t(arr->elementCount) * arr->elementSize;
+		}
+		RunCase("Array::readFloats", elements, bytes, [&arrays] {
+			float values[4] = {};
+			float sum = 0;
+			for (const auto& arr : arrays) {
+				const auto components = arr->elementSize / (unsigned int)sizeof(float);
+				for (unsigned int i = 0; i < arr->elementCount; ++i) {
+					arr->readFloats(i, values, components);
+					sum += values[0];
+				}
+			}
+			return (size_t)sum;
+		});
+	}
+	printf("\n");
+}
+
+int main(int argc, char** argv)
+{
+	std::vector<std::string> paths;
+	miniosgb::WriteOptions synthetic;
+	bool share = true;
+	for (int i = 1; i < argc; ++i) {
+		const auto hasValue = (i + 1 < argc);
+		if ((strcmp(argv[i], "-t") == 0) && hasValue) {
+			g_minSeconds = atof(argv[++i]);
+		} else if ((strcmp(argv[i], "-case") == 0) && hasValue) {
+			g_filter = argv[++i];
+		} else if ((strcmp(argv[i], "-version") == 0) && hasValue) {
+			synthetic.version = (unsigned int)atoi(argv[++i]);
+		} else if ((strcmp(argv[i], "-brackets") == 0) && hasValue) {
+			synthetic.useBinaryBrackets = (atoi(argv[++i]) != 0);
+		} else if ((strcmp(argv[i], "-share") == 0) && hasValue) {
+			share = (atoi(argv[++i]) != 0);
+		} else if ((strcmp(argv[i], "-h") == 0) || (argv[i][0] == '-')) {
+			printf("  Usage:\n");
+			printf("    miniosgb_microbench [<file | dir> ...] [-t <seconds per case>] [-case <name filter>]\n");
+			printf("                        [-version <synthetic osgb version>] [-brackets 0|1] [-share 0|1]\n");
+			printf("\n");
+			printf("  Runs every case on small, medium and large synthetic tiles, then on the given files.\n");
+			printf("  For a directory, its smallest, median and largest tiles are used.\n");
+			printf("  GB/s counts every byte a case consumes, including payloads the Reader skips in place.\n");
+			printf("\n");
+			return 0;
+		} else {
+			paths.push_back(argv[i]);
+		}
+	}
+
+	std::vector<std::unique_ptr<Tile>> tiles;
+	struct Size { const char* name; unsigned int triangles; unsigned int geometries; unsigned int texture; };
+	for (const auto& size : { Size{ "small", 128, 1, 64 }, Size{ "medium", 2048, 4, 256 }, Size{ "large", 32768, 8, 1024 } }) {
+		miniosgb::SynthOptions options;
+		options.write = synthetic;
+		options.depth = 2;
+		options.trianglesPerGeometry = size.triangles;
+		options.geometriesPerTile = size.geometries;
+		options.textureSize = size.texture;
+		options.shareObjects = share;
+		auto tile = std::make_unique<Tile>();
+		tile->label = std::string("synthetic ") + size.name;
+		std::string error;
+		if (!miniosgb::synthesizeTile(tile->buffer, options, &error)) {
+			printf("FAILED: %s\n", error.c_str());
+			return 1;
+		}
+		tiles.push_back(std::move(tile));
+	}
+
+	for (const auto& path : paths) {
+		std::vector<std::string> files = { path };
+		if (std::filesystem::is_directory(path)) {
+			files = miniosgb::findFiles(path);
+			std::vector<std::pair<uintmax_t, std::string>> sized;
+			for (const auto& file : files) {
+				std::error_code ec;
+				sized.emplace_back(std::filesystem::file_size(file, ec), file);
+			}
+			std::sort(sized.begin(), sized.end());
+			files.clear();
+			if (!sized.empty()) {
+				files.push_back(sized.front().second);
+				if (sized.size() > 2) {
+					files.push_back(sized[sized.size() / 2].second);
+				}
+				if (sized.size() > 1) {
+					files.push_back(sized.back().second);
+				}
+			}
+		}
+		for (const auto& file : files) {
+			auto tile = std::make_unique<Tile>();
+			tile->label = file;
+			std::string error;
+			if (!miniosgb::readFile(file.c_str(), tile->buffer, &error)) {
+				printf("FAILED: %s\n", error.c_str());
+				return 1;
+			}
+			tiles.push_back(std::move(tile));
+		}
+	}
+
+	for (auto& tile : tiles) {
+		std::string error;
+		if (!LoadTile(*tile, &error)) {
+			printf("%s: FAILED: %s\n\n", tile->label.c_str(), error.c_str());
+			continue;
+		}
+		RunTile(*tile);
+	}
+	return 0;
+}
@@ -1,9 +1,27 @@
 #pragma once
 #include <memory>
 #include <string>
+#include <string_view>
 #include <vector>
 #include <unordered_map>
+#include <unordered_set>
 #include <stdexcept>
+#include <cstring>
+#include <array>
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <algorithm>
+#include <functional>
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+#include "miniosgb_trace.h"
 
 namespace miniosgb
 {
@@ -12,8 +30,43 @@ namespace miniosgb
 	struct Vec4f { float x = 0; float y = 0; float z = 0; float w = 0; };
 	struct Vec3d { double x = 0; double y = 0; double z = 0; };
 
+	// Link from one object to another. Objects belong to the ObjectArena of their Data and are released with it, so a
+	// link owns nothing and counts nothing: it is a plain pointer with the get()/->/bool interface of a smart one.
+	template<typename T> class Ref {
+	public:
+		Ref() = default;
+		Ref(std::nullptr_t) {}
+		Ref(T* ptr) : _ptr(ptr) {}
+		template<typename U, typename = typename std::enable_if<std::is_convertible<U*, T*>::value>::type>
+		Ref(const Ref<U>& other) : _ptr(other.get()) {}
+
+		T* get() const { return _ptr; }
+		T* operator->() const { return _ptr; }
+		T& operator*() const { return *_ptr; }
+		explicit operator bool() const { return (_ptr != nullptr); }
+		void reset() { _ptr = nullptr; }
+
+		friend bool operator==(const Ref& a, const Ref& b) { return (a._ptr == b._ptr); }
+		friend bool operator!=(const Ref& a, const Ref& b) { return (a._ptr != b._ptr); }
+
+	private:
+		T* _ptr = nullptr;
+	};
+
+	// Concrete class of an object, set by its constructor, so traversals can dispatch with a switch (visit(),
+	// objectCast()) instead of RTTI. Classes defined outside this header stay Unknown.
+	enum class ObjectType : unsigned char {
+		Unknown = 0,
+		Vec2Array, Vec3Array, Vec4Array,
+		PrimitiveSet, DrawElementsUInt,
+		Geometry, Geode, Group, PagedLOD,
+		StateSet, Material, Texture2D, Image,
+		DefaultUserDataContainer,
+	};
+
 	struct Object {
-		unsigned int uniqueId;
+		unsigned int uniqueId = 0;
+		ObjectType objectType = ObjectType::Unknown;
 		virtual const char* className() const = 0;
 		virtual ~Object() {}
 	};
@@ -34,7 +87,7 @@ namespace miniosgb
 	};
 
 	struct Vec2Array : Array {
-		Vec2Array() : Array(ArrayType::Vec2f, sizeof(Vec2f)) {}
+		Vec2Array() : Array(ArrayType::Vec2f, sizeof(Vec2f)) { objectType = ObjectType::Vec2Array; }
 		const char* className() const override { return "Vec2Array"; }
 		bool virtual readFloats(unsigned int index, float* dest, unsigned int count) override {
 			if ((index >= elementCount) || (count > 2)) {
@@ -46,7 +99,7 @@ namespace miniosgb
 	};
 
 	struct Vec3Array : Array {
-		Vec3Array() : Array(ArrayType::Vec3f, sizeof(Vec3f)) {}
+		Vec3Array() : Array(ArrayType::Vec3f, sizeof(Vec3f)) { objectType = ObjectType::Vec3Array; }
 		const char* className() const override { return "Vec3Array"; }
 		bool virtual readFloats(unsigned int index, float* dest, unsigned int count) override {
 			if ((index >= elementCount) || (count > 3)) {
@@ -58,7 +111,7 @@ namespace miniosgb
 	};
 
 	struct Vec4Array : Array {
-		Vec4Array() : Array(ArrayType::Vec4f, sizeof(Vec4f)) {}
+		Vec4Array() : Array(ArrayType::Vec4f, sizeof(Vec4f)) { objectType = ObjectType::Vec4Array; }
 		const char* className() const override { return "Vec4Array"; }
 		bool virtual readFloats(unsigned int index, float* dest, unsigned int count) override {
 			if ((index >= elementCount) || (count > 4)) {
@@ -81,11 +134,12 @@ namespace miniosgb
 
 	// https://github.com/openscenegraph/OpenSceneGraph/blob/OpenSceneGraph-3.6/include/osg/StateSet
 	struct StateSet : Object {
+		StateSet() { objectType = ObjectType::StateSet; }
 		const char* className() const override { return "StateSet"; }
 		typedef std::vector<std::pair<StateAttribute::GLMode, StateAttribute::GLModeValue>> ModeList;
 		ModeList modes;
 
-		typedef std::vector<std::pair<std::shared_ptr<StateAttribute>, StateAttribute::OverrideValue>> AttributeList;
+		typedef std::vector<std::pair<Ref<StateAttribute>, StateAttribute::OverrideValue>> AttributeList;
 		AttributeList attributes;
 
 		typedef std::vector<ModeList> TextureModeList;
@@ -99,12 +153,13 @@ namespace miniosgb
 	};
 
 	struct Node : Object {
-		std::shared_ptr<StateSet> stateSet;
+		Ref<StateSet> stateSet;
 	};
 
 	struct Drawable : Node {};
 
 	struct PrimitiveSet : BufferData {
+		PrimitiveSet() { objectType = ObjectType::PrimitiveSet; }
 		const char* className() const override { return "PrimitiveSet"; }
 		unsigned int mode = 0;
 		// unconfirmed
@@ -113,28 +168,32 @@ namespace miniosgb
 	};
 
 	struct DrawElementsUInt : PrimitiveSet {
+		DrawElementsUInt() { objectType = ObjectType::DrawElementsUInt; }
 		const char* className() const override { return "DrawElementsUInt"; }
 	};
 
 	struct Geometry : Drawable {
+		Geometry() { objectType = ObjectType::Geometry; }
 		const char* className() const override { return "Geometry"; }
-		std::vector<std::shared_ptr<PrimitiveSet>> primitives;
-		std::shared_ptr<Array> vertexData;
-		std::shared_ptr<Array> normalData;
-		std::shared_ptr<Array> colorData;
-		std::shared_ptr<Array> secondaryColorData;
-		std::shared_ptr<Array> fogCoordData;
-		std::vector<std::shared_ptr<Array>> texCoordDataList;
+		std::vector<Ref<PrimitiveSet>> primitives;
+		Ref<Array> vertexData;
+		Ref<Array> normalData;
+		Ref<Array> colorData;
+		Ref<Array> secondaryColorData;
+		Ref<Array> fogCoordData;
+		std::vector<Ref<Array>> texCoordDataList;
 	};
 
 	struct Geode : Node {
+		Geode() { objectType = ObjectType::Geode; }
 		const char* className() const override { return "Geode"; }
-		std::vector<std::shared_ptr<Drawable>> drawables;
+		std::vector<Ref<Drawable>> drawables;
 	};
 
 	struct Group : Node {
+		Group() { objectType = ObjectType::Group; }
 		const char* className() const override { return "Group"; }
-		std::vector<std::shared_ptr<Node>> children;
+		std::vector<Ref<Node>> children;
 	};
 
 	struct LOD : Group {
@@ -142,14 +201,18 @@ namespace miniosgb
 		Vec3d userDefinedCenter;
 		double userDefinedRadius = 0;
 
+		enum class RangeMode { DistanceFromEyePoint = 0, PixelSizeOnScreen = 1 };
+		RangeMode rangeMode = RangeMode::DistanceFromEyePoint;
+
 		struct Range { float min; float max; };
 		std::vector<Range> rangeList;
 	};
 
 	struct PagedLOD : LOD {
+		PagedLOD() { objectType = ObjectType::PagedLOD; }
 		const char* className() const override { return "PagedLOD"; }
 		struct RangeData {
-			std::string filename;
+			std::string_view filename; // in the source buffer, or copied into the Data (Data::copyString)
 			float priorityOffset = 0;
 			float priorityScale = 0;
 		};
@@ -157,11 +220,12 @@ namespace miniosgb
 	};
 
 	struct Material : StateAttribute {
+		Material() { objectType = ObjectType::Material; }
 		const char* className() const override { return "Material"; }
 		template <typename T> struct Property {
-			bool frontAndBack;
-			T front;
-			T back;
+			bool frontAndBack = false;
+			T front = {};
+			T back = {};
 		};
 		Property<Vec4f> ambient;
 		Property<Vec4f> diffuse;
@@ -184,21 +248,533 @@ namespace miniosgb
 	};
 
 	struct Image : BufferData {
+		Image() { objectType = ObjectType::Image; }
 		const char* className() const override { return "Image"; }
 		const unsigned char* data = nullptr;
 		unsigned int dataLength = 0;
 	};
 
 	struct Texture2D : Texture {
+		Texture2D() { objectType = ObjectType::Texture2D; }
 		const char* className() const override { return "Texture2D"; }
-		std::shared_ptr<Image> image;
+		Ref<Image> image;
 	};
 
 	struct UserDataContainer : Object {};
 	struct DefaultUserDataContainer : UserDataContainer {
+		DefaultUserDataContainer() { objectType = ObjectType::DefaultUserDataContainer; }
 		const char* className() const override { return "DefaultUserDataContainer"; }
 	};
 
+	namespace details {
+		template<typename From, typename To> using LikeConst = typename std::conditional<std::is_const<From>::value, const To, To>::type;
+
+		template<typename O, typename F> decltype(auto) visitObject(O& obj, F&& fn) {
+			switch (obj.objectType) {
+				case ObjectType::Vec2Array: return fn(static_cast<LikeConst<O, Vec2Array>&>(obj));
+				case ObjectType::Vec3Array: return fn(static_cast<LikeConst<O, Vec3Array>&>(obj));
+				case ObjectType::Vec4Array: return fn(static_cast<LikeConst<O, Vec4Array>&>(obj));
+				case ObjectType::PrimitiveSet: return fn(static_cast<LikeConst<O, PrimitiveSet>&>(obj));
+				case ObjectType::DrawElementsUInt: return fn(static_cast<LikeConst<O, DrawElementsUInt>&>(obj));
+				case ObjectType::Geometry: return fn(static_cast<LikeConst<O, Geometry>&>(obj));
+				case ObjectType::Geode: return fn(static_cast<LikeConst<O, Geode>&>(obj));
+				case ObjectType::Group: return fn(static_cast<LikeConst<O, Group>&>(obj));
+				case ObjectType::PagedLOD: return fn(static_cast<LikeConst<O, PagedLOD>&>(obj));
+				case ObjectType::StateSet: return fn(static_cast<LikeConst<O, StateSet>&>(obj));
+				case ObjectType::Material: return fn(static_cast<LikeConst<O, Material>&>(obj));
+				case ObjectType::Texture2D: return fn(static_cast<LikeConst<O, Texture2D>&>(obj));
+				case ObjectType::Image: return fn(static_cast<LikeConst<O, Image>&>(obj));
+				case ObjectType::DefaultUserDataContainer: return fn(static_cast<LikeConst<O, DefaultUserDataContainer>&>(obj));
+				default: return fn(obj);
+			}
+		}
+	}
+
+	// Calls fn with `obj` as its concrete class, found by objectType, or as Object when Unknown. fn is a generic
+	// lambda or an overload set; every call must return the same type.
+	template<typename F> decltype(auto) visit(Object& obj, F&& fn) { return details::visitObject(obj, fn); }
+	template<typename F> decltype(auto) visit(const Object& obj, F&& fn) { return details::visitObject(obj, fn); }
+
+	// dynamic_cast<T*> by objectType: `obj` if its class is T or derives from it, else nullptr. Unknown classes
+	// still go through dynamic_cast.
+	template<typename T, typename O> details::LikeConst<O, typename std::remove_const<T>::type>* objectCast(O* obj) {
+		typedef details::LikeConst<O, typename std::remove_const<T>::type> Result;
+		if (obj == nullptr) {
+			return nullptr;
+		}
+		details::LikeConst<O, Object>& base = *obj;
+		if (base.objectType == ObjectType::Unknown) {
+			return dynamic_cast<Result*>(&base);
+		}
+		return visit(base, [](auto& concrete) -> Result* {
+			if constexpr (std::is_base_of<typename std::remove_const<T>::type, typename std::decay<decltype(concrete)>::type>::value) {
+				return &concrete;
+			} else {
+				return nullptr;
+			}
+		});
+	}
+
+	// Owner of the objects of a Data. Objects are placed one after another in a few growing blocks and released all
+	// together: no reference counts, no allocation per object, and teardown is a destructor pass plus a free per block.
+	class ObjectArena {
+	public:
+		ObjectArena() = default;
+		ObjectArena(ObjectArena&& other) noexcept { swap(other); }
+		ObjectArena& operator=(ObjectArena&& other) noexcept {
+			if (this != &other) {
+				clear();
+				swap(other);
+			}
+			return *this;
+		}
+		ObjectArena(const ObjectArena&) = delete;
+		ObjectArena& operator=(const ObjectArena&) = delete;
+		~ObjectArena() { clear(); }
+
+		// Blocks don't move when the arena does, so objects keep their address for the arena's lifetime.
+		template<typename T> T* create() {
+			static_assert(std::is_base_of<Object, T>::value, "only objects live in an ObjectArena");
+			static_assert(alignof(T) <= alignof(std::max_align_t), "over-aligned object");
+			_objects.push_back(nullptr); // first, so the object is never left out of the destructor pass
+			T* obj;
+			try {
+				obj = new (allocate(sizeof(T))) T();
+			} catch (...) {
+				_objects.pop_back(); // no null entry for clear() and forEach(); the bytes stay unused in the block
+				throw;
+			}
+			_objects.back() = obj;
+			return obj;
+		}
+
+		size_t size() const { return _objects.size(); }
+
+		// Calls fn(Object*) for each object, in creation order.
+		template<typename F> void forEach(F&& fn) const {
+			for (const auto obj : _objects) {
+				fn(obj);
+			}
+		}
+
+		bool owns(const Object* obj) const {
+			const auto p = (const unsigned char*)obj;
+			const std::less<const unsigned char*> less;
+			for (const auto& block : _blocks) {
+				if (!less(p, block.bytes.get()) && less(p, block.bytes.get() + block.size)) {
+					return true;
+				}
+			}
+			return false;
+		}
+
+		// Undoes the latest allocation if it is `obj`, of `size` bytes, e.g. when a shared copy replaces it.
+		bool discardLast(Object* obj, size_t size) {
+			if (_objects.empty() || (_objects.back() != obj) || _blocks.empty()) {
+				return false;
+			}
+			const auto start = (size_t)((unsigned char*)obj - _blocks.back().bytes.get());
+			if ((start >= _blocks.back().size) || (start + roundUp(size) != _used)) {
+				return false;
+			}
+			obj->~Object();
+			_objects.pop_back();
+			_used = start;
+			return true;
+		}
+
+		// Copy of `s` kept in the arena, for the file names of graphs built by hand.
+		std::string_view copyString(std::string_view s) {
+			if (s.empty()) {
+				return {};
+			}
+			const auto copy = (char*)allocate(s.size());
+			memcpy(copy, s.data(), s.size());
+			return std::string_view(copy, s.size());
+		}
+
+		// Heap bytes of the blocks and the object list.
+		size_t capacity() const {
+			size_t bytes = _objects.capacity() * sizeof(Object*) + _blocks.capacity() * sizeof(Block);
+			for (const auto& block : _blocks) {
+				bytes += block.size;
+			}
+			return bytes;
+		}
+
+		void clear() {
+			for (const auto obj : _objects) {
+				obj->~Object();
+			}
+			_objects.clear();
+			_blocks.clear();
+			_used = 0;
+		}
+
+		void swap(ObjectArena& other) noexcept {
+			_blocks.swap(other._blocks);
+			_objects.swap(other._objects);
+			std::swap(_used, other._used);
+		}
+
+	private:
+		static constexpr size_t firstBlockSize = 4096; // a leaf tile takes a few dozen objects
+		static constexpr size_t maxBlockSize = 256 * 1024;
+
+		struct Block {
+			std::unique_ptr<unsigned char[]> bytes; // new[] aligns for any fundamental type
+			size_t size;
+		};
+		std::vector<Block> _blocks;
+		size_t _used = 0; // of the last block
+		std::vector<Object*> _objects; // in creation order, for the destructor pass
+
+		static size_t roundUp(size_t size) {
+			return (size + alignof(std::max_align_t) - 1) & ~(alignof(std::max_align_t) - 1);
+		}
+
+		void* allocate(size_t size) {
+			size = roundUp(size);
+			if (_blocks.empty() || (_used + size > _blocks.back().size)) {
+				const auto grown = _blocks.empty() ? firstBlockSize : std::min(_blocks.back().size * 2, maxBlockSize);
+				const auto blockSize = std::max(grown, size);
+				_blocks.push_back({ std::unique_ptr<unsigned char[]>(new unsigned char[blockSize]), blockSize });
+				_used = 0;
+			}
+			const auto ptr = _blocks.back().bytes.get() + _used;
+			_used += size;
+			return ptr;
+		}
+	};
+
+	// Process-wide hash-consing of state: materials, textures without an image and the state sets made of them
+	// are replaced by one shared copy per distinct content, so tiles share them. A texture with an image keeps its
+	// own copy, the image being part of its tile, and so does its state set, with the shared material; for those,
+	// stateClassOf() gives the shared state set that all the ones differing only in their images map to, which is
+	// what renderers sort and batch by. Shared copies live until clear(), which only a process that holds no Data
+	// read with the interner may call.
+	class StateInterner {
+	public:
+		static StateInterner& global() {
+			static StateInterner instance;
+			return instance;
+		}
+
+		struct Counts {
+			size_t materials = 0; // distinct, i.e. shared copies
+			size_t textures = 0;
+			size_t stateSets = 0;
+			size_t stateClasses = 0; // of stateClassOf()
+			size_t hits = 0; // objects replaced by a shared copy
+		};
+
+		// The shared copy of `obj`, or `obj` itself if it isn't interned.
+		Object* intern(Object* obj) {
+			std::string key;
+			if (!keyOf(obj, key)) {
+				return obj;
+			}
+			std::lock_guard<std::mutex> lock(_mutex);
+			const auto it = _shared.find(key);
+			if (it != _shared.end()) {
+				++_counts.hits;
+				return it->second;
+			}
+			return share(obj, std::move(key));
+		}
+
+		// The shared state set standing for every state set equal to `stateSet` but for the images of its textures:
+		// the same modes, the shared material and, for each texture, the shared image-less texture with its
+		// parameters. Renderers sort and batch by it and bind each tile's own image. An interned state set is its
+		// own class. nullptr when `stateSet` holds an attribute that isn't a material or a texture.
+		const StateSet* stateClassOf(const StateSet& stateSet) {
+			std::string key = "C";
+			appendModes(stateSet, key);
+			std::lock_guard<std::mutex> lock(_mutex);
+			if (_owned.find(&stateSet) != _owned.end()) {
+				return &stateSet;
+			}
+			StateSet::AttributeList attributes;
+			if (!classAttributes(stateSet.attributes, attributes, key)) {
+				return nullptr;
+			}
+			std::vector<StateSet::AttributeList> textureAttributesList(stateSet.textureAttributesList.size());
+			append(key, textureAttributesList.size());
+			for (size_t unit = 0; unit < textureAttributesList.size(); ++unit) {
+				if (!classAttributes(stateSet.textureAttributesList[unit], textureAttributesList[unit], key)) {
+					return nullptr;
+				}
+			}
+			const auto it = _shared.find(key);
+			if (it != _shared.end()) {
+				return objectCast<StateSet>(it->second);
+			}
+			const auto copy = copyOf(stateSet);
+			copy->attributes = std::move(attributes);
+			copy->textureAttributesList = std::move(textureAttributesList);
+			++_counts.stateClasses;
+			_shared.emplace(std::move(key), copy);
+			_owned.insert(copy);
+			return copy;
+		}
+
+		bool isShared(const Object* obj) const {
+			std::lock_guard<std::mutex> lock(_mutex);
+			return (_owned.find(obj) != _owned.end());
+		}
+
+		Counts counts() const {
+			std::lock_guard<std::mutex> lock(_mutex);
+			return _counts;
+		}
+
+		// Heap bytes of the shared copies.
+		size_t capacity() const {
+			std::lock_guard<std::mutex> lock(_mutex);
+			return _objects.capacity();
+		}
+
+		void clear() {
+			std::lock_guard<std::mutex> lock(_mutex);
+			_shared.clear();
+			_owned.clear();
+			_objects.clear();
+			_counts = Counts();
+		}
+
+	private:
+		mutable std::mutex _mutex;
+		ObjectArena _objects;
+		std::unordered_map<std::string, Object*> _shared; // by content key
+		std::unordered_set<const Object*> _owned;
+		Counts _counts;
+
+		template<typename T> static void append(std::string& key, const T& value) {
+			key.append((const char*)&value, sizeof(value));
+		}
+
+		template<typename T> static void append(std::string& key, const Material::Property<T>& property) {
+			append(key, property.frontAndBack);
+			append(key, property.front);
+			append(key, property.back);
+		}
+
+		// Adds the shared copy of `obj`, keyed by `key`; a texture's copy leaves out the image. Under the lock.
+		Object* share(const Object* obj, std::string&& key) {
+			Object* copy = nullptr;
+			if (const auto material = objectCast<Material>(obj)) {
+				copy = copyOf(*material);
+				++_counts.materials;
+			} else if (const auto texture = objectCast<Texture2D>(obj)) {
+				const auto textureCopy = copyOf(*texture);
+				textureCopy->image.reset();
+				copy = textureCopy;
+				++_counts.textures;
+			} else if (const auto stateSet = objectCast<StateSet>(obj)) {
+				copy = copyOf(*stateSet);
+				++_counts.stateSets;
+			}
+			_shared.emplace(std::move(key), copy);
+			_owned.insert(copy);
+			return copy;
+		}
+
+		static void textureKey(const Texture2D& texture, std::string& key) {
+			key = "T";
+			append(key, texture.wrapS);
+			append(key, texture.wrapT);
+			append(key, texture.wrapR);
+		}
+
+		static void appendModes(const StateSet& stateSet, std::string& key) {
+			append(key, stateSet.renderingHint);
+			append(key, stateSet.modes.size());
+			for (const auto& mode : stateSet.modes) {
+				append(key, mode);
+			}
+			append(key, stateSet.textureModesList.size());
+			for (const auto& modes : stateSet.textureModesList) {
+				append(key, modes.size());
+				for (const auto& mode : modes) {
+					append(key, mode);
+				}
+			}
+		}
+
+		// `attributes` with each material and texture replaced by its shared copy, the image-less one for a texture
+		// with an image. Under the lock.
+		bool classAttributes(const StateSet::AttributeList& attributes, StateSet::AttributeList& shared, std::string& key) {
+			append(key, attributes.size());
+			for (const auto& attribute : attributes) {
+				auto obj = attribute.first.get();
+				if (obj && (_owned.find(obj) == _owned.end())) {
+					std::string objKey;
+					if (const auto texture = objectCast<Texture2D>(obj)) {
+						textureKey(*texture, objKey);
+					} else if (!objectCast<Material>(obj) || !keyOf(obj, objKey)) {
+						return false;
+					}
+					const auto it = _shared.find(objKey);
+					obj = static_cast<StateAttribute*>((it != _shared.end()) ? it->second : share(obj, std::move(objKey)));
+				}
+				shared.push_back({ obj, attribute.second });
+				append(key, obj);
+				append(key, attribute.second);
+			}
+			return true;
+		}
+
+		bool sharedAttributes(const StateSet::AttributeList& attributes, std::string& key) const {
+			append(key, attributes.size());
+			for (const auto& attribute : attributes) {
+				if (attribute.first && (_owned.find(attribute.first.get()) == _owned.end())) {
+					return false;
+				}
+				append(key, attribute.first.get());
+				append(key, attribute.second);
+			}
+			return true;
+		}
+
+		// Content of an internable object; a state set refers to its attributes by shared copy.
+		bool keyOf(const Object* obj, std::string& key) const {
+			if (const auto material = objectCast<Material>(obj)) {
+				key = "M";
+				append(key, material->ambient);
+				append(key, material->diffuse);
+				append(key, material->specular);
+				append(key, material->emission);
+				append(key, material->shininess);
+				return true;
+			}
+			if (const auto texture = objectCast<Texture2D>(obj)) {
+				if (texture->image) {
+					return false;
+				}
+				textureKey(*texture, key);
+				return true;
+			}
+			if (const auto stateSet = objectCast<StateSet>(obj)) {
+				key = "S";
+				appendModes(*stateSet, key);
+				std::lock_guard<std::mutex> lock(_mutex);
+				if (!sharedAttributes(stateSet->attributes, key)) {
+					return false;
+				}
+				append(key, stateSet->textureAttributesList.size());
+				for (const auto& attributes : stateSet->textureAttributesList) {
+					if (!sharedAttributes(attributes, key)) {
+						return false;
+					}
+				}
+				return true;
+			}
+			return false;
+		}
+
+		template<typename T> T* copyOf(const T& obj) {
+			const auto copy = _objects.create<T>();
+			*copy = obj;
+			return copy;
+		}
+	};
+
+	// What a read went through, per class and per version dependent layout. Bytes and time of an object leave out
+	// the objects nested in it, so the classes add up to the whole file but its header.
+	struct ReadStatistics {
+		struct Class {
+			size_t objects = 0;
+			unsigned long long bytes = 0;
+			unsigned long long ticks = 0;
+		};
+		std::map<std::string, Class, std::less<>> classes; // by file class name; pre-112 inline arrays and images included
+
+		// shared references resolved by id instead of read again
+		size_t objectHits = 0;
+		size_t arrayHits = 0;
+		size_t imageHits = 0;
+
+		enum class Branch {
+			UserData, // Object: single UserData object (before 77)
+			UserDataContainer, // Object: UserDataContainer (77+)
+			NodeDescriptions, // Node: descriptions (before 77)
+			PagedLODFrameNumber, // PagedLOD: frameNumberOfLastTraversal (before 70)
+			GeometryInlineArrays, // Geometry: inline primitive sets and arrays (before 112)
+			GeometryArrayObjects, // Geometry: primitive sets and arrays as objects (112+)
+			GeometryNodeFields, // Geometry: Node fields (154+)
+			StateSetDefineList, // StateSet: shader defines (151+)
+			TextureImageAttachment, // Texture: image attachment (95 to 153)
+			TextureSwizzle, // Texture: swizzle (98+)
+			TextureLOD, // Texture: min/max LOD and LOD bias (155+)
+			ImageClassName, // Image: class name (95+)
+			Brackets32, // 32-bit binary brackets (before 149)
+			Brackets64, // 64-bit binary brackets (149+)
+			Count
+		};
+		std::array<size_t, (size_t)Branch::Count> branches = {};
+
+		static const char* branchName(Branch branch) {
+			static const char* const names[] = {
+				"UserData (<77)", "UserDataContainer (77+)", "Node descriptions (<77)", "PagedLOD frame number (<70)",
+				"Geometry inline arrays (<112)", "Geometry array objects (112+)", "Geometry Node fields (154+)",
+				"StateSet define list (151+)", "Texture image attachment (95-153)", "Texture swizzle (98+)",
+				"Texture LOD (155+)", "Image class name (95+)", "32-bit brackets (<149)", "64-bit brackets (149+)",
+			};
+			return names[(size_t)branch];
+		}
+
+		double ticksPerSecond = 1e9; // nanoseconds, or time stamp counter cycles with ReadOptions::useTsc
+
+		// Ticks of `other` are taken in its unit when this has none yet, else converted to this one.
+		void merge(const ReadStatistics& other) {
+			if (classes.empty()) {
+				ticksPerSecond = other.ticksPerSecond;
+			}
+			const auto scale = ticksPerSecond / other.ticksPerSecond;
+			for (const auto& it : other.classes) {
+				auto& c = classes[it.first];
+				c.objects += it.second.objects;
+				c.bytes += it.second.bytes;
+				c.ticks += (scale == 1.0) ? it.second.ticks : (unsigned long long)(it.second.ticks * scale);
+			}
+			objectHits += other.objectHits;
+			arrayHits += other.arrayHits;
+			imageHits += other.imageHits;
+			for (size_t i = 0; i < branches.size(); ++i) {
+				branches[i] += other.branches[i];
+			}
+		}
+	};
+
+	// Heap bytes a parsed Data holds, by category; allocator overhead is not included.
+	struct MemoryUsage {
+		size_t sourceBuffer = 0; // the buffer Data::read() parsed, owned by the caller but kept resident by zero-copy payloads
+		size_t referencedPayload = 0; // the array, index and inline image bytes the objects point to, in it or in the detached copy
+		size_t detached = 0; // the compact payload copy Data::detach() made in place of the source buffer
+		size_t objects = 0; // the ObjectArena blocks holding the object instances and copied file names
+		size_t vectors = 0; // heap storage of the children, primitive, attribute, mode and range vectors
+		size_t statistics = 0; // ReadStatistics, when collected
+
+		size_t owned() const {
+			return detached + objects + vectors + statistics;
+		}
+
+		void merge(const MemoryUsage& other) {
+			sourceBuffer += other.sourceBuffer;
+			referencedPayload += other.referencedPayload;
+			detached += other.detached;
+			objects += other.objects;
+			vectors += other.vectors;
+			statistics += other.statistics;
+		}
+	};
+
+	struct ReadOptions {
+		bool collectStatistics = false;
+		bool useTsc = false; // time classes with the x86 time stamp counter, much cheaper than the clock; ignored elsewhere
+		StateInterner* interner = nullptr; // e.g. &StateInterner::global(); must outlive the Data read
+	};
+
 	namespace details {
 		struct Reader {
 			struct Error : std::runtime_error {
@@ -206,14 +782,18 @@ namespace miniosgb
 				Error(size_t offset_, const std::string& message) : std::runtime_error(message), offset(offset_) {}
 			};
 
-			Reader(const unsigned char* buffer, size_t length)
-				: _buffer(buffer), _length(length) {
+			Reader(const unsigned char* buffer, size_t length, ObjectArena& arena)
+				: _buffer(buffer), _length(length), _arena(arena) {
 			}
 
 			const unsigned char* _buffer;
 			const size_t _length;
 			size_t _pos = 0;
 
+			ObjectArena& _arena; // where the objects read are created
+
+			template<typename T> T* create() { return _arena.create<T>(); }
+
 			bool ended() const {
 				return (_pos == _length);
 			}
@@ -221,7 +801,85 @@ namespace miniosgb
 			unsigned int _version = 0;
 			bool _useBinaryBrackets = false;
 
-			template<typename T> T read()
+			ReadStatistics* _statistics = nullptr; // collect only when set
+			StateInterner* _interner = nullptr; // share state objects when set
+			bool _useTsc = false;
+			unsigned long long _nestedTicks = 0; // of the objects completed inside the current one
+			size_t _nestedBytes = 0;
+
+			static bool tscAvailable() {
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+				return true;
+#else
+				return false;
+#endif
+			}
+
+			unsigned long long ticks() const { return ticks(_useTsc); }
+
+			static unsigned long long ticks(bool useTsc) {
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+				if (useTsc) {
+					return __rdtsc();
+				}
+#endif
+				return (unsigned long long)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+			}
+
+			// Time stamp counter frequency, measured once against the steady clock.
+			static double tscFrequency() {
+				static const double frequency = [] {
+					const auto start = std::chrono::steady_clock::now();
+					const auto startTicks = ticks(true);
+					while (std::chrono::steady_clock::now() - start < std::chrono::milliseconds(10)) {
+					}
+					const auto seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+					return (ticks(true) - startTicks) / seconds;
+				}();
+				return frequency;
+			}
+
+			void countBranch(ReadStatistics::Branch branch) {
+				if (_statistics) {
+					++_statistics->branches[(size_t)branch];
+				}
+			}
+
+			struct ClassSample {
+				unsigned long long start;
+				size_t pos;
+				unsigned long long nestedTicks;
+				size_t nestedBytes;
+			};
+
+			// Starts the statistics of an object that began at `pos`; endClass() books it.
+			ClassSample beginClass(size_t pos) {
+				const ClassSample sample = { ticks(), pos, _nestedTicks, _nestedBytes };
+				_nestedTicks = 0;
+				_nestedBytes = 0;
+				return sample;
+			}
+
+			void endClass(std::string_view className, const ClassSample& sample) {
+				const auto ticks = this->ticks() - sample.start;
+				const auto bytes = _pos - sample.pos;
+				auto it = _statistics->classes.find(className);
+				if (it == _statistics->classes.end()) {
+					it = _statistics->classes.emplace(std::string(className), ReadStatistics::Class()).first;
+				}
+				auto& stats = it->second;
+				++stats.objects;
+				stats.ticks += ticks - _nestedTicks;
+				stats.bytes += bytes - _nestedBytes;
+				_nestedTicks = sample.nestedTicks + ticks;
+				_nestedBytes = sample.nestedBytes + bytes;
+			}
+
+			template<typename T> struct Type {};
+
+			template<typename T> T read() { return read(Type<T>()); }
+
+			template<typename T> T read(Type<T>)
 			{
 				if ((_pos + sizeof(T) > _length)) {
 					throw Error(_pos, "read beyond data length");
@@ -249,7 +907,7 @@ namespace miniosgb
 				}
 			}
 
-			template<> bool read<bool>() {
+			bool read(Type<bool>) {
 				if ((_pos + sizeof(bool) > _length)) {
 					throw Error(_pos, "read beyond data length");
 				}
@@ -261,19 +919,26 @@ namespace miniosgb
 				return value;
 			}
 
-			template<>
-			std::string read<std::string>() {
+			// A string in place in the buffer; names that are only compared or skipped cost no allocation.
+			std::string_view read(Type<std::string_view>) {
 				// readString https://github.com/openscenegraph/OpenSceneGraph/blob/OpenSceneGraph-3.6/src/osgPlugins/osg/BinaryStreamOperator.h
 				const auto size = read<int>();
 				if (size < 0) {
 					throw Error(_pos, "invalid string length");
 				}
-				std::string s(size, '\0');
-				read(const_cast<char*>(s.data()), size);
+				if (_pos + size > _length) {
+					throw Error(_pos, "read beyond data length");
+				}
+				const std::string_view s((const char*)_buffer + _pos, size);
+				_pos += size;
 				return s;
 			}
 
-			std::shared_ptr<Object> readObjectIfTrue() {
+			std::string read(Type<std::string>) {
+				return std::string(read<std::string_view>());
+			}
+
+			Object* readObjectIfTrue() {
 				// ObjectSerializer https://github.com/openscenegraph/OpenSceneGraph/blob/OpenSceneGraph-3.6/include/osgDB/Serializer
 				if (read<bool>()) {
 					return readObject();
@@ -282,10 +947,10 @@ namespace miniosgb
 				}
 			}
 
-			template<typename T> std::shared_ptr<T> readObjectData();
+			template<typename T> T* readObjectData() { return readObjectData(Type<T>()); }
 
-			template<> std::shared_ptr<PagedLOD> readObjectData<PagedLOD>() {
-				auto obj = std::make_shared<PagedLOD>();
+			PagedLOD* readObjectData(Type<PagedLOD>) {
+				auto obj = create<PagedLOD>();
 				readObjectFields<Object>(*obj);
 				readObjectFields<Node>(*obj);
 				readObjectFields<LOD>(*obj);
@@ -293,27 +958,28 @@ namespace miniosgb
 				return obj;
 			}
 
-			template<> std::shared_ptr<Group> readObjectData<Group>() {
-				auto obj = std::make_shared<Group>();
+			Group* readObjectData(Type<Group>) {
+				auto obj = create<Group>();
 				readObjectFields<Object>(*obj);
 				readObjectFields<Node>(*obj);
 				readObjectFields<Group>(*obj);
 				return obj;
 			}
 
-			template<> std::shared_ptr<Geode> readObjectData<Geode>() {
-				auto obj = std::make_shared<Geode>();
+			Geode* readObjectData(Type<Geode>) {
+				auto obj = create<Geode>();
 				readObjectFields<Object>(*obj);
 				readObjectFields<Node>(*obj);
 				readObjectFields<Geode>(*obj);
 				return obj;
 			}
 
-			template<> std::shared_ptr<Geometry> readObjectData<Geometry>() {
+			Geometry* readObjectData(Type<Geometry>) {
 				// https://github.com/openscenegraph/OpenSceneGraph/blob/OpenSceneGraph-3.6/src/osgWrappers/serializers/osg/Geometry.cpp
-				auto obj = std::make_shared<Geometry>();
+				auto obj = create<Geometry>();
 				readObjectFields<Object>(*obj);
 				if (_version >= 154) {
+					countBranch(ReadStatistics::Branch::GeometryNodeFields);
 					readObjectFields<Node>(*obj);
 				}
 				readObjectFields<Drawable>(*obj);
@@ -321,31 +987,31 @@ namespace miniosgb
 				return obj;
 			}
 
-			template<> std::shared_ptr<DrawElementsUInt> readObjectData<DrawElementsUInt>() {
-				auto obj = std::make_shared<DrawElementsUInt>();
+			DrawElementsUInt* readObjectData(Type<DrawElementsUInt>) {
+				auto obj = create<DrawElementsUInt>();
 				readObjectFields<Object>(*obj);
 				readObjectFields<PrimitiveSet>(*obj);
 				readObjectFields<DrawElementsUInt>(*obj);
 				return obj;
 			}
 
-			template<> std::shared_ptr<StateSet> readObjectData<StateSet>() {
-				auto obj = std::make_shared<StateSet>();
+			StateSet* readObjectData(Type<StateSet>) {
+				auto obj = create<StateSet>();
 				readObjectFields<Object>(*obj);
 				readObjectFields<StateSet>(*obj);
 				return obj;
 			}
 
-			template<> std::shared_ptr<Material> readObjectData<Material>() {
-				auto obj = std::make_shared<Material>();
+			Material* readObjectData(Type<Material>) {
+				auto obj = create<Material>();
 				readObjectFields<Object>(*obj);
 				readObjectFields<StateAttribute>(*obj);
 				readObjectFields<Material>(*obj);
 				return obj;
 			}
 
-			template<> std::shared_ptr<Texture2D> readObjectData<Texture2D>() {
-				auto obj = std::make_shared<Texture2D>();
+			Texture2D* readObjectData(Type<Texture2D>) {
+				auto obj = create<Texture2D>();
 				readObjectFields<Object>(*obj);
 				readObjectFields<StateAttribute>(*obj);
 				readObjectFields<Texture>(*obj);
@@ -353,43 +1019,45 @@ namespace miniosgb
 				return obj;
 			}
 
-			template<> std::shared_ptr<DefaultUserDataContainer> readObjectData<DefaultUserDataContainer>() {
-				auto obj = std::make_shared<DefaultUserDataContainer>();
+			DefaultUserDataContainer* readObjectData(Type<DefaultUserDataContainer>) {
+				auto obj = create<DefaultUserDataContainer>();
 				readObjectFields<Object>(*obj);
 				readObjectFields<DefaultUserDataContainer>(*obj);
 				return obj;
 			}
 
-			template<> std::shared_ptr<Vec3Array> readObjectData<Vec3Array>() {
-				auto obj = std::make_shared<Vec3Array>();
+			Vec3Array* readObjectData(Type<Vec3Array>) {
+				auto obj = create<Vec3Array>();
 				readObjectFields<Object>(*obj);
 				readObjectFields<Array>(*obj);
 				readObjectFields<Vec3Array>(*obj);
 				return obj;
 			}
 
-			template<> std::shared_ptr<Vec2Array> readObjectData<Vec2Array>() {
-				auto obj = std::make_shared<Vec2Array>();
+			Vec2Array* readObjectData(Type<Vec2Array>) {
+				auto obj = create<Vec2Array>();
 				readObjectFields<Object>(*obj);
 				readObjectFields<Array>(*obj);
 				readObjectFields<Vec2Array>(*obj);
 				return obj;
 			}
 
-			template<typename T> void readObjectFields(T& obj);
+			template<typename T> void readObjectFields(T& obj) { readObjectFields(static_cast<T&>(obj)); }
 
-			template<> void readObjectFields<Object>(Object& obj) {
+			void readObjectFields(Object& obj) {
 				// https://github.com/openscenegraph/OpenSceneGraph/blob/OpenSceneGraph-3.6/src/osgWrappers/serializers/osg/Object.cpp
-				const auto name = read<std::string>();
+				const auto name = read<std::string_view>();
 				read<unsigned int>(); // dataVariance
 				if (_version < 77) { // UserData
+					countBranch(ReadStatistics::Branch::UserData);
 					readObject();
 				} else { // UserDataContainer
+					countBranch(ReadStatistics::Branch::UserDataContainer);
 					readObjectIfTrue();
 				}
 			}
 
-			template<> void readObjectFields<Node>(Node& obj) {
+			void readObjectFields(Node& obj) {
 				// https://github.com/openscenegraph/OpenSceneGraph/blob/OpenSceneGraph-3.6/src/osgWrappers/serializers/osg/Node.cpp
 				if (read<bool>()) { // InitialBound
 					ReadBeginBracket();
@@ -405,38 +1073,41 @@ namespace miniosgb
 				readObjectIfTrue(); // cullCallback
 				read<bool>(); // cullingActive
 				read<unsigned int>(); // nodeMask
-				if ((_version < 77) && read<bool>()) { // descriptions
-					const auto size = read<unsigned int>();
-					ReadBeginBracket();
-					for (unsigned int i = 0; i < size; ++i) {
-						read<std::string>();
+				if (_version < 77) {
+					countBranch(ReadStatistics::Branch::NodeDescriptions);
+					if (read<bool>()) { // descriptions
+						const auto size = read<unsigned int>();
+						ReadBeginBracket();
+						for (unsigned int i = 0; i < size; ++i) {
+							read<std::string_view>();
+						}
+						ReadEndBracket();
 					}
-					ReadEndBracket();
 				}
-				obj.stateSet = std::dynamic_pointer_cast<StateSet>(readObjectIfTrue());
+				obj.stateSet = objectCast<StateSet>(readObjectIfTrue());
 			}
 
-			template<> void readObjectFields<Group>(Group& obj) {
+			void readObjectFields(Group& obj) {
 				// https://github.com/openscenegraph/OpenSceneGraph/blob/OpenSceneGraph-3.6/src/osgWrappers/serializers/osg/Group.cpp
 				if (read<bool>()) { // Children
 					const auto size = read<unsigned int>();
 					obj.children.resize(size);
 					ReadBeginBracket();
 					for (unsigned int i = 0; i < size; ++i) {
-						obj.children[i] = std::dynamic_pointer_cast<Node>(readObject());
+						obj.children[i] = objectCast<Node>(readObject());
 					}
 					ReadEndBracket();
 				}
 			}
 
-			template<> void readObjectFields<LOD>(LOD& obj) {
+			void readObjectFields(LOD& obj) {
 				// https://github.com/openscenegraph/OpenSceneGraph/blob/OpenSceneGraph-3.6/src/osgWrappers/serializers/osg/LOD.cpp
 				obj.centerMode = read<int>();
 				if (read<bool>()) { // userDefinedCenter, radius
 					obj.userDefinedCenter = read<Vec3d>();
 					obj.userDefinedRadius = read<double>();
 				}
-				const auto rangeMode = read<unsigned int>();
+				obj.rangeMode = read<LOD::RangeMode>();
 				if (read<bool>()) { // RangeList
 					const auto size = read<unsigned int>();
 					obj.rangeList.resize(size);
@@ -450,15 +1121,16 @@ namespace miniosgb
 				}
 			}
 
-			template<> void readObjectFields<PagedLOD>(PagedLOD& obj) {
+			void readObjectFields(PagedLOD& obj) {
 				// https://github.com/openscenegraph/OpenSceneGraph/blob/OpenSceneGraph-3.6/src/osgWrappers/serializers/osg/PagedLOD.cpp
 				if (read<bool>()) {
 					const auto hasDatabasePath = read<bool>();
 					if (hasDatabasePath) {
-						const auto databasePath = read<std::string>();
+						const auto databasePath = read<std::string_view>();
 					}
 				}
 				if (_version < 70) {
+					countBranch(ReadStatistics::Branch::PagedLODFrameNumber);
 					read<unsigned int>(); // frameNumberOfLastTraversal
 				}
 				read<unsigned int>(); // numChildrenThatCannotBeExpired
@@ -468,7 +1140,7 @@ namespace miniosgb
 					obj.rangeDataList.resize(fsize);
 					ReadBeginBracket();
 					for (unsigned int i = 0; i < fsize; ++i) {
-						obj.rangeDataList[i].filename = read<std::string>();
+						obj.rangeDataList[i].filename = read<std::string_view>();
 					}
 					ReadEndBracket();
 					const auto psize = read<unsigned int>();
@@ -487,26 +1159,26 @@ namespace miniosgb
 					obj.children.resize(size);
 					ReadBeginBracket();
 					for (unsigned int i = 0; i < size; ++i) {
-						obj.children[i] = std::dynamic_pointer_cast<Node>(readObject());
+						obj.children[i] = objectCast<Node>(readObject());
 					}
 					ReadEndBracket();
 				}
 			}
 
-			template<> void readObjectFields<Geode>(Geode& obj) {
+			void readObjectFields(Geode& obj) {
 				if (read<bool>()) { // Drawables
 					const auto size = read<unsigned int>();
 					obj.drawables.resize(size);
 					ReadBeginBracket();
 					for (unsigned int i = 0; i < size; ++i) {
-						obj.drawables[i] = std::dynamic_pointer_cast<Drawable>(readObject());
+						obj.drawables[i] = objectCast<Drawable>(readObject());
 					}
 					ReadEndBracket();
 				}
 			}
 
-			template<> void readObjectFields<Drawable>(Drawable& obj) {
-				obj.stateSet = std::dynamic_pointer_cast<StateSet>(readObjectIfTrue());
+			void readObjectFields(Drawable& obj) {
+				obj.stateSet = objectCast<StateSet>(readObjectIfTrue());
 				if (read<bool>()) { // InitialBound
 					double dummy[6];
 					read(dummy, 6);
@@ -523,25 +1195,26 @@ namespace miniosgb
 				//TODO: MORE
 			}
 
-			template<> void readObjectFields<PrimitiveSet>(PrimitiveSet& obj) {
+			void readObjectFields(PrimitiveSet& obj) {
 				read<int>(); // NumInstances;
 				obj.mode = read<unsigned int>();
 				obj.indexCount = read<unsigned int>();
 				obj.indexData = _buffer + _pos;
 			}
 
-			template<> void readObjectFields<DrawElementsUInt>(DrawElementsUInt& obj) {
+			void readObjectFields(DrawElementsUInt& obj) {
 				_pos += obj.indexCount * sizeof(unsigned int);
 			}
 
-			template<> void readObjectFields<Geometry>(Geometry& obj) {
+			void readObjectFields(Geometry& obj) {
 				{ // PrimitiveSet
 					const auto size = read<unsigned int>();
 					if (_version < 112) {
+						countBranch(ReadStatistics::Branch::GeometryInlineArrays);
 						ReadBeginBracket();
 						obj.primitives.resize(size);
 						for (unsigned int p = 0; p < size; ++p) {
-							const auto prim = std::make_shared<PrimitiveSet>();
+							const auto prim = create<PrimitiveSet>();
 							read<unsigned int>(); // NumInstances
 							prim->mode = read<unsigned int>();
 
@@ -556,9 +1229,10 @@ namespace miniosgb
 						}
 						ReadEndBracket();
 					} else {
+						countBranch(ReadStatistics::Branch::GeometryArrayObjects);
 						obj.primitives.resize(size);
 						for (unsigned int p = 0; p < size; ++p) {
-							obj.primitives[p] = std::dynamic_pointer_cast<PrimitiveSet>(readObject());
+							obj.primitives[p] = objectCast<PrimitiveSet>(readObject());
 						}
 					}
 				}
@@ -612,28 +1286,28 @@ namespace miniosgb
 					}
 					read<bool>(); // FastPathHint
 				} else {
-					obj.vertexData = std::dynamic_pointer_cast<Array>(readObjectIfTrue());
-					obj.normalData = std::dynamic_pointer_cast<Array>(readObjectIfTrue());
-					obj.colorData = std::dynamic_pointer_cast<Array>(readObjectIfTrue());
-					obj.secondaryColorData = std::dynamic_pointer_cast<Array>(readObjectIfTrue());
-					obj.fogCoordData = std::dynamic_pointer_cast<Array>(readObjectIfTrue());
+					obj.vertexData = objectCast<Array>(readObjectIfTrue());
+					obj.normalData = objectCast<Array>(readObjectIfTrue());
+					obj.colorData = objectCast<Array>(readObjectIfTrue());
+					obj.secondaryColorData = objectCast<Array>(readObjectIfTrue());
+					obj.fogCoordData = objectCast<Array>(readObjectIfTrue());
 					{
 						const auto size = read<unsigned int>();
 						obj.texCoordDataList.resize(size);
 						for (unsigned int i = 0; i < size; ++i) {
-							obj.texCoordDataList[i] = std::dynamic_pointer_cast<Array>(readObject());
+							obj.texCoordDataList[i] = objectCast<Array>(readObject());
 						}
 					}
 					{ // VertexAttribData
 						const auto size = read<unsigned int>();
 						for (unsigned int i = 0; i < size; ++i) {
-							const auto vertexAttribData = std::dynamic_pointer_cast<Array>(readObject());
+							const auto vertexAttribData = objectCast<Array>(readObject());
 						}
 					}
 				}
 			}
 
-			template<> void readObjectFields<StateSet>(StateSet& obj) {
+			void readObjectFields(StateSet& obj) {
 				if (read<bool>()) {
 					const auto size = read<unsigned int>();
 					ReadBeginBracket();
@@ -648,7 +1322,7 @@ namespace miniosgb
 					const auto size = read<unsigned int>();
 					ReadBeginBracket();
 					for (unsigned int i = 0; i < size; ++i) {
-						const auto attribute = std::dynamic_pointer_cast<StateAttribute>(readObject());
+						const auto attribute = objectCast<StateAttribute>(readObject());
 						const auto value = read<unsigned int>();
 						if (attribute) {
 							obj.attributes.emplace_back(attribute, value);
@@ -681,7 +1355,7 @@ namespace miniosgb
 						const auto size_ = read<unsigned int>();
 						ReadBeginBracket();
 						for (unsigned int j = 0; j < size_; ++j) {
-							auto attribute = std::dynamic_pointer_cast<StateAttribute>(readObject());
+							auto attribute = objectCast<StateAttribute>(readObject());
 							const auto value = read<unsigned int>();
 							if (attribute) {
 								attributes.emplace_back(attribute, value);
@@ -704,28 +1378,31 @@ namespace miniosgb
 				obj.renderingHint = read<StateSet::RenderingHint>();
 				const auto renderBinMode = read<unsigned int>();
 				const auto binNumber = read<unsigned int>();
-				const auto binName = read<std::string>();
+				const auto binName = read<std::string_view>();
 				const auto nestRenderBins = read<bool>();
 				readObjectIfTrue();
 				readObjectIfTrue();
-				if ((_version >= 151) && read<bool>()) {
-					const auto size = read<unsigned int>();
-					ReadBeginBracket();
-					for (unsigned int i = 0; i < size; ++i) {
-						read<std::string>();
-						read<std::string>();
-						read<int>();
+				if (_version >= 151) {
+					countBranch(ReadStatistics::Branch::StateSetDefineList);
+					if (read<bool>()) {
+						const auto size = read<unsigned int>();
+						ReadBeginBracket();
+						for (unsigned int i = 0; i < size; ++i) {
+							read<std::string_view>();
+							read<std::string_view>();
+							read<int>();
+						}
+						ReadEndBracket();
 					}
-					ReadEndBracket();
 				}
 			}
 
-			template<> void readObjectFields<StateAttribute>(StateAttribute& obj) {
+			void readObjectFields(StateAttribute& obj) {
 				readObjectIfTrue();
 				readObjectIfTrue();
 			}
 
-			template<> void readObjectFields<Material>(Material& obj) {
+			void readObjectFields(Material& obj) {
 				const auto colorMode = read<unsigned int>();
 				if (read<bool>()) {
 					obj.ambient.frontAndBack = read<bool>();
@@ -754,7 +1431,7 @@ namespace miniosgb
 				}
 			}
 
-			template<> void readObjectFields<Texture>(Texture& obj) {
+			void readObjectFields(Texture& obj) {
 				if (read<bool>()) {
 					obj.wrapS = read<Texture::WrapMode>();
 				}
@@ -791,26 +1468,33 @@ namespace miniosgb
 				const auto shadowComparisonFunc = read<unsigned int>();
 				const auto shadowTextureMode = read<unsigned int>();
 				const auto shadowAmbient = read<float>();
-				if ((_version >= 95) && (_version < 154) && read<bool>()) {
-					int dummy[6]; read(dummy, 6);
+				if ((_version >= 95) && (_version < 154)) {
+					countBranch(ReadStatistics::Branch::TextureImageAttachment);
+					if (read<bool>()) {
+						int dummy[6]; read(dummy, 6);
+					}
 				}
-				if ((_version >= 98) && read<bool>()) {
-					const auto swizzle = read<std::string>();
+				if (_version >= 98) {
+					countBranch(ReadStatistics::Branch::TextureSwizzle);
+					if (read<bool>()) {
+						const auto swizzle = read<std::string_view>();
+					}
 				}
 				if (_version >= 155) {
+					countBranch(ReadStatistics::Branch::TextureLOD);
 					const auto minLOD = read<float>();
 					const auto maxLOD = read<float>();
 					const auto lodBias = read<float>();
 				}
 			}
 
-			template<> void readObjectFields<Texture2D>(Texture2D& obj) {
+			void readObjectFields(Texture2D& obj) {
 				obj.image = readImage();
 				const auto textureWidth = read<unsigned int>();
 				const auto textureHeight = read<unsigned int>();
 			}
 
-			template<> void readObjectFields<DefaultUserDataContainer>(DefaultUserDataContainer& obj) {
+			void readObjectFields(DefaultUserDataContainer& obj) {
 				if (read<bool>()) { // UserData
 					ReadBeginBracket();
 					readObject();
@@ -820,7 +1504,7 @@ namespace miniosgb
 					const auto size = read<unsigned int>();
 					ReadBeginBracket();
 					for (unsigned int i = 0; i < size; ++i) {
-						read<std::string>();
+						read<std::string_view>();
 					}
 					ReadEndBracket();
 				}
@@ -834,7 +1518,7 @@ namespace miniosgb
 				}
 			}
 
-			template<> void readObjectFields<Array>(Array& obj) {
+			void readObjectFields(Array& obj) {
 				obj.binding = read<Array::Binding>();
 				obj.normalize = read<bool>();
 				read<bool>(); // PreserveDataType
@@ -842,27 +1526,35 @@ namespace miniosgb
 				obj.elementData = _buffer + _pos;
 			}
 
-			template<> void readObjectFields<Vec2Array>(Vec2Array& obj) {
+			void readObjectFields(Vec2Array& obj) {
 				_pos += obj.elementCount * sizeof(float) * 2;
 			}
 
-			template<> void readObjectFields<Vec3Array>(Vec3Array& obj) {
+			void readObjectFields(Vec3Array& obj) {
 				_pos += obj.elementCount * sizeof(float) * 3;
 			}
 
-			std::unordered_map<unsigned int, std::shared_ptr<Object>> _objects;
-			std::shared_ptr<Object> readObject() {
-				const auto className = read<std::string>();
-				if (className.empty()) {
+			std::unordered_map<unsigned int, Object*> _objects;
+			Object* readObject() {
+				const auto objectPos = _pos;
+				const auto className = read<std::string_view>();
+				if (className.empty() || (className == "NULL")) { // OutputStream writes null objects as "NULL"
 					return nullptr;
 				}
 				ReadBeginBracket();
 				const auto uniqueId = read<unsigned int>();
 				for (const auto it = _objects.find(uniqueId); it != _objects.end();) {
+					if (_statistics) {
+						++_statistics->objectHits;
+					}
 					return it->second;
 				}
 
-				std::shared_ptr<Object> object;
+				ClassSample sample = {};
+				if (_statistics) {
+					sample = beginClass(objectPos);
+				}
+				Object* object = nullptr;
 				if (className == "osg::PagedLOD") {
 					object = readObjectData<PagedLOD>();
 				} else if (className == "osg::Group") {
@@ -886,34 +1578,54 @@ namespace miniosgb
 				} else if (className == "osg::Vec2Array") {
 					object = readObjectData<Vec2Array>();
 				} else {
-					throw Error(_pos, "unsupported object class: " + className);
+					throw Error(_pos, "unsupported object class: " + std::string(className));
 				}
 				ReadEndBracket();
+				if (_statistics) {
+					endClass(className, sample);
+				}
 
 				if (object) {
 					object->uniqueId = uniqueId;
+					if (_interner) {
+						const auto shared = _interner->intern(object);
+						if (shared != object) {
+							// nested objects come after their parent, so the parent is the latest only if they were shared too
+							_arena.discardLast(object, visit(*object, [](const auto& concrete) { return sizeof(concrete); }));
+							object = shared;
+						}
+					}
 					_objects[uniqueId] = object;
 				}
 				return object;
 			}
 
-			std::unordered_map<unsigned int, std::shared_ptr<Image>> _images;
-			std::shared_ptr<Image> readImage() {
+			std::unordered_map<unsigned int, Image*> _images;
+			Image* readImage() {
 				// InputStream::ReadImage() https://github.com/openscenegraph/OpenSceneGraph/blob/OpenSceneGraph-3.6/src/osgDB/InputStream.cpp
+				const auto imagePos = _pos;
 				if (read<bool>()) {
 					if (_version > 94) {
-						const auto className = read<std::string>();
+						countBranch(ReadStatistics::Branch::ImageClassName);
+						const auto className = read<std::string_view>();
 					}
 					const auto uniqueId = read<unsigned int>();
 					for (const auto it = _images.find(uniqueId); it != _images.end();) {
+						if (_statistics) {
+							++_statistics->imageHits;
+						}
 						return it->second;
 					}
+					ClassSample sample = {};
+					if (_statistics) {
+						sample = beginClass(imagePos);
+					}
 
-					auto image = std::make_shared<Image>();
+					auto image = create<Image>();
 					image->uniqueId = uniqueId;
 					_images[uniqueId] = image;
 
-					const auto name = read<std::string>();
+					const auto name = read<std::string_view>();
 					const auto writeHint = read<unsigned int>();
 					const auto decision = read<unsigned int>();
 					if (decision == 1) { // IMAGE_INLINE_FILE 
@@ -935,33 +1647,44 @@ namespace miniosgb
 						throw Error(_pos, "invalid image decision: " + std::to_string(decision));
 					}
 					readObjectFields<Object>(*image);
+					if (_statistics) {
+						endClass("osg::Image", sample);
+					}
 					return image;
 				} else {
 					return {};
 				}
 			}
 
-			std::unordered_map<unsigned int, std::shared_ptr<Array>> _arrays;
-			std::shared_ptr<Array> ReadArray() {
+			std::unordered_map<unsigned int, Array*> _arrays;
+			Array* ReadArray() {
+				const auto arrayPos = _pos;
 				if (read<bool>()) { // hasArray
 					const auto uniqueId = read<unsigned int>();
 					for (const auto it = _arrays.find(uniqueId); it != _arrays.end();) {
+						if (_statistics) {
+							++_statistics->arrayHits;
+						}
 						return it->second;
 					}
-					std::shared_ptr<Array> arr;
+					ClassSample sample = {};
+					if (_statistics) {
+						sample = beginClass(arrayPos);
+					}
+					Array* arr = nullptr;
 
 					//https://github.com/openscenegraph/OpenSceneGraph/blob/OpenSceneGraph-3.6/include/osgDB/DataTypes
 					const auto type = read<int>();
 					switch (type)
 					{
 						case 15: // ID_VEC2_ARRAY 
-							arr = std::make_shared<Vec2Array>();
+							arr = create<Vec2Array>();
 							break;
 						case 16: // ID_VEC3_ARRAY 
-							arr = std::make_shared<Vec3Array>();
+							arr = create<Vec3Array>();
 							break;
 						case 17: // ID_VEC4_ARRAY
-							arr = std::make_shared<Vec4Array>();
+							arr = create<Vec4Array>();
 							break;
 						default:
 							throw Error(_pos, "unsupported array type: " + std::to_string(type));
@@ -982,6 +1705,9 @@ namespace miniosgb
 					}
 					arr->binding = read<Array::Binding>();
 					arr->normalize = (read<unsigned int>() != 0);
+					if (_statistics) {
+						endClass((type == 15) ? "osg::Vec2Array" : (type == 16) ? "osg::Vec3Array" : "osg::Vec4Array", sample);
+					}
 					return arr;
 				}
 				return nullptr;
@@ -990,8 +1716,10 @@ namespace miniosgb
 			void ReadBeginBracket() {
 				if (_useBinaryBrackets) {
 					if (_version > 148) {
+						countBranch(ReadStatistics::Branch::Brackets64);
 						_pos += sizeof(long long);
 					} else {
+						countBranch(ReadStatistics::Branch::Brackets32);
 						_pos += sizeof(int);
 					}
 				}
@@ -1020,27 +1748,251 @@ namespace miniosgb
 				}
 				_useBinaryBrackets = ((attributes & 0x04) != 0);
 
-				const auto compressorName = read<std::string>();
+				const auto compressorName = read<std::string_view>();
 				if (compressorName != "0") {
-					throw Error(_pos, "unsupported compressor: " + compressorName);
+					throw Error(_pos, "unsupported compressor: " + std::string(compressorName));
+				}
+			}
+		};
+	}
+
+	namespace details {
+		// Walks the object graph once, counting the vectors and payloads of shared objects a single time.
+		class MemoryCounter {
+		public:
+			// Objects outside `arena` (shared by a StateInterner) are left to their owner.
+			MemoryCounter(MemoryUsage& usage, const ObjectArena* arena = nullptr) : _usage(usage), _arena(arena) {}
+
+			void add(const Object* obj) {
+				if ((obj == nullptr) || (_arena && !_arena->owns(obj)) || !_visited.insert(obj).second) {
+					return;
+				}
+				if (const auto node = objectCast<Node>(obj)) {
+					add(node->stateSet.get());
+				}
+				if (const auto group = objectCast<Group>(obj)) {
+					addVector(group->children);
+					for (const auto& child : group->children) {
+						add(child.get());
+					}
+				}
+				if (const auto lod = objectCast<LOD>(obj)) {
+					addVector(lod->rangeList);
+				}
+				if (const auto plod = objectCast<PagedLOD>(obj)) {
+					addVector(plod->rangeDataList);
+				}
+				if (const auto geode = objectCast<Geode>(obj)) {
+					addVector(geode->drawables);
+					for (const auto& drawable : geode->drawables) {
+						add(drawable.get());
+					}
+				}
+				if (const auto geometry = objectCast<Geometry>(obj)) {
+					addVector(geometry->primitives);
+					addVector(geometry->texCoordDataList);
+					for (const auto& prim : geometry->primitives) {
+						add(prim.get());
+					}
+					add(geometry->vertexData.get());
+					add(geometry->normalData.get());
+					add(geometry->colorData.get());
+					add(geometry->secondaryColorData.get());
+					add(geometry->fogCoordData.get());
+					for (const auto& texCoords : geometry->texCoordDataList) {
+						add(texCoords.get());
+					}
+				}
+				if (const auto prim = objectCast<PrimitiveSet>(obj)) {
+					_usage.referencedPayload += size_t(prim->indexCount) * sizeof(unsigned int);
+				}
+				if (const auto arr = objectCast<Array>(obj)) {
+					_usage.referencedPayload += size_t(arr->elementCount) * arr->elementSize;
+				}
+				if (const auto stateSet = objectCast<StateSet>(obj)) {
+					addVector(stateSet->modes);
+					addVector(stateSet->attributes);
+					addVector(stateSet->textureModesList);
+					addVector(stateSet->textureAttributesList);
+					for (const auto& modes : stateSet->textureModesList) {
+						addVector(modes);
+					}
+					for (const auto& attribute : stateSet->attributes) {
+						add(attribute.first.get());
+					}
+					for (const auto& attributes : stateSet->textureAttributesList) {
+						addVector(attributes);
+						for (const auto& attribute : attributes) {
+							add(attribute.first.get());
+						}
+					}
+				}
+				if (const auto texture = objectCast<Texture2D>(obj)) {
+					add(texture->image.get());
+				}
+				if (const auto image = objectCast<Image>(obj)) {
+					_usage.referencedPayload += image->dataLength;
+				}
+			}
+
+			void add(const ReadStatistics& statistics) {
+				// a red-black tree node holds the value, three links and the color
+				for (const auto& it : statistics.classes) {
+					_usage.statistics += sizeof(it) + 4 * sizeof(void*);
+					addString(it.first, _usage.statistics);
+				}
+			}
+
+		private:
+			MemoryUsage& _usage;
+			const ObjectArena* _arena;
+			std::unordered_set<const Object*> _visited;
+
+			template<typename T> void addVector(const std::vector<T>& v) {
+				_usage.vectors += v.capacity() * sizeof(T);
+			}
+
+			static void addString(const std::string& s, size_t& bytes) {
+				static const auto smallCapacity = std::string().capacity();
+				if (s.capacity() > smallCapacity) {
+					bytes += s.capacity() + 1;
 				}
 			}
 		};
 	}
 
+	// The payloads Data::detach() keeps; arrays are selected by the role the geometries use them in.
+	struct DetachOptions {
+		bool positions = true;
+		bool normals = false;
+		bool texCoords = true;
+		bool colors = false; // also secondary colors and fog coordinates
+		bool indices = true;
+		bool images = false; // inline image files, often decoded or uploaded already
+	};
+
 	struct Data {
-		std::shared_ptr<Object> rootObject;
+		Ref<Object> rootObject;
+		ObjectArena objects; // owns every object of the graph; the links between them don't
+		ReadStatistics statistics; // empty unless ReadOptions::collectStatistics
+		const unsigned char* source = nullptr; // the buffer read() parsed; arrays, indices and images point into it
+		size_t sourceLength = 0;
+		std::unique_ptr<unsigned char[]> detachedPayload; // after detach(), the kept payloads in place of the source
+		size_t detachedLength = 0;
+
+		// New object owned by this Data, to build or extend a graph with.
+		template<typename T> T* create() { return objects.create<T>(); }
+		std::string_view copyString(std::string_view s) { return objects.copyString(s); }
+
+		// What this Data costs in memory, to size caches by instead of the file size.
+		MemoryUsage memoryUsage() const {
+			MemoryUsage usage;
+			usage.sourceBuffer = sourceLength;
+			usage.detached = detachedLength;
+			usage.objects = objects.capacity();
+			details::MemoryCounter counter(usage, &objects);
+			counter.add(rootObject.get());
+			counter.add(statistics);
+			return usage;
+		}
+
+		// Copies the selected payloads into one tightly packed allocation owned by this Data, and the file names into
+		// the arena, so the source buffer can be released. Payloads not selected are dropped: their pointers become null
+		// and their counts zero. Objects of other arenas (e.g. shared by a StateInterner) are left as they are.
+		void detach(const DetachOptions& options = {}) {
+			std::unordered_set<const Array*> keptArrays;
+			objects.forEach([&](Object* obj) {
+				if (const auto geometry = objectCast<Geometry>(obj)) {
+					const auto keep = [&](const Ref<Array>& arr, bool selected) {
+						if (arr && selected) {
+							keptArrays.insert(arr.get());
+						}
+					};
+					keep(geometry->vertexData, options.positions);
+					keep(geometry->normalData, options.normals);
+					keep(geometry->colorData, options.colors);
+					keep(geometry->secondaryColorData, options.colors);
+					keep(geometry->fogCoordData, options.colors);
+					for (const auto& texCoords : geometry->texCoordDataList) {
+						keep(texCoords, options.texCoords);
+					}
+				}
+			});
+			const auto forEachPayload = [&](auto&& fn) {
+				objects.forEach([&](Object* obj) {
+					if (const auto arr = objectCast<Array>(obj)) {
+						fn(arr->elementData, arr->elementCount, size_t(arr->elementCount) * arr->elementSize, keptArrays.count(arr) > 0);
+					} else if (const auto prim = objectCast<PrimitiveSet>(obj)) {
+						fn(prim->indexData, prim->indexCount, size_t(prim->indexCount) * sizeof(unsigned int), options.indices);
+					} else if (const auto image = objectCast<Image>(obj)) {
+						fn(image->data, image->dataLength, size_t(image->dataLength), options.images);
+					}
+				});
+			};
+
+			// a payload several objects point to is copied once; offsets stay 4-byte aligned for floats and indices
+			std::map<std::pair<const unsigned char*, size_t>, size_t> offsets;
+			size_t length = 0;
+			forEachPayload([&](const unsigned char* payload, unsigned int, size_t size, bool keep) {
+				if (keep && payload && (size > 0) && offsets.emplace(std::make_pair(payload, size), length).second) {
+					length += (size + 3) & ~size_t(3);
+				}
+			});
+			auto buffer = std::make_unique<unsigned char[]>(std::max<size_t>(length, 1));
+			for (const auto& it : offsets) {
+				memcpy(buffer.get() + it.second, it.first.first, it.first.second);
+			}
+			forEachPayload([&](const unsigned char*& payload, unsigned int& count, size_t size, bool keep) {
+				if (keep && payload && (size > 0)) {
+					payload = buffer.get() + offsets.find(std::make_pair(payload, size))->second;
+				} else {
+					payload = nullptr;
+					count = 0;
+				}
+			});
+			objects.forEach([&](Object* obj) {
+				if (const auto plod = objectCast<PagedLOD>(obj)) {
+					for (auto& range : plod->rangeDataList) {
+						range.filename = objects.copyString(range.filename);
+					}
+				}
+			});
+
+			detachedPayload = std::move(buffer);
+			detachedLength = length;
+			source = nullptr;
+			sourceLength = 0;
+		}
 
 		static std::unique_ptr<Data> read(const unsigned char* buffer, size_t length, std::string* error = nullptr)
 		{
+			return read(buffer, length, ReadOptions(), error);
+		}
+
+		static std::unique_ptr<Data> read(const unsigned char* buffer, size_t length, const ReadOptions& options, std::string* error = nullptr)
+		{
+			MINIOSGB_TRACE_SCOPE("parse", "Data::read");
 #ifndef _DEBUG
 			try {
 #endif
-				details::Reader reader(buffer, length);
-				reader.readHeader();
-
 				auto data = std::make_unique<Data>();
-				data->rootObject = reader.readObject();
+				details::Reader reader(buffer, length, data->objects);
+				data->source = buffer;
+				data->sourceLength = length;
+				reader._interner = options.interner;
+				if (options.collectStatistics) {
+					reader._statistics = &data->statistics;
+					reader._useTsc = options.useTsc && details::Reader::tscAvailable();
+					data->statistics.ticksPerSecond = reader._useTsc ? details::Reader::tscFrequency() : 1e9;
+				}
+				{
+					MINIOSGB_TRACE_SCOPE("parse", "header");
+					reader.readHeader();
+				}
+				{
+					MINIOSGB_TRACE_SCOPE("parse", "object graph");
+					data->rootObject = reader.readObject();
+				}
 				if (data->rootObject && reader.ended()) {
 					return data;
 				} else {
@@ -0,0 +1,529 @@
+#pragma once
+#include "miniosgb_gltf.h"
+#include "miniosgb_parallel.h"
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <memory>
+
+namespace miniosgb
+{
+	struct TilesetOptions {
+		enum class Format { B3dm, Glb };
+		Format format = Format::B3dm; // b3dm for 3D Tiles 1.0 viewers, glb content for 3D Tiles 1.1
+		GltfOptions gltf; // yUp and finestOnly are forced, as 3D Tiles expects Y-up glTF and every level as its own tile
+
+		// Geometric errors are derived from the PagedLOD ranges so the viewer switches levels where OSG would.
+		double maxScreenSpaceError = 16; // the viewer's setting the errors are tuned for
+		double screenHeight = 1080; // pixels, for DISTANCE_FROM_EYE_POINT ranges
+		double fieldOfView = 60; // vertical, degrees, for DISTANCE_FROM_EYE_POINT ranges
+
+		// Column-major local-to-ECEF matrix of the top tileset's root, e.g. enuTransform() of the SRS origin.
+		std::array<double, 16> transform = { 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1 };
+
+		unsigned int readThreads = 2;
+		unsigned int convertThreads = 0; // 0: one per hardware thread
+		unsigned int writeThreads = 2;
+		size_t queueCapacity = 64; // tiles in flight between two stages
+	};
+
+	struct TilesetStats {
+		size_t tiles = 0; // converted, including tiles without geometry
+		size_t failed = 0;
+		unsigned long long bytesRead = 0;
+		unsigned long long bytesWritten = 0;
+		double seconds = 0;
+	};
+
+	// East-north-up frame at a WGS84 position as a column-major local-to-ECEF matrix.
+	inline std::array<double, 16> enuTransform(double latitude, double longitude, double height) {
+		const double pi = 3.14159265358979323846;
+		const double a = 6378137.0;
+		const double e2 = 6.69437999014e-3;
+		const auto lat = latitude * pi / 180;
+		const auto lon = longitude * pi / 180;
+		const auto sinLat = std::sin(lat), cosLat = std::cos(lat);
+		const auto sinLon = std::sin(lon), cosLon = std::cos(lon);
+		const auto n = a / std::sqrt(1 - e2 * sinLat * sinLat);
+		return {
+			-sinLon, cosLon, 0, 0, // east
+			-sinLat * cosLon, -sinLat * sinLon, cosLat, 0, // north
+			cosLat * cosLon, cosLat * sinLon, sinLat, 0, // up
+			(n + height) * cosLat * cosLon, (n + height) * cosLat * sinLon, (n * (1 - e2) + height) * sinLat, 1
+		};
+	}
+
+	namespace details {
+		// Root tiles of a Smart3D/ContextCapture style dataset: <dir>/Tile_X/Tile_X.osgb and top-level .osgb files.
+		inline std::vector<std::string> findRootTiles(const std::string& dataDir) {
+			std::vector<std::string> roots;
+			std::error_code ec;
+			for (std::filesystem::directory_iterator it(dataDir, ec), end; !ec && (it != end); it.increment(ec)) {
+				const auto& path = it->path();
+				if (it->is_directory(ec)) {
+					if (std::filesystem::is_regular_file(path / (path.filename().string() + ".osgb"), ec)) {
+						roots.push_back(path.filename().string() + "/" + path.filename().string());
+					}
+				} else if (path.extension() == ".osgb") {
+					roots.push_back(path.stem().string());
+				}
+			}
+			std::sort(roots.begin(), roots.end());
+			return roots;
+		}
+
+		class TilesetConverter {
+		public:
+			TilesetConverter(const std::string& dataDir, const std::string& outputDir, const TilesetOptions& options)
+				: _dataDir(dataDir), _outputDir(outputDir), _options(options), _gltf(options.gltf),
+				_converted(options.queueCapacity), _encoded(options.queueCapacity) {
+				_gltf.yUp = true;
+				_gltf.finestOnly = false;
+			}
+
+			bool run(TilesetStats& stats, std::string* error) {
+				const auto start = std::chrono::steady_clock::now();
+				for (const auto& root : findRootTiles(_dataDir)) {
+					_roots.push_back(addTile(root));
+				}
+				if (_roots.empty()) {
+					if (error) {
+						*error = "no tiles found in " + _dataDir;
+					}
+					return false;
+				}
+
+				std::vector<std::thread> threads;
+				const auto spawn = [&](unsigned int count, void (TilesetConverter::*stage)()) {
+					for (unsigned int i = 0, n = std::max(1u, count); i < n; ++i) {
+						threads.emplace_back(stage, this);
+					}
+				};
+				spawn(_options.readThreads, &TilesetConverter::readStage);
+				spawn(defaultThreadCount(_options.convertThreads), &TilesetConverter::convertStage);
+				spawn(_options.writeThreads, &TilesetConverter::writeStage);
+				for (auto& thread : threads) {
+					thread.join();
+				}
+
+				const bool ok = writeTilesets();
+				stats.tiles = _tiles.size() - _errors.size();
+				stats.failed = _errors.size();
+				stats.bytesRead = _bytesRead;
+				stats.bytesWritten = _bytesWritten;
+				stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+				if (!_errors.empty() && error) {
+					*error = _errors.front();
+					if (_errors.size() > 1) {
+						*error += " (and " + std::to_string(_errors.size() - 1) + " more failures)";
+					}
+				}
+				return ok && _errors.empty();
+			}
+
+		private:
+			struct Tile {
+				std::string path; // relative to the data directory, generic separators, no extension
+				Box3d content;
+				Box3d bounds; // content and all descendants
+				double geometricError = 0;
+				std::vector<size_t> children;
+				bool hasContent = false;
+				bool ok = false;
+				int state = 0; // bounds computation: 0 = pending, 1 = visiting, 2 = done
+			};
+
+			struct Job {
+				size_t tile;
+				std::vector<unsigned char> buffer;
+				std::unique_ptr<Data> data;
+				Glb glb;
+				std::vector<unsigned char> header; // b3dm header and feature table
+			};
+
+			const std::string _dataDir;
+			const std::string _outputDir;
+			const TilesetOptions& _options;
+			GltfOptions _gltf;
+
+			std::mutex _mutex; // guards everything up to _errors
+			std::condition_variable _pendingChanged;
+			std::vector<std::unique_ptr<Tile>> _tiles;
+			std::unordered_map<std::string, size_t> _tileIndices;
+			std::deque<size_t> _pending; // discovered, not yet read
+			size_t _outstanding = 0; // discovered, not yet written or failed
+			std::vector<std::string> _errors;
+
+			std::vector<size_t> _roots;
+			BoundedQueue<std::unique_ptr<Job>> _converted;
+			BoundedQueue<std::unique_ptr<Job>> _encoded;
+			std::atomic<unsigned long long> _bytesRead{ 0 };
+			std::atomic<unsigned long long> _bytesWritten{ 0 };
+
+			const char* contentExtension() const {
+				return (_options.format == TilesetOptions::Format::B3dm) ? ".b3dm" : ".glb";
+			}
+
+			// must be called with _mutex held, or before the stages start
+			size_t addTile(const std::string& path) {
+				const auto it = _tileIndices.find(path);
+				if (it != _tileIndices.end()) {
+					return it->second;
+				}
+				const auto index = _tiles.size();
+				_tiles.push_back(std::make_unique<Tile>());
+				_tiles.back()->path = path;
+				_tileIndices.emplace(path, index);
+				_pending.push_back(index);
+				++_outstanding;
+				_pendingChanged.notify_one();
+				return index;
+			}
+
+			Tile& tile(size_t index) {
+				std::lock_guard<std::mutex> lock(_mutex);
+				return *_tiles[index];
+			}
+
+			void finish(size_t index, const std::string& failure = std::string()) {
+				std::lock_guard<std::mutex> lock(_mutex);
+				if (failure.empty()) {
+					_tiles[index]->ok = true;
+				} else {
+					_errors.push_back(failure);
+				}
+				if (--_outstanding == 0) {
+					// nothing left that could discover more tiles
+					_pendingChanged.notify_all();
+					_converted.close();
+					_encoded.close();
+				}
+			}
+
+			bool nextPending(size_t& index) {
+				std::unique_lock<std::mutex> lock(_mutex);
+				_pendingChanged.wait(lock, [this] { return !_pending.empty() || (_outstanding == 0); });
+				if (_pending.empty()) {
+					return false;
+				}
+				index = _pending.front();
+				_pending.pop_front();
+				return true;
+			}
+
+			void readStage() {
+				size_t index;
+				while (nextPending(index)) {
+					auto job = std::make_unique<Job>();
+					job->tile = index;
+					const auto filename = _dataDir + "/" + tile(index).path + ".osgb";
+					std::string error;
+					if (!readFile(filename.c_str(), job->buffer, &error)) {
+						finish(index, error);
+						continue;
+					}
+					_bytesRead += job->buffer.size();
+					_converted.push(std::move(job));
+				}
+			}
+
+			void convertStage() {
+				std::unique_ptr<Job> job;
+				while (_converted.pop(job)) {
+					const auto index = job->tile;
+					try {
+						MINIOSGB_TRACE_SCOPE("convert", "3dtiles convert");
+						std::string error;
+						if (convert(*job, &error)) {
+							if (!job->glb.slices.empty()) {
+								_encoded.push(std::move(job));
+							} else {
+								finish(index);
+							}
+						} else {
+							finish(index, error);
+						}
+					} catch (const std::exception& e) {
+						finish(index, _dataDir + "/" + tile(index).path + ".osgb: " + e.what());
+					}
+				}
+			}
+
+			void writeStage() {
+				std::unique_ptr<Job> job;
+				while (_encoded.pop(job)) {
+					MINIOSGB_TRACE_SCOPE("convert", "3dtiles write");
+					const auto filename = _outputDir + "/" + tile(job->tile).path + contentExtension();
+					std::error_code ec;
+					std::filesystem::create_directories(std::filesystem::path(filename).parent_path(), ec);
+					std::vector<IoSlice> slices;
+					slices.reserve(job->glb.slices.size() + 1);
+					if (!job->header.empty()) {
+						slices.push_back({ job->header.data(), job->header.size() });
+					}
+					slices.insert(slices.end(), job->glb.slices.begin(), job->glb.slices.end());
+					std::string error;
+					if (writeFile(filename.c_str(), slices, &error)) {
+						_bytesWritten += totalSize(slices);
+						finish(job->tile);
+					} else {
+						finish(job->tile, error);
+					}
+					job.reset(); // release the tile buffer before waiting for the next one
+				}
+			}
+
+			// Error at which the viewer should load the finer file of `plod`, in the units of the tile.
+			double geometricErrorOf(const PagedLOD& plod, size_t child, double diameter) const {
+				const auto& range = plod.rangeList[child];
+				if (plod.rangeMode == LOD::RangeMode::PixelSizeOnScreen) {
+					// the finer file shows once the bounding sphere covers range.min pixels
+					return (range.min > 0) ? _options.maxScreenSpaceError * diameter / range.min : 0;
+				}
+				// the finer file shows closer than range.max
+				const auto pi = 3.14159265358979323846;
+				const auto pixelSize = 2 * std::tan(_options.fieldOfView * pi / 360) / _options.screenHeight;
+				return (range.max < 1e29f) ? range.max * _options.maxScreenSpaceError * pixelSize : 0;
+			}
+
+			bool convert(Job& job, std::string* error) {
+				auto& current = tile(job.tile);
+				std::string readError;
+				job.data = Data::read(job.buffer.data(), job.buffer.size(), &readError);
+				if (!job.data) {
+					*error = _dataDir + "/" + current.path + ".osgb: " + (readError.empty() ? "no root object" : readError);
+					return false;
+				}
+
+				forEachGeometry(job.data->rootObject.get(), [&](Geometry& geometry, bool) {
+					current.content.expand(boundsOf(geometry));
+				});
+				const auto contentDiameter = current.content.valid() ? diameterOf(current.content) : 0;
+
+				// collect the finer files and the error at which each PagedLOD switches to them
+				const auto directory = std::filesystem::path(current.path).parent_path();
+				std::vector<std::string> children;
+				std::unordered_set<Object*> visited;
+				const std::function<void(Object*)> visit = [&](Object* obj) {
+					const auto group = objectCast<Group>(obj);
+					if ((group == nullptr) || !visited.insert(obj).second) {
+						return;
+					}
+					if (const auto plod = objectCast<PagedLOD>(obj)) {
+						const auto diameter = (plod->userDefinedRadius > 0) ? 2 * plod->userDefinedRadius : contentDiameter;
+						for (size_t i = 0; i < plod->rangeDataList.size(); ++i) {
+							const auto& filename = plod->rangeDataList[i].filename;
+							if (filename.empty()) {
+								continue;
+							}
+							children.push_back((directory / filename).lexically_normal().replace_extension().generic_string());
+							if (i < plod->rangeList.size()) {
+								current.geometricError = std::max(current.geometricError, geometricErrorOf(*plod, i, diameter));
+							}
+						}
+					}
+					for (const auto& child : group->children) {
+						visit(child.get());
+					}
+				};
+				visit(job.data->rootObject.get());
+				if (!children.empty() && (current.geometricError <= 0)) {
+					current.geometricError = contentDiameter; // ranges we can't interpret: refine as soon as visible
+				}
+				if (!children.empty()) {
+					std::lock_guard<std::mutex> lock(_mutex);
+					for (const auto& child : children) {
+						const auto index = addTile(child);
+						if (std::find(current.children.begin(), current.children.end(), index) == current.children.end()) {
+							current.children.push_back(index);
+						}
+					}
+				}
+
+				current.hasContent = current.content.valid();
+				if (!current.hasContent) {
+					return true;
+				}
+				if (!buildGlb(*job.data, job.glb, _gltf, error)) {
+					*error = _dataDir + "/" + current.path + ".osgb: " + *error;
+					return false;
+				}
+				if (_options.format == TilesetOptions::Format::B3dm) {
+					// https://github.com/CesiumGS/3d-tiles/tree/main/specification/TileFormats/Batched3DModel
+					std::string featureTable = "{\"BATCH_LENGTH\":0}";
+					featureTable.resize(((28 + featureTable.size() + 7) & ~size_t(7)) - 28, ' ');
+					const auto put32 = [&job](size_t value) {
+						for (int b = 0; b < 4; ++b) {
+							job.header.push_back((unsigned char)(value >> (8 * b)));
+						}
+					};
+					job.header.reserve(28 + featureTable.size());
+					job.header.insert(job.header.end(), { 'b', '3', 'd', 'm' });
+					put32(1);
+					put32(28 + featureTable.size() + job.glb.size());
+					put32(featureTable.size());
+					put32(0);
+					put32(0);
+					put32(0);
+					job.header.insert(job.header.end(), featureTable.begin(), featureTable.end());
+				}
+				return true;
+			}
+
+			const Box3d& treeBounds(size_t index) {
+				auto& t = *_tiles[index];
+				if (t.state == 0) {
+					t.state = 1;
+					t.bounds = t.content;
+					for (const auto child : t.children) {
+						if (_tiles[child]->state != 1) { // a cycle in the file references
+							t.bounds.expand(treeBounds(child));
+						}
+					}
+					t.state = 2;
+				}
+				return t.bounds;
+			}
+
+			static double diameterOf(const Box3d& box) {
+				const auto dx = box.max.x - box.min.x, dy = box.max.y - box.min.y, dz = box.max.z - box.min.z;
+				return std::sqrt(dx * dx + dy * dy + dz * dz);
+			}
+
+			static void appendBox(std::string& out, const Box3d& box) {
+				// https://github.com/CesiumGS/3d-tiles/tree/main/specification#box
+				const double values[12] = {
+					(box.min.x + box.max.x) / 2, (box.min.y + box.max.y) / 2, (box.min.z + box.max.z) / 2,
+					(box.max.x - box.min.x) / 2, 0, 0,
+					0, (box.max.y - box.min.y) / 2, 0,
+					0, 0, (box.max.z - box.min.z) / 2
+				};
+				out += "{\"box\":[";
+				for (int i = 0; i < 12; ++i) {
+					if (i > 0) {
+						out += ',';
+					}
+					appendNumber(out, values[i]);
+				}
+				out += "]}";
+			}
+
+			void appendTile(std::string& out, size_t index, const std::filesystem::path& base, std::vector<size_t>& stack) {
+				const auto& t = *_tiles[index];
+				stack.push_back(index);
+				out += "{\"boundingVolume\":";
+				appendBox(out, t.bounds);
+				out += ",\"geometricError\":";
+				appendNumber(out, t.geometricError);
+				if (stack.size() == 1) {
+					out += ",\"refine\":\"REPLACE\"";
+				}
+				if (t.hasContent) {
+					out += ",\"content\":{\"uri\":\"";
+					out += std::filesystem::path(t.path + contentExtension()).lexically_relative(base).generic_string();
+					out += "\"}";
+				}
+				bool first = true;
+				for (const auto child : t.children) {
+					const auto& c = *_tiles[child];
+					if (!c.ok || !c.bounds.valid() || (std::find(stack.begin(), stack.end(), child) != stack.end())) {
+						continue;
+					}
+					out += first ? ",\"children\":[" : ",";
+					first = false;
+					appendTile(out, child, base, stack);
+				}
+				if (!first) {
+					out += ']';
+				}
+				out += '}';
+				stack.pop_back();
+			}
+
+			bool writeJson(const std::string& path, double geometricError, const std::string& root) {
+				std::string json = "{\"asset\":{\"version\":\"";
+				json += (_options.format == TilesetOptions::Format::B3dm) ? "1.0" : "1.1";
+				json += "\",\"generator\":\"miniosgb\"},\"geometricError\":";
+				appendNumber(json, geometricError);
+				json += ",\"root\":" + root + "}";
+				const auto filename = _outputDir + "/" + path;
+				std::error_code ec;
+				std::filesystem::create_directories(std::filesystem::path(filename).parent_path(), ec);
+				std::string error;
+				if (!writeFile(filename.c_str(), { { json.data(), json.size() } }, &error)) {
+					_errors.push_back(error);
+					return false;
+				}
+				_bytesWritten += json.size();
+				return true;
+			}
+
+			// One external tileset per root tile, referenced from the top-level tileset.json.
+			bool writeTilesets() {
+				bool ok = true;
+				Box3d all;
+				double maxError = 0;
+				std::string children;
+				for (const auto root : _roots) {
+					const auto& t = *_tiles[root];
+					if (!t.ok || !treeBounds(root).valid()) {
+						continue;
+					}
+					std::string tile;
+					std::vector<size_t> stack;
+					const auto path = t.path + ".json";
+					appendTile(tile, root, std::filesystem::path(path).parent_path(), stack);
+					// a reference tile without error would never open its external tileset
+					const auto error = (t.geometricError > 0) ? t.geometricError : diameterOf(t.bounds);
+					ok = writeJson(path, error, tile) && ok;
+
+					all.expand(t.bounds);
+					maxError = std::max(maxError, error);
+					if (!children.empty()) {
+						children += ',';
+					}
+					children += "{\"boundingVolume\":";
+					appendBox(children, t.bounds);
+					children += ",\"geometricError\":";
+					appendNumber(children, error);
+					children += ",\"content\":{\"uri\":\"" + path + "\"}}";
+				}
+				if (!all.valid()) {
+					return ok;
+				}
+
+				std::string root = "{\"boundingVolume\":";
+				appendBox(root, all);
+				const auto error = std::max(maxError, diameterOf(all));
+				root += ",\"geometricError\":";
+				appendNumber(root, error);
+				root += ",\"refine\":\"REPLACE\"";
+				const std::array<double, 16> identity = { 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1 };
+				if (_options.transform != identity) {
+					root += ",\"transform\":[";
+					for (int i = 0; i < 16; ++i) {
+						if (i > 0) {
+							root += ',';
+						}
+						appendNumber(root, _options.transform[i]);
+					}
+					root += ']';
+				}
+				root += ",\"children\":[" + children + "]}";
+				return writeJson("tileset.json", error, root) && ok;
+			}
+		};
+	}
+
+	// Converts every PagedLOD hierarchy under `dataDir` (Tile_X/Tile_X.osgb and top-level .osgb files) into a
+	// 3D Tiles tileset in `outputDir`: one b3dm/glb per osgb file at the same relative path, one external tileset
+	// per root tile and a top-level tileset.json. Reading, parsing/encoding and writing run as a pipeline of
+	// thread pools connected by bounded queues, so memory stays bounded by the queue capacities no matter how
+	// large the dataset is. Files that fail are reported and left out of the tileset; the rest is still written.
+	inline bool convertTo3dTiles(const std::string& dataDir, const std::string& outputDir, const TilesetOptions& options = {},
+		TilesetStats* stats = nullptr, std::string* error = nullptr) {
+		TilesetStats local;
+		details::TilesetConverter converter(dataDir, outputDir, options);
+		return converter.run(stats ? *stats : local, error);
+	}
+};
@@ -0,0 +1,145 @@
+#pragma once
+#include "miniosgb_image.h"
+#include "miniosgb_io.h"
+#include "miniosgb_parallel.h"
+#include <future>
+#include <limits>
+
+namespace miniosgb
+{
+	// Cancellation flag shared by its copies: keep one, pass one with the request, cancel() when the result is stale.
+	class CancellationToken {
+	public:
+		CancellationToken() : _cancelled(std::make_shared<std::atomic<bool>>(false)) {}
+		void cancel() const { _cancelled->store(true, std::memory_order_relaxed); }
+		bool cancelled() const { return _cancelled->load(std::memory_order_relaxed); }
+
+	private:
+		std::shared_ptr<std::atomic<bool>> _cancelled;
+	};
+
+	// Result of AsyncTileLoader::load().
+	struct AsyncTile {
+		std::vector<unsigned char> buffer; // the file; `data` points into it
+		std::unique_ptr<Data> data;
+		std::unordered_map<const Image*, DecodedImage> images; // when the loader has a decoder; empty entries failed
+		std::string error;
+		bool cancelled = false; // cancelled before it completed: no data, no error
+	};
+
+	// Loads tiles on a fixed pool of workers: read, Data::read() and, with a decoder, image decode, one request after
+	// the other from a shared queue, so hundreds of requests cost no thread each. The token is checked between the
+	// stages: a cancelled request still queued completes at once without any I/O.
+	class AsyncTileLoader {
+	public:
+		explicit AsyncTileLoader(unsigned int threads = 0, const ReadOptions& options = ReadOptions(), ImageDecoder decoder = nullptr)
+			: _options(options), _decoder(std::move(decoder)), _requests(std::numeric_limits<size_t>::max()) {
+			threads = defaultThreadCount(threads);
+			for (unsigned int t = 0; t < threads; ++t) {
+				_workers.emplace_back([this] { work(); });
+			}
+		}
+
+		AsyncTileLoader(const AsyncTileLoader&) = delete;
+		AsyncTileLoader& operator=(const AsyncTileLoader&) = delete;
+
+		// Requests not started yet complete as cancelled; the ones being loaded are finished first.
+		~AsyncTileLoader() {
+			_stopping = true;
+			_requests.close();
+			for (auto& worker : _workers) {
+				worker.join();
+			}
+		}
+
+		std::future<AsyncTile> load(std::string filename, CancellationToken token = CancellationToken()) {
+			Request request{ std::move(filename), std::move(token), std::promise<AsyncTile>() };
+			auto future = request.promise.get_future();
+			++_pending;
+			if (!_requests.push(std::move(request))) {
+				--_pending;
+				AsyncTile tile;
+				tile.cancelled = true;
+				std::promise<AsyncTile> closed;
+				closed.set_value(std::move(tile));
+				return closed.get_future();
+			}
+			return future;
+		}
+
+		// Requests queued or being loaded.
+		size_t pending() const { return _pending; }
+
+	private:
+		struct Request {
+			std::string filename;
+			CancellationToken token;
+			std::promise<AsyncTile> promise;
+		};
+
+		const ReadOptions _options;
+		const ImageDecoder _decoder;
+		BoundedQueue<Request> _requests;
+		std::vector<std::thread> _workers;
+		std::atomic<bool> _stopping{ false };
+		std::atomic<size_t> _pending{ 0 };
+
+		void work() {
+			for (Request request; _requests.pop(request);) {
+				AsyncTile tile;
+				std::exception_ptr exception;
+				try {
+					tile = load(request);
+				} catch (...) {
+					exception = std::current_exception();
+				}
+				--_pending; // before the waiter wakes up
+				if (exception) {
+					request.promise.set_exception(exception);
+				} else {
+					request.promise.set_value(std::move(tile));
+				}
+			}
+		}
+
+		AsyncTile load(const Request& request) {
+			MINIOSGB_TRACE_SCOPE("async", "load");
+			AsyncTile tile;
+			const auto cancelled = [&]() {
+				if (request.token.cancelled()) {
+					tile.data.reset();
+					tile.images.clear();
+					tile.cancelled = true;
+				}
+				return tile.cancelled;
+			};
+			if (_stopping) { // still queued at destruction; once started, a request is only stopped by its token
+				tile.cancelled = true;
+				return tile;
+			}
+			if (cancelled() || !readFile(request.filename.c_str(), tile.buffer, &tile.error) || cancelled()) {
+				return tile;
+			}
+			std::string readError;
+			tile.data = Data::read(tile.buffer.data(), tile.buffer.size(), _options, &readError);
+			if (!tile.data) {
+				tile.error = request.filename + ": " + (readError.empty() ? "no root object" : readError);
+				return tile;
+			}
+			if (_decoder) {
+				tile.data->objects.forEach([&](Object* obj) {
+					const auto image = objectCast<Image>(obj);
+					if (image && !cancelled() && (tile.images.find(image) == tile.images.end())) {
+						auto& decoded = tile.images[image];
+						MINIOSGB_TRACE_SCOPE("image", "decode");
+						if (!_decoder(*image, decoded)) {
+							decoded = DecodedImage();
+						}
+					}
+				});
+			}
+			cancelled();
+			return tile;
+		}
+	};
+};
@@ -0,0 +1,237 @@
+#pragma once
+#include "miniosgb_io.h"
+#include <atomic>
+#include <future>
+#include <list>
+#include <shared_mutex>
+
+namespace miniosgb
+{
+	struct TileCacheOptions {
+		size_t capacity = size_t(1) << 30; // bytes of all cached tiles, by MemoryUsage; each shard keeps its share
+		unsigned int shards = 64; // rounded up to a power of two
+		ReadOptions read;
+		bool detach = false; // keep only DetachOptions' payloads of a tile instead of its whole file
+		DetachOptions detachOptions;
+	};
+
+	// A loaded tile as shared by the cache; immutable once published.
+	struct CachedTile {
+		std::vector<unsigned char> buffer; // the file, unless detached, and `data` points into it; or a converted form
+		std::unique_ptr<Data> data;
+		std::string error; // failed loads are handed to the callers waiting for them, but not kept
+		size_t cost = 0; // bytes charged to the cache, the buffer plus Data::memoryUsage() if 0 after loading
+	};
+
+	struct TileCacheStatistics {
+		size_t hits = 0;
+		size_t misses = 0; // loads started
+		size_t coalesced = 0; // misses that waited for a load already in flight instead of starting one
+		size_t evictions = 0;
+		size_t entries = 0;
+		size_t bytes = 0;
+	};
+
+	// Tile cache keyed by path, split into shards with a lock each, so threads asking for different tiles rarely meet.
+	// A hit takes its shard's lock shared and only sets the tile's reference bit, so the readers of one hot tile don't
+	// serialize; misses, eviction and erase take it exclusively. Eviction is CLOCK (second chance): the hand clears the
+	// bit of referenced tiles as it passes them and evicts the first one not used since its last pass.
+	// Concurrent misses on one key are single-flight: the first caller loads, outside the lock, and the others wait
+	// for its result. Tiles are shared: an evicted tile lives on while a caller still holds it.
+	class TileCache {
+	public:
+		explicit TileCache(const TileCacheOptions& options = TileCacheOptions()) : _options(options) {
+			unsigned int shards = 1;
+			while (shards < options.shards) {
+				shards <<= 1;
+			}
+			_shards = std::vector<Shard>(shards);
+			_shardCapacity = std::max<size_t>(options.capacity / shards, 1);
+		}
+
+		TileCache(const TileCache&) = delete;
+		TileCache& operator=(const TileCache&) = delete;
+
+		// The tile of `filename`, read and parsed on a miss.
+		std::shared_ptr<const CachedTile> get(const std::string& filename) {
+			return get(filename, [&](CachedTile& tile) { load(filename, tile); });
+		}
+
+		// The tile of `key`, filled by load(CachedTile&) on a miss, e.g. with a converted form. An exception thrown by
+		// load is rethrown to every caller waiting for it, and nothing is cached.
+		template<typename Load> std::shared_ptr<const CachedTile> get(const std::string& key, Load&& load) {
+			auto& shard = shardOf(key);
+			std::shared_future<std::shared_ptr<const CachedTile>> pending;
+			{
+				std::shared_lock<std::shared_mutex> lock(shard.mutex);
+				const auto it = shard.entries.find(key);
+				if (it != shard.entries.end()) {
+					if (it->second.tile) {
+						return hit(shard, it->second);
+					}
+					pending = it->second.pending;
+				}
+			}
+			std::promise<std::shared_ptr<const CachedTile>> promise;
+			if (!pending.valid()) {
+				std::lock_guard<std::shared_mutex> lock(shard.mutex);
+				const auto it = shard.entries.find(key);
+				if (it == shard.entries.end()) {
+					++shard.statistics.misses;
+					shard.entries[key].pending = promise.get_future().share();
+				} else if (it->second.tile) { // loaded since the shared lock was released
+					return hit(shard, it->second);
+				} else {
+					pending = it->second.pending;
+				}
+			}
+			if (pending.valid()) {
+				shard.coalesced.fetch_add(1, std::memory_order_relaxed);
+				return pending.get();
+			}
+
+			std::shared_ptr<CachedTile> tile;
+			try {
+				tile = std::make_shared<CachedTile>();
+				load(*tile);
+				if (tile->cost == 0) {
+					tile->cost = tile->buffer.capacity() + sizeof(CachedTile) + (tile->data ? tile->data->memoryUsage().owned() : 0);
+				}
+			} catch (...) {
+				{
+					std::lock_guard<std::shared_mutex> lock(shard.mutex);
+					shard.entries.erase(key);
+				}
+				promise.set_exception(std::current_exception());
+				throw;
+			}
+			{
+				std::lock_guard<std::shared_mutex> lock(shard.mutex);
+				const auto it = shard.entries.find(key);
+				if (!tile->error.empty()) {
+					shard.entries.erase(it);
+				} else {
+					auto& entry = it->second;
+					entry.tile = tile;
+					entry.pending = {};
+					// just behind the hand, so it is the last the hand reaches
+					entry.clock = shard.clock.insert(shard.hand, key);
+					if (shard.hand == shard.clock.end()) {
+						shard.hand = shard.clock.begin();
+					}
+					shard.statistics.bytes += tile->cost;
+					evict(shard, entry.clock);
+				}
+			}
+			promise.set_value(tile);
+			return tile;
+		}
+
+		void erase(const std::string& key) {
+			auto& shard = shardOf(key);
+			std::lock_guard<std::shared_mutex> lock(shard.mutex);
+			const auto it = shard.entries.find(key);
+			if ((it != shard.entries.end()) && it->second.tile) {
+				remove(shard, it);
+			}
+		}
+
+		// Drops the loaded tiles; loads in flight complete and are cached as usual.
+		void clear() {
+			for (auto& shard : _shards) {
+				std::lock_guard<std::shared_mutex> lock(shard.mutex);
+				while (!shard.clock.empty()) {
+					remove(shard, shard.entries.find(shard.clock.front()));
+				}
+			}
+		}
+
+		TileCacheStatistics statistics() const {
+			TileCacheStatistics total;
+			for (auto& shard : _shards) {
+				std::shared_lock<std::shared_mutex> lock(shard.mutex);
+				total.hits += shard.hits.load(std::memory_order_relaxed);
+				total.misses += shard.statistics.misses;
+				total.coalesced += shard.coalesced.load(std::memory_order_relaxed);
+				total.evictions += shard.statistics.evictions;
+				total.bytes += shard.statistics.bytes;
+				total.entries += shard.clock.size();
+			}
+			return total;
+		}
+
+	private:
+		struct Entry {
+			std::shared_ptr<const CachedTile> tile; // null while loading
+			std::shared_future<std::shared_ptr<const CachedTile>> pending;
+			std::list<std::string>::iterator clock;
+			std::atomic<bool> referenced{ false }; // set by hits under the shared lock
+		};
+
+		struct alignas(64) Shard {
+			mutable std::shared_mutex mutex;
+			std::unordered_map<std::string, Entry> entries;
+			std::list<std::string> clock; // loaded keys, in the order the hand visits them
+			std::list<std::string>::iterator hand = clock.end();
+			TileCacheStatistics statistics; // misses, evictions and bytes, under the exclusive lock
+			std::atomic<size_t> hits{ 0 };
+			std::atomic<size_t> coalesced{ 0 };
+		};
+
+		const TileCacheOptions _options;
+		std::vector<Shard> _shards;
+		size_t _shardCapacity = 0;
+
+		Shard& shardOf(const std::string& key) {
+			return _shards[std::hash<std::string>()(key) & (_shards.size() - 1)];
+		}
+
+		static std::shared_ptr<const CachedTile> hit(Shard& shard, Entry& entry) {
+			shard.hits.fetch_add(1, std::memory_order_relaxed);
+			if (!entry.referenced.load(std::memory_order_relaxed)) { // no write, so no cache line ping-pong, once set
+				entry.referenced.store(true, std::memory_order_relaxed);
+			}
+			return entry.tile;
+		}
+
+		void load(const std::string& filename, CachedTile& tile) {
+			if (!readFile(filename.c_str(), tile.buffer, &tile.error)) {
+				return;
+			}
+			std::string readError;
+			tile.data = Data::read(tile.buffer.data(), tile.buffer.size(), _options.read, &readError);
+			if (!tile.data || !tile.data->rootObject) {
+				tile.data.reset();
+				tile.error = filename + ": " + (readError.empty() ? "no root object" : readError);
+			} else if (_options.detach) {
+				tile.data->detach(_options.detachOptions);
+				std::vector<unsigned char>().swap(tile.buffer);
+			}
+		}
+
+		// The hand gives referenced tiles a second chance, but the tile just added stays even if it alone is over the share.
+		void evict(Shard& shard, std::list<std::string>::iterator added) {
+			while ((shard.statistics.bytes > _shardCapacity) && (shard.clock.size() > 1)) {
+				if (shard.hand == shard.clock.end()) {
+					shard.hand = shard.clock.begin();
+				}
+				const auto it = shard.entries.find(*shard.hand);
+				if ((shard.hand == added) || it->second.referenced.exchange(false, std::memory_order_relaxed)) {
+					++shard.hand;
+					continue;
+				}
+				remove(shard, it);
+				++shard.statistics.evictions;
+			}
+		}
+
+		static void remove(Shard& shard, std::unordered_map<std::string, Entry>::iterator it) {
+			shard.statistics.bytes -= it->second.tile->cost;
+			if (shard.hand == it->second.clock) {
+				++shard.hand;
+			}
+			shard.clock.erase(it->second.clock);
+			shard.entries.erase(it);
+		}
+	};
+};
@@ -0,0 +1,580 @@
+#pragma once
+#include "miniosgb_io.h"
+#include "miniosgb_mesh.h"
+#include "miniosgb_image.h"
+#include <cstdint>
+#include <map>
+#include <string_view>
+
+namespace miniosgb
+{
+	// MiniOSGB compiled tile: the parsed scene of one OSGB file as flat little-endian tables and blobs that are
+	// used in place, e.g. straight from a MappedFile. All references are byte offsets from the start of the
+	// file or indices into the tables, so the file is position independent and loading it needs no parsing,
+	// allocation or pointer fixups. Tables and blobs start 16-byte aligned.
+	//
+	// Layout: CompiledHeader | tables (nodes, children, ranges, geometries, primitives, materials, textures,
+	// images) | blobs (positions, normals, texture coordinates, indices, image files, range filenames).
+	// Bump compiledVersion on any change of the records below.
+	static const uint32_t compiledVersion = 1;
+
+	struct CompiledHeader {
+		char magic[8]; // "MOSGBTIL"
+		uint32_t version;
+		uint32_t headerSize;
+		uint64_t fileSize;
+		uint64_t checksum; // of bytes [headerSize, fileSize)
+		uint32_t nodeCount;
+		uint32_t childCount;
+		uint32_t rangeCount;
+		uint32_t geometryCount;
+		uint32_t primitiveCount;
+		uint32_t materialCount;
+		uint32_t textureCount;
+		uint32_t imageCount;
+		uint64_t nodes;
+		uint64_t children;
+		uint64_t ranges;
+		uint64_t geometries;
+		uint64_t primitives;
+		uint64_t materials;
+		uint64_t textures;
+		uint64_t images;
+	};
+
+	// Group, Geode, LOD or PagedLOD. Node 0 is the root; children are node indices in the children table.
+	struct CompiledNode {
+		enum Kind : uint32_t { Group = 0, Geode = 1, LOD = 2, PagedLOD = 3 };
+		uint32_t kind;
+		uint32_t rangeMode; // LOD::RangeMode
+		uint32_t firstChild;
+		uint32_t childCount;
+		uint32_t firstGeometry;
+		uint32_t geometryCount;
+		uint32_t firstRange; // one per LOD child (LOD) or range data entry (PagedLOD)
+		uint32_t rangeCount;
+		float center[3];
+		float radius;
+	};
+
+	struct CompiledRange {
+		float min;
+		float max;
+		uint64_t filename; // PagedLOD file, not null-terminated; 0 when none
+		uint32_t filenameLength;
+		uint32_t reserved;
+	};
+
+	static const uint32_t compiledNone = 0xFFFFFFFF;
+
+	struct CompiledGeometry {
+		uint32_t vertexCount;
+		uint32_t material; // index or compiledNone
+		uint32_t texture; // index or compiledNone
+		uint32_t firstPrimitive;
+		uint32_t primitiveCount;
+		uint32_t reserved;
+		uint64_t positions; // vertexCount Vec3f
+		uint64_t normals; // vertexCount Vec3f, 0 when none
+		uint64_t texCoords; // vertexCount Vec2f, 0 when none
+		float min[3];
+		float max[3];
+	};
+
+	struct CompiledPrimitive {
+		uint32_t mode; // PrimitiveMode
+		uint32_t indexCount;
+		uint64_t indices; // indexCount uint32_t
+	};
+
+	struct CompiledMaterial {
+		float ambient[4];
+		float diffuse[4];
+		float specular[4];
+		float emission[4];
+		float shininess;
+		uint32_t reserved[3];
+	};
+
+	struct CompiledTexture {
+		uint32_t image;
+		uint32_t wrapS; // Texture::WrapMode
+		uint32_t wrapT;
+		uint32_t reserved;
+	};
+
+	struct CompiledImage {
+		uint64_t data; // the inline image file as stored in the OSGB
+		uint64_t size;
+		uint32_t format; // ImageFormat
+		uint32_t width;
+		uint32_t height;
+		uint32_t reserved;
+	};
+
+	static_assert(sizeof(CompiledHeader) == 128, "compiled layout");
+	static_assert(sizeof(CompiledNode) == 48, "compiled layout");
+	static_assert(sizeof(CompiledRange) == 24, "compiled layout");
+	static_assert(sizeof(CompiledGeometry) == 72, "compiled layout");
+	static_assert(sizeof(CompiledPrimitive) == 16, "compiled layout");
+	static_assert(sizeof(CompiledMaterial) == 80, "compiled layout");
+	static_assert(sizeof(CompiledTexture) == 16, "compiled layout");
+	static_assert(sizeof(CompiledImage) == 32, "compiled layout");
+
+	namespace details {
+		// 64-bit checksum over 32-byte stripes in four independent lanes, so it runs at memory bandwidth.
+		inline uint64_t checksum64(const unsigned char* data, size_t size) {
+			const uint64_t p1 = 0x9E3779B185EBCA87ull;
+			const uint64_t p2 = 0xC2B2AE3D27D4EB4Full;
+			const auto rotl = [](uint64_t x, int r) { return (x << r) | (x >> (64 - r)); };
+			const auto load = [data](size_t p) { uint64_t v; memcpy(&v, data + p, 8); return v; };
+			uint64_t lanes[4] = { p1 + p2, p2, 0, 0 - p1 };
+			size_t p = 0;
+			for (; p + 32 <= size; p += 32) {
+				for (int k = 0; k < 4; ++k) {
+					lanes[k] = rotl(lanes[k] + load(p + k * 8) * p2, 31) * p1;
+				}
+			}
+			auto hash = rotl(lanes[0], 1) + rotl(lanes[1], 7) + rotl(lanes[2], 12) + rotl(lanes[3], 18) + size;
+			for (; p + 8 <= size; p += 8) {
+				hash = rotl(hash ^ (rotl(load(p) * p2, 31) * p1), 27) * p1 + p2;
+			}
+			for (; p < size; ++p) {
+				hash = rotl(hash ^ (data[p] * p1), 11) * p2;
+			}
+			hash ^= hash >> 33;
+			hash *= p2;
+			hash ^= hash >> 29;
+			hash *= p1;
+			return hash ^ (hash >> 32);
+		}
+
+		class TileCompiler {
+		public:
+			bool compile(const Data& data, std::vector<unsigned char>& out, std::string* error) {
+				if (addNode(data.rootObject.get()) != 0) {
+					if (error) {
+						*error = "root object is not a node";
+					}
+					return false;
+				}
+
+				CompiledHeader header = {};
+				memcpy(header.magic, "MOSGBTIL", 8);
+				header.version = compiledVersion;
+				header.headerSize = sizeof(CompiledHeader);
+				header.nodeCount = (uint32_t)_nodes.size();
+				header.childCount = (uint32_t)_children.size();
+				header.rangeCount = (uint32_t)_ranges.size();
+				header.geometryCount = (uint32_t)_geometries.size();
+				header.primitiveCount = (uint32_t)_primitives.size();
+				header.materialCount = (uint32_t)_materials.size();
+				header.textureCount = (uint32_t)_textures.size();
+				header.imageCount = (uint32_t)_images.size();
+
+				// tables follow the header, blobs follow the tables: shift blob offsets by the tables' size
+				size_t offset = sizeof(CompiledHeader);
+				const auto place = [&offset](const auto& table) {
+					const auto at = offset;
+					offset = align(offset + table.size() * sizeof(table[0]));
+					return (uint64_t)at;
+				};
+				header.nodes = place(_nodes);
+				header.children = place(_children);
+				header.ranges = place(_ranges);
+				header.geometries = place(_geometries);
+				header.primitives = place(_primitives);
+				header.materials = place(_materials);
+				header.textures = place(_textures);
+				header.images = place(_images);
+				const auto blobs = (uint64_t)offset;
+				const auto relocate = [blobs](uint64_t& blob) {
+					if (blob != 0) {
+						blob += blobs - 1; // 0 is reserved for "none", so blob offsets were stored plus one
+					}
+				};
+				for (auto& range : _ranges) {
+					relocate(range.filename);
+				}
+				for (auto& geometry : _geometries) {
+					relocate(geometry.positions);
+					relocate(geometry.normals);
+					relocate(geometry.texCoords);
+				}
+				for (auto& primitive : _primitives) {
+					relocate(primitive.indices);
+				}
+				for (auto& image : _images) {
+					relocate(image.data);
+				}
+				header.fileSize = blobs + _blobs.size();
+
+				out.assign(header.fileSize, 0);
+				const auto copy = [&out](uint64_t at, const auto& table) {
+					if (!table.empty()) {
+						memcpy(out.data() + at, table.data(), table.size() * sizeof(table[0]));
+					}
+				};
+				copy(header.nodes, _nodes);
+				copy(header.children, _children);
+				copy(header.ranges, _ranges);
+				copy(header.geometries, _geometries);
+				copy(header.primitives, _primitives);
+				copy(header.materials, _materials);
+				copy(header.textures, _textures);
+				copy(header.images, _images);
+				copy(blobs, _blobs);
+				header.checksum = checksum64(out.data() + sizeof(CompiledHeader), out.size() - sizeof(CompiledHeader));
+				memcpy(out.data(), &header, sizeof(header));
+				return true;
+			}
+
+		private:
+			std::vector<CompiledNode> _nodes;
+			std::vector<uint32_t> _children;
+			std::vector<CompiledRange> _ranges;
+			std::vector<CompiledGeometry> _geometries;
+			std::vector<CompiledPrimitive> _primitives;
+			std::vector<CompiledMaterial> _materials;
+			std::vector<CompiledTexture> _textures;
+			std::vector<CompiledImage> _images;
+			std::vector<unsigned char> _blobs;
+			std::unordered_map<const Object*, uint32_t> _nodeIndices;
+			std::map<std::pair<const void*, size_t>, uint64_t> _blobOffsets;
+			std::unordered_map<const Material*, uint32_t> _materialIndices;
+			std::unordered_map<const Texture2D*, uint32_t> _textureIndices;
+			std::unordered_map<const Image*, uint32_t> _imageIndices;
+
+			static size_t align(size_t offset) {
+				return (offset + 15) & ~size_t(15);
+			}
+
+			// Offset of the blob within the blob area, plus one; each source array is stored once.
+			uint64_t addBlob(const void* data, size_t size) {
+				if ((data == nullptr) || (size == 0)) {
+					return 0;
+				}
+				const auto key = std::make_pair(data, size);
+				const auto it = _blobOffsets.find(key);
+				if (it != _blobOffsets.end()) {
+					return it->second;
+				}
+				const auto at = _blobs.size();
+				_blobs.resize(align(at + size));
+				memcpy(_blobs.data() + at, data, size);
+				_blobOffsets.emplace(key, at + 1);
+				return at + 1;
+			}
+
+			uint32_t addMaterial(const Material* material) {
+				const auto it = _materialIndices.find(material);
+				if (it != _materialIndices.end()) {
+					return it->second;
+				}
+				CompiledMaterial compiled = {};
+				memcpy(compiled.ambient, &material->ambient.front, sizeof(Vec4f));
+				memcpy(compiled.diffuse, &material->diffuse.front, sizeof(Vec4f));
+				memcpy(compiled.specular, &material->specular.front, sizeof(Vec4f));
+				memcpy(compiled.emission, &material->emission.front, sizeof(Vec4f));
+				compiled.shininess = material->shininess.front;
+				_materials.push_back(compiled);
+				return _materialIndices[material] = (uint32_t)(_materials.size() - 1);
+			}
+
+			uint32_t addTexture(const Texture2D* texture) {
+				const auto it = _textureIndices.find(texture);
+				if (it != _textureIndices.end()) {
+					return it->second;
+				}
+				const auto& image = *texture->image;
+				auto imageIndex = compiledNone;
+				const auto found = _imageIndices.find(&image);
+				if (found != _imageIndices.end()) {
+					imageIndex = found->second;
+				} else {
+					ImageInfo info;
+					probeImage(image, info);
+					CompiledImage compiled = {};
+					compiled.data = addBlob(image.data, image.dataLength);
+					compiled.size = image.dataLength;
+					compiled.format = (uint32_t)info.format;
+					compiled.width = info.width;
+					compiled.height = info.height;
+					_images.push_back(compiled);
+					imageIndex = _imageIndices[&image] = (uint32_t)(_images.size() - 1);
+				}
+				CompiledTexture compiled = {};
+				compiled.image = imageIndex;
+				compiled.wrapS = (uint32_t)texture->wrapS;
+				compiled.wrapT = (uint32_t)texture->wrapT;
+				_textures.push_back(compiled);
+				return _textureIndices[texture] = (uint32_t)(_textures.size() - 1);
+			}
+
+			void addGeometry(const Geometry& geometry) {
+				const auto vertices = positionsOf(geometry);
+				if (vertices == nullptr) {
+					return;
+				}
+				CompiledGeometry compiled = {};
+				compiled.vertexCount = vertices->elementCount;
+				compiled.positions = addBlob(vertices->elementData, size_t(vertices->elementCount) * sizeof(Vec3f));
+				const auto& normals = geometry.normalData;
+				if (normals && (normals->arrayType == Array::ArrayType::Vec3f) && (normals->binding == Array::Binding::PerVertex)
+					&& (normals->elementCount >= vertices->elementCount)) {
+					compiled.normals = addBlob(normals->elementData, size_t(vertices->elementCount) * sizeof(Vec3f));
+				}
+				if (const auto texCoords = texCoordsOf(geometry)) {
+					compiled.texCoords = addBlob(texCoords->elementData, size_t(vertices->elementCount) * sizeof(Vec2f));
+				}
+				const auto material = materialOf(geometry);
+				compiled.material = material ? addMaterial(material) : compiledNone;
+				const auto texture = textureOf(geometry);
+				compiled.texture = (texture && texture->image && texture->image->data) ? addTexture(texture) : compiledNone;
+				compiled.firstPrimitive = (uint32_t)_primitives.size();
+				for (const auto& prim : geometry.primitives) {
+					if (prim && prim->indexData && (prim->indexCount > 0)) {
+						CompiledPrimitive primitive = {};
+						primitive.mode = prim->mode;
+						primitive.indexCount = prim->indexCount;
+						primitive.indices = addBlob(prim->indexData, size_t(prim->indexCount) * sizeof(uint32_t));
+						_primitives.push_back(primitive);
+					}
+				}
+				compiled.primitiveCount = (uint32_t)_primitives.size() - compiled.firstPrimitive;
+				const auto box = boundsOf(geometry);
+				const float bounds[6] = { (float)box.min.x, (float)box.min.y, (float)box.min.z, (float)box.max.x, (float)box.max.y, (float)box.max.z };
+				memcpy(compiled.min, bounds, sizeof(compiled.min));
+				memcpy(compiled.max, bounds + 3, sizeof(compiled.max));
+				_geometries.push_back(compiled);
+			}
+
+			// Appends `obj` and, depth first, its subtree; returns its node index or compiledNone if it isn't a node.
+			uint32_t addNode(const Object* obj) {
+				const auto it = _nodeIndices.find(obj);
+				if (it != _nodeIndices.end()) {
+					return it->second;
+				}
+				const auto group = objectCast<Group>(obj);
+				const auto geode = objectCast<Geode>(obj);
+				if ((group == nullptr) && (geode == nullptr)) {
+					return compiledNone;
+				}
+				const auto index = (uint32_t)_nodes.size();
+				_nodeIndices.emplace(obj, index);
+				_nodes.emplace_back();
+
+				CompiledNode node = {};
+				node.kind = geode ? CompiledNode::Geode : CompiledNode::Group;
+				node.firstRange = (uint32_t)_ranges.size();
+				if (const auto lod = objectCast<LOD>(obj)) {
+					node.kind = CompiledNode::LOD;
+					node.rangeMode = (uint32_t)lod->rangeMode;
+					node.center[0] = (float)lod->userDefinedCenter.x;
+					node.center[1] = (float)lod->userDefinedCenter.y;
+					node.center[2] = (float)lod->userDefinedCenter.z;
+					node.radius = (float)lod->userDefinedRadius;
+					const auto plod = objectCast<PagedLOD>(obj);
+					if (plod) {
+						node.kind = CompiledNode::PagedLOD;
+					}
+					const auto count = std::max(lod->rangeList.size(), plod ? plod->rangeDataList.size() : 0);
+					for (size_t i = 0; i < count; ++i) {
+						CompiledRange range = {};
+						if (i < lod->rangeList.size()) {
+							range.min = lod->rangeList[i].min;
+							range.max = lod->rangeList[i].max;
+						}
+						if (plod && (i < plod->rangeDataList.size())) {
+							const auto& filename = plod->rangeDataList[i].filename;
+							range.filename = addBlob(filename.data(), filename.size());
+							range.filenameLength = (uint32_t)filename.size();
+						}
+						_ranges.push_back(range);
+					}
+				}
+				node.rangeCount = (uint32_t)_ranges.size() - node.firstRange;
+				node.firstGeometry = (uint32_t)_geometries.size();
+				if (geode) {
+					for (const auto& drawable : geode->drawables) {
+						if (const auto geometry = objectCast<Geometry>(drawable.get())) {
+							addGeometry(*geometry);
+						}
+					}
+				}
+				node.geometryCount = (uint32_t)_geometries.size() - node.firstGeometry;
+
+				// children are listed contiguously, so resolve them before appending the list
+				std::vector<uint32_t> children;
+				if (group) {
+					for (const auto& child : group->children) {
+						const auto childIndex = addNode(child.get());
+						if (childIndex != compiledNone) {
+							children.push_back(childIndex);
+						}
+					}
+				}
+				node.firstChild = (uint32_t)_children.size();
+				node.childCount = (uint32_t)children.size();
+				_children.insert(_children.end(), children.begin(), children.end());
+				_nodes[index] = node;
+				return index;
+			}
+		};
+	}
+
+	// Serializes a parsed tile into the compiled format. Arrays and image files are copied, so `out` is
+	// independent of the OSGB buffer.
+	inline bool compileTile(const Data& data, std::vector<unsigned char>& out, std::string* error = nullptr) {
+		details::TileCompiler compiler;
+		return compiler.compile(data, out, error);
+	}
+
+	inline bool compileFile(const char* osgbFilename, const char* compiledFilename, std::string* error = nullptr) {
+		std::vector<unsigned char> buffer;
+		const auto data = loadFile(osgbFilename, buffer, error);
+		std::vector<unsigned char> compiled;
+		return data && compileTile(*data, compiled, error)
+			&& writeFile(compiledFilename, { { compiled.data(), compiled.size() } }, error);
+	}
+
+	// View of a compiled tile in memory. open() checks the header and that every record references memory
+	// inside the file, which costs time proportional to the number of records, not to the data size; the
+	// checksum pass over the whole file is optional. Without it, open() trusts the contents: an index may be
+	// past its geometry's vertexCount and the child table may have cycles, so only skip it for files this
+	// process wrote or verified. The memory must stay valid while the view is used.
+	class CompiledTile {
+	public:
+		bool open(const void* data, size_t size, bool verifyChecksum = false, std::string* error = nullptr) {
+			_data = nullptr;
+			const auto fail = [error](const char* message) {
+				if (error) {
+					*error = message;
+				}
+				return false;
+			};
+			const auto bytes = (const unsigned char*)data;
+			if ((bytes == nullptr) || (size < sizeof(CompiledHeader)) || (memcmp(bytes, "MOSGBTIL", 8) != 0)) {
+				return fail("not a compiled tile");
+			}
+			if (((uintptr_t)bytes & 15) != 0) {
+				return fail("compiled tile not 16-byte aligned in memory");
+			}
+			const auto& h = *(const CompiledHeader*)bytes;
+			if ((h.version != compiledVersion) || (h.headerSize != sizeof(CompiledHeader))) {
+				return fail("unsupported compiled tile version");
+			}
+			if (h.fileSize != size) {
+				return fail("compiled tile truncated");
+			}
+			if (verifyChecksum && (details::checksum64(bytes + h.headerSize, size - h.headerSize) != h.checksum)) {
+				return fail("compiled tile checksum mismatch");
+			}
+
+			const auto inside = [size](uint64_t offset, uint64_t length) {
+				return (offset <= size) && (length <= size - offset);
+			};
+			const auto table = [&](uint64_t offset, uint64_t count, size_t recordSize) {
+				return ((offset & 15) == 0) && (offset >= sizeof(CompiledHeader)) && inside(offset, count * recordSize);
+			};
+			if ((h.nodeCount == 0) || !table(h.nodes, h.nodeCount, sizeof(CompiledNode)) || !table(h.children, h.childCount, sizeof(uint32_t))
+				|| !table(h.ranges, h.rangeCount, sizeof(CompiledRange)) || !table(h.geometries, h.geometryCount, sizeof(CompiledGeometry))
+				|| !table(h.primitives, h.primitiveCount, sizeof(CompiledPrimitive)) || !table(h.materials, h.materialCount, sizeof(CompiledMaterial))
+				|| !table(h.textures, h.textureCount, sizeof(CompiledTexture)) || !table(h.images, h.imageCount, sizeof(CompiledImage))) {
+				return fail("compiled tile tables out of bounds");
+			}
+			_data = bytes;
+			const auto blob = [&](uint64_t offset, uint64_t length) {
+				return (offset == 0) || (((offset & 3) == 0) && inside(offset, length));
+			};
+			bool ok = true;
+			for (const auto& n : nodes()) {
+				ok = ok && (n.firstChild <= h.childCount) && (n.childCount <= h.childCount - n.firstChild)
+					&& (n.firstGeometry <= h.geometryCount) && (n.geometryCount <= h.geometryCount - n.firstGeometry)
+					&& (n.firstRange <= h.rangeCount) && (n.rangeCount <= h.rangeCount - n.firstRange);
+			}
+			for (const auto child : span<uint32_t>(h.children, h.childCount)) {
+				ok = ok && (child < h.nodeCount);
+			}
+			for (const auto& r : ranges()) {
+				ok = ok && ((r.filename != 0) || (r.filenameLength == 0)) && inside(r.filename, r.filenameLength);
+			}
+			for (const auto& g : geometries()) {
+				ok = ok && (g.positions != 0) && blob(g.positions, uint64_t(g.vertexCount) * sizeof(Vec3f))
+					&& blob(g.normals, uint64_t(g.vertexCount) * sizeof(Vec3f)) && blob(g.texCoords, uint64_t(g.vertexCount) * sizeof(Vec2f))
+					&& ((g.material == compiledNone) || (g.material < h.materialCount)) && ((g.texture == compiledNone) || (g.texture < h.textureCount))
+					&& (g.firstPrimitive <= h.primitiveCount) && (g.primitiveCount <= h.primitiveCount - g.firstPrimitive);
+			}
+			for (const auto& p : primitives()) {
+				ok = ok && (p.indices != 0) && blob(p.indices, uint64_t(p.indexCount) * sizeof(uint32_t));
+			}
+			for (const auto& t : textures()) {
+				ok = ok && (t.image < h.imageCount);
+			}
+			for (const auto& i : images()) {
+				ok = ok && inside(i.data, i.size);
+			}
+			if (!ok) {
+				_data = nullptr;
+				return fail("compiled tile records out of bounds");
+			}
+			return true;
+		}
+
+		template<typename T> struct Span {
+			const T* first;
+			size_t count;
+			const T* begin() const { return first; }
+			const T* end() const { return first + count; }
+			size_t size() const { return count; }
+			const T& operator[](size_t i) const { return first[i]; }
+		};
+
+		const CompiledHeader& header() const { return *(const CompiledHeader*)_data; }
+		Span<CompiledNode> nodes() const { return span<CompiledNode>(header().nodes, header().nodeCount); }
+		Span<CompiledRange> ranges() const { return span<CompiledRange>(header().ranges, header().rangeCount); }
+		Span<CompiledGeometry> geometries() const { return span<CompiledGeometry>(header().geometries, header().geometryCount); }
+		Span<CompiledPrimitive> primitives() const { return span<CompiledPrimitive>(header().primitives, header().primitiveCount); }
+		Span<CompiledMaterial> materials() const { return span<CompiledMaterial>(header().materials, header().materialCount); }
+		Span<CompiledTexture> textures() const { return span<CompiledTexture>(header().textures, header().textureCount); }
+		Span<CompiledImage> images() const { return span<CompiledImage>(header().images, header().imageCount); }
+
+		const CompiledNode& root() const { return nodes()[0]; }
+		Span<uint32_t> children(const CompiledNode& node) const { return span<uint32_t>(header().children + node.firstChild * sizeof(uint32_t), node.childCount); }
+		Span<CompiledRange> ranges(const CompiledNode& node) const { return span<CompiledRange>(header().ranges + node.firstRange * sizeof(CompiledRange), node.rangeCount); }
+		Span<CompiledGeometry> geometries(const CompiledNode& node) const { return span<CompiledGeometry>(header().geometries + node.firstGeometry * sizeof(CompiledGeometry), node.geometryCount); }
+		Span<CompiledPrimitive> primitives(const CompiledGeometry& geometry) const { return span<CompiledPrimitive>(header().primitives + geometry.firstPrimitive * sizeof(CompiledPrimitive), geometry.primitiveCount); }
+
+		const Vec3f* positions(const CompiledGeometry& geometry) const { return at<Vec3f>(geometry.positions); }
+		const Vec3f* normals(const CompiledGeometry& geometry) const { return at<Vec3f>(geometry.normals); }
+		const Vec2f* texCoords(const CompiledGeometry& geometry) const { return at<Vec2f>(geometry.texCoords); }
+		const uint32_t* indices(const CompiledPrimitive& primitive) const { return at<uint32_t>(primitive.indices); }
+		const unsigned char* imageData(const CompiledImage& image) const { return at<unsigned char>(image.data); }
+		std::string_view filename(const CompiledRange& range) const { return std::string_view(at<char>(range.filename), range.filenameLength); }
+
+	private:
+		const unsigned char* _data = nullptr;
+
+		template<typename T> const T* at(uint64_t offset) const {
+			return offset ? (const T*)(_data + offset) : nullptr;
+		}
+		template<typename T> Span<T> span(uint64_t offset, size_t count) const {
+			return { (const T*)(_data + offset), count };
+		}
+	};
+
+	// Maps a compiled tile file and opens it in place, by default verifying its checksum, since a cache file may
+	// have been truncated or corrupted on disk.
+	inline bool loadCompiled(const char* filename, MappedFile& file, CompiledTile& tile, bool verifyChecksum = true, std::string* error = nullptr) {
+		if (!file.open(filename, error)) {
+			return false;
+		}
+		if (!tile.open(file.data(), file.size(), verifyChecksum, error)) {
+			if (error) {
+				*error = std::string(filename) + ": " + *error;
+			}
+			return false;
+		}
+		return true;
+	}
+};
@@ -0,0 +1,179 @@
+#pragma once
+#include "miniosgb_io.h"
+#include "miniosgb_parallel.h"
+#include <optional>
+#include <type_traits>
+
+namespace miniosgb
+{
+	struct DatasetOptions {
+		unsigned int threads = 0; // 0: one per core
+		size_t window = 0; // mapFiles(): results mapped but not consumed yet, at most; 0: four per worker
+		bool ordered = true; // mapFiles(): consume results in file order, else as they complete
+		ReadOptions read;
+	};
+
+	// A file of the dataset as handed to the map function; `data` lives until the map function returns.
+	struct DatasetFile {
+		size_t index = 0; // in the file list
+		const char* filename = nullptr;
+		Data* data = nullptr; // null when the file couldn't be read or parsed
+		std::string error;
+	};
+
+	namespace details {
+		// Parse state a worker reuses from file to file: the mapping object and the result record.
+		struct DatasetWorker {
+			MappedFile mapping;
+			DatasetFile file;
+			std::unique_ptr<Data> data;
+
+			const DatasetFile& open(const std::vector<std::string>& files, size_t index, const ReadOptions& options) {
+				file.index = index;
+				file.filename = files[index].c_str();
+				file.error.clear();
+				data.reset();
+				if (mapping.open(file.filename, &file.error)) {
+					std::string readError;
+					data = Data::read(mapping.data(), mapping.size(), options, &readError);
+					if (!data || !data->rootObject) {
+						data.reset();
+						file.error = files[index] + ": " + (readError.empty() ? "no root object" : readError);
+					}
+				}
+				file.data = data.get();
+				return file;
+			}
+
+			void close() {
+				data.reset();
+				mapping.close();
+			}
+		};
+	}
+
+	// Reads and parses every file on a worker pool, maps it with map(const DatasetFile&, worker) to a result, and
+	// hands the results to consume(index, Result&&) on the calling thread, in file order if DatasetOptions::ordered.
+	// Workers stall once `window` results wait for consume, so memory stays bounded however slow it is.
+	// The first exception thrown by map or consume stops the work and is rethrown to the caller.
+	template<typename Map, typename Consume>
+	void mapFiles(const std::vector<std::string>& files, const DatasetOptions& options, Map&& map, Consume&& consume) {
+		typedef typename std::decay<typename std::invoke_result<Map&, const DatasetFile&, unsigned int>::type>::type Result;
+		if (files.empty()) {
+			return;
+		}
+		const auto threads = (unsigned int)std::min<size_t>(defaultThreadCount(options.threads), files.size());
+		const auto window = (options.window > 0) ? options.window : size_t(4) * threads;
+
+		std::mutex mutex;
+		std::condition_variable canStart, canConsume;
+		size_t next = 0, consumed = 0;
+		std::vector<std::optional<Result>> slots(options.ordered ? window : 0); // result of file i at i % window
+		std::deque<std::pair<size_t, Result>> ready; // unordered: in completion order
+		bool stop = false;
+		std::exception_ptr exception;
+		const auto fail = [&](std::exception_ptr e) {
+			std::lock_guard<std::mutex> lock(mutex);
+			if (!exception) {
+				exception = e;
+			}
+			stop = true;
+			canStart.notify_all();
+			canConsume.notify_all();
+		};
+
+		std::vector<std::thread> workers;
+		for (unsigned int t = 0; t < threads; ++t) {
+			workers.emplace_back([&, t] {
+				details::DatasetWorker worker;
+				for (;;) {
+					size_t i;
+					{
+						std::unique_lock<std::mutex> lock(mutex);
+						canStart.wait(lock, [&] { return stop || (next == files.size()) || (next - consumed < window); });
+						if (stop || (next == files.size())) {
+							return;
+						}
+						i = next++;
+					}
+					try {
+						auto result = map(worker.open(files, i, options.read), t);
+						worker.close();
+						std::lock_guard<std::mutex> lock(mutex);
+						if (options.ordered) {
+							slots[i % window].emplace(std::move(result));
+						} else {
+							ready.emplace_back(i, std::move(result));
+						}
+						canConsume.notify_all();
+					} catch (...) {
+						worker.close();
+						fail(std::current_exception());
+						return;
+					}
+				}
+			});
+		}
+
+		for (; consumed < files.size();) {
+			size_t index = consumed;
+			std::optional<Result> result;
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				canConsume.wait(lock, [&] { return stop || (options.ordered ? slots[consumed % window].has_value() : !ready.empty()); });
+				if (stop) {
+					break;
+				}
+				if (options.ordered) {
+					result = std::move(slots[consumed % window]);
+					slots[consumed % window].reset();
+				} else {
+					index = ready.front().first;
+					result.emplace(std::move(ready.front().second));
+					ready.pop_front();
+				}
+			}
+			try {
+				consume(index, std::move(*result));
+			} catch (...) {
+				fail(std::current_exception());
+				break;
+			}
+			std::lock_guard<std::mutex> lock(mutex);
+			++consumed;
+			canStart.notify_one();
+		}
+		for (auto& worker : workers) {
+			worker.join();
+		}
+		if (exception) {
+			std::rethrow_exception(exception);
+		}
+	}
+
+	// Reads and parses every file on a worker pool and folds it with map(const DatasetFile&, Acc& local, worker)
+	// into an accumulator of the worker, started as a copy of `init`. The accumulators are then combined with
+	// merge(Acc& total, Acc&& local) in worker order and the total returned; `init` should be the identity.
+	template<typename Acc, typename Map, typename Merge>
+	Acc reduceFiles(const std::vector<std::string>& files, const DatasetOptions& options, const Acc& init, Map&& map, Merge&& merge) {
+		struct alignas(64) Local { // no false sharing between the workers' accumulators
+			Acc value;
+			details::DatasetWorker worker;
+		};
+		const auto threads = defaultThreadCount(options.threads);
+		std::vector<std::unique_ptr<Local>> locals(threads);
+		for (auto& local : locals) {
+			local.reset(new Local{ init, {} });
+		}
+		parallelFor(files.size(), threads, [&](size_t i, unsigned int t) {
+			auto& local = *locals[t];
+			map(local.worker.open(files, i, options.read), local.value, t);
+			local.worker.close();
+		});
+		Acc total = init;
+		for (auto& local : locals) {
+			merge(total, std::move(local->value));
+		}
+		return total;
+	}
+};
@@ -0,0 +1,59 @@
+#pragma once
+#include "miniosgb_raster.h"
+
+namespace miniosgb
+{
+	// Digital surface model: the highest finest-level surface per grid cell.
+	struct DsmOptions : RasterOptions {
+		float noData = -9999.0f;
+	};
+
+	// Receives the finished grid strip by strip, top to bottom. Returning false cancels rasterization.
+	typedef std::function<bool(unsigned int row, unsigned int rowCount, unsigned int columns, const float* heights)> DsmStripSink;
+
+	// Rasterizes the finest-level triangles of `files` into a height grid covering the requested extent.
+	// Tiles are rasterized into worker-local windows and merged into the current strip with max-z, so memory
+	// stays bounded by the strip plus one tile per thread.
+	inline bool rasterizeDsm(const std::vector<std::string>& files, const DsmOptions& options, const DsmStripSink& sink, std::string* error = nullptr) {
+		if (!details::validRaster(options, error)) {
+			return false;
+		}
+		const details::RasterGrid grid(options);
+		std::vector<std::vector<float>> windows(defaultThreadCount(options.threads));
+		std::vector<float> strip(size_t(grid.stripRows) * grid.columns, options.noData);
+		unsigned int stripRow0 = 0;
+		std::mutex stripMutex;
+
+		return details::rasterizeStrips(files, options, grid,
+			[&](unsigned int worker, Data& data, const details::RasterGrid::Window& window) {
+				auto& heights = windows[worker];
+				heights.assign(window.size(), -FLT_MAX);
+				details::forEachFinestTriangle(data, options.offset, [&](Geometry&, unsigned int, unsigned int, unsigned int,
+					const Vec3d& a, const Vec3d& b, const Vec3d& c) {
+					grid.scan(a, b, c, window, [&](size_t cell, double w0, double w1, double w2) {
+						const auto z = (float)(w0 * a.z + w1 * b.z + w2 * c.z);
+						if (z > heights[cell]) {
+							heights[cell] = z;
+						}
+					});
+				});
+
+				std::lock_guard<std::mutex> lock(stripMutex);
+				for (unsigned int r = 0; r < window.rows; ++r) {
+					const float* src = heights.data() + size_t(r) * window.columns;
+					float* dst = strip.data() + size_t(window.row0 + r - stripRow0) * grid.columns + window.col0;
+					for (unsigned int col = 0; col < window.columns; ++col) {
+						if ((src[col] != -FLT_MAX) && ((dst[col] == options.noData) || (src[col] > dst[col]))) {
+							dst[col] = src[col];
+						}
+					}
+				}
+			},
+			[&](unsigned int row0, unsigned int rowCount) {
+				const auto ok = sink(row0, rowCount, grid.columns, strip.data());
+				std::fill(strip.begin(), strip.end(), options.noData);
+				stripRow0 = row0 + rowCount;
+				return ok;
+			}, error);
+	}
+};
@@ -0,0 +1,385 @@
+#pragma once
+#include "miniosgb_mesh.h"
+#include <array>
+#include <cstdint>
+#include <string_view>
+
+namespace miniosgb
+{
+	// The scene of a parsed tile as plain arrays, one per field (structure of arrays), for traversals, culling
+	// and exports that would otherwise chase pointers and dispatch on type at every node. Nodes are grouped by
+	// kind; tree links are index ranges into `children` and `geometryRefs`. Shared objects appear once.
+	//
+	// Zero-copy like Data: positions, indices, images and file names point into the Data and its source
+	// buffer, which must outlive the FlatScene. The payloads are not aligned there, so vertices and indices are
+	// read through position(), normal(), texCoord() and index(), which copy them out like vertexAt().
+	struct FlatScene {
+		static constexpr uint32_t none = 0xFFFFFFFF;
+
+		enum class NodeKind : uint8_t { Group = 0, LOD = 1, PagedLOD = 2, Geode = 3, Count = 4 };
+
+		// Node i has kind k for kindBegin[k] <= i < kindBegin[k + 1]; LOD and PagedLOD nodes are adjacent, so the
+		// LOD columns are indexed by i - kindBegin[LOD].
+		std::array<uint32_t, (size_t)NodeKind::Count + 1> kindBegin = {};
+		uint32_t root = none;
+
+		struct Nodes {
+			std::vector<NodeKind> kind;
+			std::vector<uint32_t> parent; // the first parent met depth first; none for the root
+			std::vector<uint32_t> firstChild; // range into `children`
+			std::vector<uint32_t> childCount;
+			std::vector<uint32_t> firstGeometry; // range into `geometryRefs`, Geodes only
+			std::vector<uint32_t> geometryCount;
+			std::vector<Box3d> bounds; // of the geometries in the subtree
+			size_t size() const { return kind.size(); }
+		} nodes;
+		std::vector<uint32_t> children; // node indices
+		std::vector<uint32_t> geometryRefs; // geometry indices
+
+		struct Lods {
+			std::vector<LOD::RangeMode> rangeMode;
+			std::vector<Vec3d> center;
+			std::vector<double> radius;
+			std::vector<uint32_t> firstRange; // range into `ranges`: one per child (LOD) or range data entry (PagedLOD)
+			std::vector<uint32_t> rangeCount;
+		} lods;
+
+		struct Ranges {
+			std::vector<float> min;
+			std::vector<float> max;
+			std::vector<std::string_view> filename; // PagedLOD file, empty when none
+		} ranges;
+
+		struct Geometries {
+			std::vector<const unsigned char*> positions; // Vec3f
+			std::vector<const unsigned char*> normals; // Vec3f per vertex, nullptr when none
+			std::vector<const unsigned char*> texCoords; // Vec2f of unit 0 per vertex, nullptr when none
+			std::vector<uint32_t> vertexCount;
+			std::vector<uint32_t> firstPrimitive; // range into `primitives`
+			std::vector<uint32_t> primitiveCount;
+			std::vector<uint32_t> material; // index or none
+			std::vector<uint32_t> texture; // index or none
+			std::vector<Box3d> bounds;
+			size_t size() const { return positions.size(); }
+		} geometries;
+
+		struct Primitives {
+			std::vector<uint32_t> mode; // PrimitiveMode
+			std::vector<const unsigned char*> indices; // uint32_t
+			std::vector<uint32_t> indexCount;
+		} primitives;
+
+		std::vector<const Material*> materials;
+
+		struct Textures {
+			std::vector<uint32_t> image; // index
+			std::vector<Texture::WrapMode> wrapS;
+			std::vector<Texture::WrapMode> wrapT;
+		} textures;
+
+		struct Images {
+			std::vector<const unsigned char*> data; // the inline image file as stored in the OSGB
+			std::vector<uint32_t> size;
+		} images;
+
+		Vec3f position(uint32_t geometry, uint32_t vertex) const {
+			return element<Vec3f>(geometries.positions[geometry], vertex);
+		}
+
+		// Geometries with normals only.
+		Vec3f normal(uint32_t geometry, uint32_t vertex) const {
+			return element<Vec3f>(geometries.normals[geometry], vertex);
+		}
+
+		// Geometries with texture coordinates only.
+		Vec2f texCoord(uint32_t geometry, uint32_t vertex) const {
+			return element<Vec2f>(geometries.texCoords[geometry], vertex);
+		}
+
+		uint32_t index(uint32_t primitive, uint32_t i) const {
+			return element<uint32_t>(primitives.indices[primitive], i);
+		}
+
+		uint32_t kindCount(NodeKind kind) const {
+			return kindBegin[(size_t)kind + 1] - kindBegin[(size_t)kind];
+		}
+
+		// A PagedLOD with file names: its own geometries are the coarse representation of what the files hold.
+		bool pagesOut(uint32_t node) const {
+			if (nodes.kind[node] != NodeKind::PagedLOD) {
+				return false;
+			}
+			const auto lod = node - kindBegin[(size_t)NodeKind::LOD];
+			for (uint32_t r = 0; r < lods.rangeCount[lod]; ++r) {
+				if (!ranges.filename[lods.firstRange[lod] + r].empty()) {
+					return true;
+				}
+			}
+			return false;
+		}
+
+	private:
+		template<typename T> static T element(const unsigned char* data, uint32_t i) {
+			T value;
+			memcpy(&value, data + size_t(i) * sizeof(T), sizeof(T));
+			return value;
+		}
+	};
+
+	namespace details {
+		class SceneFlattener {
+		public:
+			explicit SceneFlattener(FlatScene& scene) : _scene(scene) {}
+
+			void flatten(const Object* root) {
+				collect(root);
+				if (_order.empty()) {
+					return;
+				}
+
+				// number the nodes kind by kind, each kind in depth-first order
+				std::array<uint32_t, (size_t)FlatScene::NodeKind::Count> counts = {};
+				for (const auto& entry : _order) {
+					++counts[(size_t)entry.kind];
+				}
+				for (size_t k = 0; k < counts.size(); ++k) {
+					_scene.kindBegin[k + 1] = _scene.kindBegin[k] + counts[k];
+				}
+				auto next = _scene.kindBegin;
+				for (auto& entry : _order) {
+					entry.index = next[(size_t)entry.kind]++;
+					_indices[entry.obj] = entry.index;
+				}
+				_scene.root = _indices[root];
+
+				const auto count = _order.size();
+				auto& nodes = _scene.nodes;
+				nodes.kind.resize(count);
+				nodes.parent.assign(count, FlatScene::none);
+				nodes.firstChild.resize(count);
+				nodes.childCount.resize(count);
+				nodes.firstGeometry.resize(count);
+				nodes.geometryCount.resize(count);
+				nodes.bounds.resize(count);
+				const auto lodCount = _scene.kindCount(FlatScene::NodeKind::LOD) + _scene.kindCount(FlatScene::NodeKind::PagedLOD);
+				_scene.lods.rangeMode.resize(lodCount);
+				_scene.lods.center.resize(lodCount);
+				_scene.lods.radius.resize(lodCount);
+				_scene.lods.firstRange.resize(lodCount);
+				_scene.lods.rangeCount.resize(lodCount);
+
+				// tables in node order, so the child and geometry lists of a kind are contiguous too
+				std::vector<const Entry*> byIndex(count);
+				for (const auto& entry : _order) {
+					byIndex[entry.index] = &entry;
+				}
+				for (uint32_t i = 0; i < count; ++i) {
+					addNode(i, *byIndex[i]);
+				}
+
+				// subtree bounds, children before parents
+				for (const auto obj : _postOrder) {
+					const auto i = _indices[obj];
+					auto& box = nodes.bounds[i];
+					for (uint32_t g = 0; g < nodes.geometryCount[i]; ++g) {
+						box.expand(_scene.geometries.bounds[_scene.geometryRefs[nodes.firstGeometry[i] + g]]);
+					}
+					for (uint32_t c = 0; c < nodes.childCount[i]; ++c) {
+						box.expand(nodes.bounds[_scene.children[nodes.firstChild[i] + c]]);
+					}
+				}
+			}
+
+		private:
+			struct Entry {
+				const Object* obj;
+				FlatScene::NodeKind kind;
+				uint32_t index;
+			};
+
+			FlatScene& _scene;
+			std::vector<Entry> _order; // depth first, parents before children
+			std::vector<const Object*> _postOrder; // children before parents
+			std::unordered_map<const Object*, uint32_t> _indices;
+			std::unordered_map<const Geometry*, uint32_t> _geometryIndices;
+			std::unordered_map<const Material*, uint32_t> _materialIndices;
+			std::unordered_map<const Texture2D*, uint32_t> _textureIndices;
+			std::unordered_map<const Image*, uint32_t> _imageIndices;
+
+			void collect(const Object* obj) {
+				const auto group = objectCast<Group>(obj);
+				const auto geode = objectCast<Geode>(obj);
+				if (((group == nullptr) && (geode == nullptr)) || !_indices.emplace(obj, FlatScene::none).second) {
+					return;
+				}
+				auto kind = FlatScene::NodeKind::Geode;
+				if (objectCast<PagedLOD>(obj)) {
+					kind = FlatScene::NodeKind::PagedLOD;
+				} else if (objectCast<LOD>(obj)) {
+					kind = FlatScene::NodeKind::LOD;
+				} else if (group) {
+					kind = FlatScene::NodeKind::Group;
+				}
+				_order.push_back({ obj, kind, FlatScene::none });
+				if (group) {
+					for (const auto& child : group->children) {
+						collect(child.get());
+					}
+				}
+				_postOrder.push_back(obj);
+			}
+
+			void addNode(uint32_t i, const Entry& entry) {
+				auto& nodes = _scene.nodes;
+				nodes.kind[i] = entry.kind;
+				nodes.firstChild[i] = (uint32_t)_scene.children.size();
+				if (const auto group = objectCast<Group>(entry.obj)) {
+					for (const auto& child : group->children) {
+						const auto it = _indices.find(child.get());
+						if (it != _indices.end()) {
+							_scene.children.push_back(it->second);
+							if (nodes.parent[it->second] == FlatScene::none && (it->second != _scene.root)) {
+								nodes.parent[it->second] = i;
+							}
+						}
+					}
+				}
+				nodes.childCount[i] = (uint32_t)_scene.children.size() - nodes.firstChild[i];
+
+				nodes.firstGeometry[i] = (uint32_t)_scene.geometryRefs.size();
+				if (const auto geode = objectCast<Geode>(entry.obj)) {
+					for (const auto& drawable : geode->drawables) {
+						if (const auto geometry = objectCast<Geometry>(drawable.get())) {
+							const auto g = addGeometry(*geometry);
+							if (g != FlatScene::none) {
+								_scene.geometryRefs.push_back(g);
+							}
+						}
+					}
+				}
+				nodes.geometryCount[i] = (uint32_t)_scene.geometryRefs.size() - nodes.firstGeometry[i];
+
+				if (const auto lod = objectCast<LOD>(entry.obj)) {
+					const auto l = i - _scene.kindBegin[(size_t)FlatScene::NodeKind::LOD];
+					auto& lods = _scene.lods;
+					lods.rangeMode[l] = lod->rangeMode;
+					lods.center[l] = lod->userDefinedCenter;
+					lods.radius[l] = lod->userDefinedRadius;
+					lods.firstRange[l] = (uint32_t)_scene.ranges.min.size();
+					const auto plod = objectCast<PagedLOD>(lod);
+					const auto count = std::max(lod->rangeList.size(), plod ? plod->rangeDataList.size() : 0);
+					for (size_t r = 0; r < count; ++r) {
+						const auto inRange = (r < lod->rangeList.size());
+						_scene.ranges.min.push_back(inRange ? lod->rangeList[r].min : 0);
+						_scene.ranges.max.push_back(inRange ? lod->rangeList[r].max : 0);
+						_scene.ranges.filename.push_back((plod && (r < plod->rangeDataList.size())) ? std::string_view(plod->rangeDataList[r].filename) : std::string_view());
+					}
+					lods.rangeCount[l] = (uint32_t)count;
+				}
+			}
+
+			uint32_t addGeometry(const Geometry& geometry) {
+				const auto it = _geometryIndices.find(&geometry);
+				if (it != _geometryIndices.end()) {
+					return it->second;
+				}
+				const auto vertices = positionsOf(geometry);
+				if (vertices == nullptr) {
+					return _geometryIndices[&geometry] = FlatScene::none;
+				}
+				auto& g = _scene.geometries;
+				g.positions.push_back(vertices->elementData);
+				const auto& normals = geometry.normalData;
+				const auto perVertexNormals = normals && (normals->arrayType == Array::ArrayType::Vec3f) && (normals->binding == Array::Binding::PerVertex)
+					&& (normals->elementCount >= vertices->elementCount);
+				g.normals.push_back(perVertexNormals ? normals->elementData : nullptr);
+				const auto texCoords = texCoordsOf(geometry);
+				g.texCoords.push_back(texCoords ? texCoords->elementData : nullptr);
+				g.vertexCount.push_back(vertices->elementCount);
+				g.firstPrimitive.push_back((uint32_t)_scene.primitives.mode.size());
+				for (const auto& prim : geometry.primitives) {
+					if (prim && prim->indexData && (prim->indexCount > 0)) {
+						_scene.primitives.mode.push_back(prim->mode);
+						_scene.primitives.indices.push_back(prim->indexData);
+						_scene.primitives.indexCount.push_back(prim->indexCount);
+					}
+				}
+				g.primitiveCount.push_back((uint32_t)_scene.primitives.mode.size() - g.firstPrimitive.back());
+				const auto material = materialOf(geometry);
+				g.material.push_back(material ? addMaterial(material) : FlatScene::none);
+				const auto texture = textureOf(geometry);
+				g.texture.push_back((texture && texture->image && texture->image->data) ? addTexture(*texture) : FlatScene::none);
+				g.bounds.push_back(boundsOf(geometry));
+				return _geometryIndices[&geometry] = (uint32_t)(g.size() - 1);
+			}
+
+			uint32_t addMaterial(const Material* material) {
+				const auto it = _materialIndices.find(material);
+				if (it != _materialIndices.end()) {
+					return it->second;
+				}
+				_scene.materials.push_back(material);
+				return _materialIndices[material] = (uint32_t)(_scene.materials.size() - 1);
+			}
+
+			uint32_t addTexture(const Texture2D& texture) {
+				const auto it = _textureIndices.find(&texture);
+				if (it != _textureIndices.end()) {
+					return it->second;
+				}
+				const auto image = texture.image.get();
+				auto imageIndex = FlatScene::none;
+				const auto found = _imageIndices.find(image);
+				if (found != _imageIndices.end()) {
+					imageIndex = found->second;
+				} else {
+					_scene.images.data.push_back(image->data);
+					_scene.images.size.push_back(image->dataLength);
+					imageIndex = _imageIndices[image] = (uint32_t)(_scene.images.data.size() - 1);
+				}
+				_scene.textures.image.push_back(imageIndex);
+				_scene.textures.wrapS.push_back(texture.wrapS);
+				_scene.textures.wrapT.push_back(texture.wrapT);
+				return _textureIndices[&texture] = (uint32_t)(_scene.textures.image.size() - 1);
+			}
+		};
+	}
+
+	// Flattens the node graph of `data`; an empty scene (root == none) if its root isn't a node.
+	inline FlatScene flattenScene(const Data& data) {
+		FlatScene scene;
+		details::SceneFlattener flattener(scene);
+		flattener.flatten(data.rootObject.get());
+		return scene;
+	}
+
+	// Flat counterpart of forEachGeometry(): each geometry reachable from the root once, `finest` false under a
+	// PagedLOD that pages out to files. Walks the index arrays with an explicit stack.
+	template<typename F> void forEachGeometry(const FlatScene& scene, F&& fn) {
+		if (scene.root == FlatScene::none) {
+			return;
+		}
+		std::vector<unsigned char> visitedNodes(scene.nodes.size()), visitedGeometries(scene.geometries.size());
+		std::vector<std::pair<uint32_t, bool>> stack = { { scene.root, true } };
+		while (!stack.empty()) {
+			const auto node = stack.back().first;
+			const auto finest = stack.back().second && !scene.pagesOut(node);
+			stack.pop_back();
+			if (visitedNodes[node]) {
+				continue;
+			}
+			visitedNodes[node] = 1;
+			for (uint32_t g = 0; g < scene.nodes.geometryCount[node]; ++g) {
+				const auto geometry = scene.geometryRefs[scene.nodes.firstGeometry[node] + g];
+				if (!visitedGeometries[geometry]) {
+					visitedGeometries[geometry] = 1;
+					fn(geometry, finest);
+				}
+			}
+			// reversed, so children are visited in order
+			for (auto c = scene.nodes.childCount[node]; c > 0; --c) {
+				stack.push_back({ scene.children[scene.nodes.firstChild[node] + c - 1], finest });
+			}
+		}
+	}
+};
@@ -0,0 +1,401 @@
+#pragma once
+#include "miniosgb_io.h"
+#include "miniosgb_mesh.h"
+#include "miniosgb_image.h"
+#include <map>
+
+namespace miniosgb
+{
+	struct GltfOptions {
+		bool yUp = true; // rotate OSG's Z-up into glTF's Y-up at the root node
+		bool unlit = true; // KHR_materials_unlit: photogrammetry textures already carry their lighting
+		bool flipTexCoords = false; // copy UVs flipped instead of referencing them and flipping via KHR_texture_transform
+		bool finestOnly = false; // skip geometries a PagedLOD replaces by a finer file
+	};
+
+	// A GLB file as a list of slices. Vertex, UV, normal and index arrays and inline image files are referenced in
+	// place in the parsed tile, so a Glb is only valid as long as the buffer the tile was read from.
+	struct Glb {
+		std::vector<IoSlice> slices;
+		size_t size() const { return totalSize(slices); }
+
+		Glb() = default;
+		Glb(const Glb&) = delete;
+		Glb& operator=(const Glb&) = delete;
+		Glb(Glb&&) = default;
+		Glb& operator=(Glb&&) = default;
+
+		// storage of the slices that are not borrowed from the tile
+		std::vector<unsigned char> header;
+		std::vector<unsigned char> json;
+		std::vector<std::vector<Vec2f>> flippedTexCoords;
+	};
+
+	namespace details {
+		// https://registry.khronos.org/glTF/specs/2.0/glTF-2.0.html#_sampler_wraps
+		inline unsigned int gltfWrapMode(Texture::WrapMode mode) {
+			switch (mode) {
+				case Texture::WrapMode::Repeat: return 10497; // REPEAT
+				case Texture::WrapMode::Mirror: return 33648; // MIRRORED_REPEAT
+				default: return 33071; // CLAMP_TO_EDGE
+			}
+		}
+
+		struct GltfBuilder {
+			const GltfOptions& options;
+			Glb& glb;
+			std::vector<IoSlice> bin;
+			size_t binSize = 0;
+
+			std::string bufferViews;
+			std::string accessors;
+			std::string primitives;
+			std::string materials;
+			std::string textures;
+			std::string samplers;
+			std::string images;
+			size_t bufferViewCount = 0;
+			size_t accessorCount = 0;
+			size_t materialCount = 0;
+			size_t textureCount = 0;
+			size_t samplerCount = 0;
+			size_t imageCount = 0;
+			std::unordered_map<const Array*, size_t> arrayAccessors;
+			std::unordered_map<const Image*, size_t> imageIndices;
+			std::unordered_map<unsigned long long, size_t> samplerIndices;
+			std::unordered_map<const Texture2D*, size_t> textureIndices;
+			std::map<std::pair<const Material*, const Texture2D*>, size_t> materialIndices;
+
+			GltfBuilder(const GltfOptions& options_, Glb& glb_) : options(options_), glb(glb_) {}
+
+			static void separate(std::string& list) {
+				if (!list.empty()) {
+					list += ',';
+				}
+			}
+
+			size_t addBufferView(const void* data, size_t size, unsigned int target) {
+				static const unsigned char zeros[4] = { 0, 0, 0, 0 };
+				separate(bufferViews);
+				bufferViews += "{\"buffer\":0,\"byteOffset\":";
+				appendNumber(bufferViews, binSize);
+				bufferViews += ",\"byteLength\":";
+				appendNumber(bufferViews, size);
+				if (target) {
+					bufferViews += ",\"target\":";
+					appendNumber(bufferViews, (size_t)target);
+				}
+				bufferViews += '}';
+				bin.push_back({ data, size });
+				binSize += size;
+				if (binSize & 3) {
+					bin.push_back({ zeros, 4 - (binSize & 3) });
+					binSize += 4 - (binSize & 3);
+				}
+				return bufferViewCount++;
+			}
+
+			size_t addAccessor(size_t bufferView, unsigned int componentType, size_t count, const char* type, const Box3d* bounds = nullptr) {
+				separate(accessors);
+				accessors += "{\"bufferView\":";
+				appendNumber(accessors, bufferView);
+				accessors += ",\"componentType\":";
+				appendNumber(accessors, (size_t)componentType);
+				accessors += ",\"count\":";
+				appendNumber(accessors, count);
+				accessors += ",\"type\":\"";
+				accessors += type;
+				accessors += '"';
+				if (bounds) {
+					const double values[6] = { bounds->min.x, bounds->min.y, bounds->min.z, bounds->max.x, bounds->max.y, bounds->max.z };
+					for (int m = 0; m < 2; ++m) {
+						accessors += m ? ",\"max\":[" : ",\"min\":[";
+						for (int i = 0; i < 3; ++i) {
+							if (i) {
+								accessors += ',';
+							}
+							appendNumber(accessors, (double)(float)values[m * 3 + i]);
+						}
+						accessors += ']';
+					}
+				}
+				accessors += '}';
+				return accessorCount++;
+			}
+
+			size_t vertexAccessor(const Array& arr, bool positions) {
+				const auto it = arrayAccessors.find(&arr);
+				if (it != arrayAccessors.end()) {
+					return it->second;
+				}
+				const auto view = addBufferView(arr.elementData, size_t(arr.elementCount) * arr.elementSize, 34962); // ARRAY_BUFFER
+				const auto box = positions ? boundsOf(arr) : Box3d();
+				const auto accessor = addAccessor(view, 5126, arr.elementCount, "VEC3", positions ? &box : nullptr); // FLOAT
+				arrayAccessors[&arr] = accessor;
+				return accessor;
+			}
+
+			size_t texCoordAccessor(const Array& arr, unsigned int count) {
+				const auto it = arrayAccessors.find(&arr);
+				if (it != arrayAccessors.end()) {
+					return it->second;
+				}
+				size_t view;
+				if (options.flipTexCoords) {
+					glb.flippedTexCoords.emplace_back(count);
+					auto& flipped = glb.flippedTexCoords.back();
+					for (unsigned int i = 0; i < count; ++i) {
+						const auto uv = texCoordAt(arr, i);
+						flipped[i] = { uv.x, 1.0f - uv.y };
+					}
+					view = addBufferView(flipped.data(), flipped.size() * sizeof(Vec2f), 34962);
+				} else {
+					view = addBufferView(arr.elementData, size_t(count) * sizeof(Vec2f), 34962);
+				}
+				const auto accessor = addAccessor(view, 5126, count, "VEC2");
+				arrayAccessors[&arr] = accessor;
+				return accessor;
+			}
+
+			// -1 when the texture has no image we can embed
+			long long textureIndex(const Texture2D& texture) {
+				const auto it = textureIndices.find(&texture);
+				if (it != textureIndices.end()) {
+					return (long long)it->second;
+				}
+				ImageInfo info;
+				if (!texture.image || !probeImage(*texture.image, info)) {
+					return -1;
+				}
+				size_t image;
+				const auto imageIt = imageIndices.find(texture.image.get());
+				if (imageIt != imageIndices.end()) {
+					image = imageIt->second;
+				} else {
+					const auto view = addBufferView(texture.image->data, texture.image->dataLength, 0);
+					separate(images);
+					images += "{\"bufferView\":";
+					appendNumber(images, view);
+					images += ",\"mimeType\":\"";
+					images += mimeTypeOf(info.format);
+					images += "\"}";
+					image = imageIndices[texture.image.get()] = imageCount++;
+				}
+				const auto samplerKey = ((unsigned long long)texture.wrapS << 32) | (unsigned int)texture.wrapT;
+				size_t sampler;
+				const auto samplerIt = samplerIndices.find(samplerKey);
+				if (samplerIt != samplerIndices.end()) {
+					sampler = samplerIt->second;
+				} else {
+					separate(samplers);
+					samplers += "{\"magFilter\":9729,\"minFilter\":9987,\"wrapS\":"; // LINEAR, LINEAR_MIPMAP_LINEAR
+					appendNumber(samplers, (size_t)gltfWrapMode(texture.wrapS));
+					samplers += ",\"wrapT\":";
+					appendNumber(samplers, (size_t)gltfWrapMode(texture.wrapT));
+					samplers += '}';
+					sampler = samplerIndices[samplerKey] = samplerCount++;
+				}
+				separate(textures);
+				textures += "{\"sampler\":";
+				appendNumber(textures, sampler);
+				textures += ",\"source\":";
+				appendNumber(textures, image);
+				textures += '}';
+				textureIndices[&texture] = textureCount;
+				return (long long)textureCount++;
+			}
+
+			size_t materialIndex(const Material* material, const Texture2D* texture) {
+				const auto key = std::make_pair(material, texture);
+				const auto it = materialIndices.find(key);
+				if (it != materialIndices.end()) {
+					return it->second;
+				}
+				const auto textureId = texture ? textureIndex(*texture) : -1;
+				const auto diffuse = material ? material->diffuse.front : Vec4f{ 1, 1, 1, 1 };
+				separate(materials);
+				materials += "{\"pbrMetallicRoughness\":{\"baseColorFactor\":[";
+				const float factors[4] = { diffuse.x, diffuse.y, diffuse.z, diffuse.w };
+				for (int i = 0; i < 4; ++i) {
+					if (i) {
+						materials += ',';
+					}
+					appendNumber(materials, (double)std::min(1.0f, std::max(0.0f, factors[i])));
+				}
+				materials += "],\"metallicFactor\":0,\"roughnessFactor\":1";
+				if (textureId >= 0) {
+					materials += ",\"baseColorTexture\":{\"index\":";
+					appendNumber(materials, (size_t)textureId);
+					if (!options.flipTexCoords) {
+						materials += ",\"extensions\":{\"KHR_texture_transform\":{\"offset\":[0,1],\"scale\":[1,-1]}}";
+					}
+					materials += '}';
+				}
+				materials += '}';
+				if (options.unlit) {
+					materials += ",\"extensions\":{\"KHR_materials_unlit\":{}}";
+				}
+				if (diffuse.w < 1.0f) {
+					materials += ",\"alphaMode\":\"BLEND\"";
+				}
+				materials += '}';
+				return materialIndices[key] = materialCount++;
+			}
+
+			void addGeometry(const Geometry& geometry) {
+				const auto vertices = positionsOf(geometry);
+				if (vertices == nullptr) {
+					return;
+				}
+				std::string attributes = "{\"POSITION\":";
+				appendNumber(attributes, vertexAccessor(*vertices, true));
+				const auto& normals = geometry.normalData;
+				if (normals && (normals->arrayType == Array::ArrayType::Vec3f) && normals->elementData
+					&& (normals->binding == Array::Binding::PerVertex) && (normals->elementCount == vertices->elementCount)) {
+					attributes += ",\"NORMAL\":";
+					appendNumber(attributes, vertexAccessor(*normals, false));
+				}
+				const auto texCoords = texCoordsOf(geometry);
+				const auto texture = texCoords ? textureOf(geometry) : nullptr;
+				if (texCoords) {
+					attributes += ",\"TEXCOORD_0\":";
+					appendNumber(attributes, texCoordAccessor(*texCoords, vertices->elementCount));
+				}
+				attributes += '}';
+				const auto material = materialIndex(materialOf(geometry), texture);
+
+				for (const auto& prim : geometry.primitives) {
+					if (!prim || (prim->indexData == nullptr) || (prim->indexCount == 0) || (prim->mode > 6)) {
+						continue;
+					}
+					unsigned int maxIndex = 0;
+					for (unsigned int i = 0; i < prim->indexCount; ++i) {
+						maxIndex = std::max(maxIndex, indexAt(*prim, i));
+					}
+					if (maxIndex >= vertices->elementCount) {
+						continue;
+					}
+					const auto view = addBufferView(prim->indexData, size_t(prim->indexCount) * sizeof(unsigned int), 34963); // ELEMENT_ARRAY_BUFFER
+					const auto indices = addAccessor(view, 5125, prim->indexCount, "SCALAR"); // UNSIGNED_INT
+					separate(primitives);
+					primitives += "{\"attributes\":";
+					primitives += attributes;
+					primitives += ",\"indices\":";
+					appendNumber(primitives, indices);
+					primitives += ",\"material\":";
+					appendNumber(primitives, material);
+					primitives += ",\"mode\":";
+					appendNumber(primitives, (size_t)prim->mode);
+					primitives += '}';
+				}
+			}
+
+			static Box3d boundsOf(const Array& arr) {
+				Box3d box;
+				for (unsigned int i = 0; i < arr.elementCount; ++i) {
+					const auto v = vertexAt(arr, i);
+					box.expand(v.x, v.y, v.z);
+				}
+				return box;
+			}
+
+			std::string json() const {
+				std::string out = "{\"asset\":{\"version\":\"2.0\",\"generator\":\"MiniOSGB\"}";
+				std::vector<std::string> extensions;
+				if (!materials.empty() && options.unlit) {
+					extensions.push_back("KHR_materials_unlit");
+				}
+				if ((textureCount > 0) && !options.flipTexCoords) {
+					extensions.push_back("KHR_texture_transform");
+				}
+				if (!extensions.empty()) {
+					std::string list;
+					for (const auto& extension : extensions) {
+						separate(list);
+						list += '"' + extension + '"';
+					}
+					out += ",\"extensionsUsed\":[" + list + "],\"extensionsRequired\":[" + list + "]";
+				}
+				out += ",\"scene\":0";
+				if (primitives.empty()) {
+					out += ",\"scenes\":[{}]";
+				} else {
+					out += ",\"scenes\":[{\"nodes\":[0]}],\"nodes\":[{\"mesh\":0";
+					if (options.yUp) {
+						out += ",\"matrix\":[1,0,0,0,0,0,-1,0,0,1,0,0,0,0,0,1]";
+					}
+					out += "}],\"meshes\":[{\"primitives\":[" + primitives + "]}]";
+				}
+				const auto list = [&out](const char* name, const std::string& items) {
+					if (!items.empty()) {
+						out += ",\"";
+						out += name;
+						out += "\":[" + items + "]";
+					}
+				};
+				list("materials", materials);
+				list("textures", textures);
+				list("samplers", samplers);
+				list("images", images);
+				list("accessors", accessors);
+				list("bufferViews", bufferViews);
+				if (binSize > 0) {
+					out += ",\"buffers\":[{\"byteLength\":";
+					appendNumber(out, binSize);
+					out += "}]";
+				}
+				out += '}';
+				return out;
+			}
+		};
+	}
+
+	// Builds a binary glTF 2.0 of all geometries of a parsed tile, one primitive per primitive set.
+	inline bool buildGlb(const Data& data, Glb& glb, const GltfOptions& options = {}, std::string* error = nullptr) {
+		MINIOSGB_TRACE_SCOPE("convert", "buildGlb");
+		glb = Glb();
+		details::GltfBuilder builder(options, glb);
+		forEachGeometry(data.rootObject.get(), [&](Geometry& geometry, bool finest) {
+			if (finest || !options.finestOnly) {
+				builder.addGeometry(geometry);
+			}
+		});
+
+		const auto json = builder.json();
+		glb.json.assign(json.begin(), json.end());
+		glb.json.resize((glb.json.size() + 3) & ~size_t(3), ' ');
+		const auto total = 12 + 8 + glb.json.size() + (builder.binSize ? 8 + builder.binSize : 0);
+		if (total > 0xFFFFFFFFull) {
+			if (error) {
+				*error = "glb larger than 4GB";
+			}
+			return false;
+		}
+		// https://registry.khronos.org/glTF/specs/2.0/glTF-2.0.html#binary-gltf-layout
+		const auto put32 = [&glb](unsigned int value) {
+			for (int b = 0; b < 4; ++b) {
+				glb.header.push_back((unsigned char)(value >> (8 * b)));
+			}
+		};
+		glb.header.reserve(28);
+		put32(0x46546C67); // glTF
+		put32(2);
+		put32((unsigned int)total);
+		put32((unsigned int)glb.json.size());
+		put32(0x4E4F534A); // JSON
+		put32((unsigned int)builder.binSize);
+		put32(0x004E4942); // BIN
+		glb.slices.push_back({ glb.header.data(), 20 });
+		glb.slices.push_back({ glb.json.data(), glb.json.size() });
+		if (builder.binSize) {
+			glb.slices.push_back({ glb.header.data() + 20, 8 });
+			glb.slices.insert(glb.slices.end(), builder.bin.begin(), builder.bin.end());
+		}
+		return true;
+	}
+
+	inline bool writeGlb(const Data& data, const char* filename, const GltfOptions& options = {}, std::string* error = nullptr) {
+		Glb glb;
+		return buildGlb(data, glb, options, error) && writeFile(filename, glb.slices, error);
+	}
+};
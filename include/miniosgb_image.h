@@ -0,0 +1,97 @@
+#pragma once
+#include "miniosgb.h"
+#include <functional>
+
+namespace miniosgb
+{
+	enum class ImageFormat { Unknown = 0, Jpeg, Png };
+
+	struct ImageInfo {
+		ImageFormat format = ImageFormat::Unknown;
+		unsigned int width = 0;
+		unsigned int height = 0;
+	};
+
+	inline const char* mimeTypeOf(ImageFormat format) {
+		switch (format) {
+			case ImageFormat::Jpeg: return "image/jpeg";
+			case ImageFormat::Png: return "image/png";
+			default: return "application/octet-stream";
+		}
+	}
+
+	// Reads format and dimensions from the header of an inline image file without decoding it.
+	inline bool probeImage(const unsigned char* data, size_t length, ImageInfo& info) {
+		MINIOSGB_TRACE_SCOPE("image", "probe");
+		const auto be16 = [data](size_t p) { return (unsigned int)((data[p] << 8) | data[p + 1]); };
+		const auto be32 = [data](size_t p) { return ((unsigned int)data[p] << 24) | ((unsigned int)data[p + 1] << 16) | ((unsigned int)data[p + 2] << 8) | data[p + 3]; };
+		info = ImageInfo();
+		if (data == nullptr) {
+			return false;
+		}
+		static const unsigned char pngSignature[8] = { 0x89, 'P', 'N', 'G', 0x0D, 0x0A, 0x1A, 0x0A };
+		if ((length >= 24) && (memcmp(data, pngSignature, 8) == 0) && (memcmp(data + 12, "IHDR", 4) == 0)) {
+			info.format = ImageFormat::Png;
+			info.width = be32(16);
+			info.height = be32(20);
+			return true;
+		}
+		if ((length >= 4) && (data[0] == 0xFF) && (data[1] == 0xD8)) {
+			// walk the segments up to the first start-of-frame marker
+			for (size_t p = 2; p + 4 <= length;) {
+				if (data[p] != 0xFF) {
+					return false;
+				}
+				const auto marker = data[p + 1];
+				if ((marker == 0xFF) || (marker == 0x01) || ((marker >= 0xD0) && (marker <= 0xD7))) {
+					p += (marker == 0xFF) ? 1 : 2;
+					continue;
+				}
+				const auto segmentLength = be16(p + 2);
+				const auto isFrame = (marker >= 0xC0) && (marker <= 0xCF) && (marker != 0xC4) && (marker != 0xC8) && (marker != 0xCC);
+				if (isFrame) {
+					if (p + 9 > length) {
+						return false;
+					}
+					info.format = ImageFormat::Jpeg;
+					info.height = be16(p + 5);
+					info.width = be16(p + 7);
+					return true;
+				}
+				p += 2 + segmentLength;
+			}
+		}
+		return false;
+	}
+
+	inline bool probeImage(const Image& image, ImageInfo& info) {
+		return probeImage(image.data, image.dataLength, info);
+	}
+
+	// 8-bit RGBA pixels, top row first.
+	struct DecodedImage {
+		unsigned int width = 0;
+		unsigned int height = 0;
+		std::vector<unsigned char> rgba;
+	};
+
+	// MiniOSGB does not decode JPEG/PNG itself; consumers that need pixels plug in their codec of choice.
+	typedef std::function<bool(const Image& image, DecodedImage& decoded)> ImageDecoder;
+
+#ifdef STBI_INCLUDE_STB_IMAGE_H
+	// Decoder backed by stb_image, available when stb_image.h is included before this header.
+	inline bool decodeImageStb(const Image& image, DecodedImage& decoded) {
+		MINIOSGB_TRACE_SCOPE("image", "decode");
+		int width = 0, height = 0, channels = 0;
+		const auto pixels = stbi_load_from_memory(image.data, (int)image.dataLength, &width, &height, &channels, 4);
+		if (pixels == nullptr) {
+			return false;
+		}
+		decoded.width = (unsigned int)width;
+		decoded.height = (unsigned int)height;
+		decoded.rgba.assign(pixels, pixels + size_t(width) * height * 4);
+		stbi_image_free(pixels);
+		return true;
+	}
+#endif
+};
@@ -0,0 +1,257 @@
+#pragma once
+#include "miniosgb.h"
+#include <cstdio>
+#include <filesystem>
+#include <algorithm>
+#include <cerrno>
+#include <charconv>
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+namespace miniosgb
+{
+	namespace details {
+		// Shortest round-trip formatting (std::to_chars), much faster than printf for text exports.
+		inline void appendNumber(std::string& out, double value) {
+			char text[32];
+			const auto result = std::to_chars(text, text + sizeof(text), value);
+			out.append(text, result.ptr);
+		}
+
+		inline void appendNumber(std::string& out, float value) {
+			char text[24];
+			const auto result = std::to_chars(text, text + sizeof(text), value);
+			out.append(text, result.ptr);
+		}
+
+		inline void appendNumber(std::string& out, size_t value) {
+			char text[24];
+			const auto result = std::to_chars(text, text + sizeof(text), value);
+			out.append(text, result.ptr);
+		}
+
+		inline FILE* openFile(const char* filename, const char* mode) {
+			FILE* file = nullptr;
+#ifdef _MSC_VER
+			fopen_s(&file, filename, mode);
+#else
+			file = fopen(filename, mode);
+#endif
+			return file;
+		}
+	}
+
+	// Reads a whole file into `buffer`, reusing its capacity so a worker can load many tiles without reallocating.
+	inline bool readFile(const char* filename, std::vector<unsigned char>& buffer, std::string* error = nullptr) {
+		MINIOSGB_TRACE_SCOPE("io", "readFile");
+		FILE* file = details::openFile(filename, "rb");
+		if (file == nullptr) {
+			if (error) {
+				*error = std::string("can't open file: ") + filename;
+			}
+			return false;
+		}
+		std::error_code ec;
+		const auto fileLen = std::filesystem::file_size(filename, ec);
+		bool ok = !ec;
+		if (ok) {
+			buffer.resize((size_t)fileLen);
+			ok = (fread(buffer.data(), 1, buffer.size(), file) == buffer.size());
+		}
+		fclose(file);
+		if (!ok && error) {
+			*error = std::string("can't read file: ") + filename;
+		}
+		return ok;
+	}
+
+	// Reads and parses a tile. The returned Data references `buffer`, which must outlive it.
+	inline std::unique_ptr<Data> loadFile(const char* filename, std::vector<unsigned char>& buffer, std::string* error = nullptr) {
+		if (!readFile(filename, buffer, error)) {
+			return nullptr;
+		}
+		std::string readError;
+		auto data = Data::read(buffer.data(), buffer.size(), &readError);
+		if (!data && error) {
+			*error = std::string(filename) + ": " + (readError.empty() ? "no root object" : readError);
+		}
+		return data;
+	}
+
+	// Read-only memory mapping of a whole file. Pages are loaded on first access and shared with the page cache,
+	// so Data::read() on data() parses a tile without copying it.
+	class MappedFile {
+	public:
+		MappedFile() = default;
+		MappedFile(const MappedFile&) = delete;
+		MappedFile& operator=(const MappedFile&) = delete;
+		~MappedFile() { close(); }
+
+		bool open(const char* filename, std::string* error = nullptr) {
+			MINIOSGB_TRACE_SCOPE("io", "map");
+			close();
+			bool ok = false;
+#ifdef _WIN32
+			const auto file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+			LARGE_INTEGER size;
+			if ((file != INVALID_HANDLE_VALUE) && GetFileSizeEx(file, &size)) {
+				_size = (size_t)size.QuadPart;
+				ok = true;
+				if (_size > 0) {
+					const auto mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+					_data = mapping ? (const unsigned char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+					ok = (_data != nullptr);
+					if (mapping) {
+						CloseHandle(mapping); // the view keeps the mapping alive
+					}
+				}
+			}
+			if (file != INVALID_HANDLE_VALUE) {
+				CloseHandle(file);
+			}
+#else
+			const int fd = ::open(filename, O_RDONLY | O_CLOEXEC);
+			struct stat st;
+			if ((fd >= 0) && (fstat(fd, &st) == 0)) {
+				_size = (size_t)st.st_size;
+				ok = true;
+				if (_size > 0) {
+					const auto data = mmap(nullptr, _size, PROT_READ, MAP_PRIVATE, fd, 0);
+					_data = (data != MAP_FAILED) ? (const unsigned char*)data : nullptr;
+					ok = (_data != nullptr);
+				}
+			}
+			if (fd >= 0) {
+				::close(fd); // the mapping stays valid
+			}
+#endif
+			if (!ok) {
+				_data = nullptr;
+				_size = 0;
+				if (error) {
+					*error = std::string("can't map file: ") + filename;
+				}
+			}
+			return ok;
+		}
+
+		void close() {
+			if (_data) {
+#ifdef _WIN32
+				UnmapViewOfFile(_data);
+#else
+				munmap((void*)_data, _size);
+#endif
+			}
+			_data = nullptr;
+			_size = 0;
+		}
+
+		const unsigned char* data() const { return _data; }
+		size_t size() const { return _size; }
+
+	private:
+		const unsigned char* _data = nullptr;
+		size_t _size = 0;
+	};
+
+	// A piece of output referenced in place, for gathered (vectored) writes.
+	struct IoSlice {
+		const void* data;
+		size_t size;
+	};
+
+	inline size_t totalSize(const std::vector<IoSlice>& slices) {
+		size_t size = 0;
+		for (const auto& slice : slices) {
+			size += slice.size;
+		}
+		return size;
+	}
+
+	// Writes all slices to a new file, with writev() where available so the pieces are never copied into one buffer.
+	inline bool writeFile(const char* filename, const std::vector<IoSlice>& slices, std::string* error = nullptr) {
+		MINIOSGB_TRACE_SCOPE("io", "writeFile");
+		bool ok = true;
+#ifdef _WIN32
+		FILE* file = details::openFile(filename, "wb");
+		if (file == nullptr) {
+			if (error) {
+				*error = std::string("can't open file: ") + filename;
+			}
+			return false;
+		}
+		for (const auto& slice : slices) {
+			if (ok && (slice.size > 0)) {
+				ok = (fwrite(slice.data, 1, slice.size, file) == slice.size);
+			}
+		}
+		ok = (fclose(file) == 0) && ok;
+#else
+		const int fd = ::open(filename, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+		if (fd < 0) {
+			if (error) {
+				*error = std::string("can't open file: ") + filename;
+			}
+			return false;
+		}
+		std::vector<iovec> iov;
+		iov.reserve(slices.size());
+		for (const auto& slice : slices) {
+			if (slice.size > 0) {
+				iov.push_back({ const_cast<void*>(slice.data), slice.size });
+			}
+		}
+		for (size_t first = 0; ok && (first < iov.size());) {
+			const auto count = (int)std::min<size_t>(iov.size() - first, 1024); // IOV_MAX
+			const auto written = ::writev(fd, &iov[first], count);
+			if (written < 0) {
+				ok = (errno == EINTR);
+				continue;
+			}
+			// skip fully written slices and trim a partially written one
+			for (auto remaining = (size_t)written; remaining > 0;) {
+				if (remaining >= iov[first].iov_len) {
+					remaining -= iov[first].iov_len;
+					++first;
+				} else {
+					iov[first].iov_base = (char*)iov[first].iov_base + remaining;
+					iov[first].iov_len -= remaining;
+					remaining = 0;
+				}
+			}
+		}
+		ok = (::close(fd) == 0) && ok;
+#endif
+		if (!ok && error) {
+			*error = std::string("can't write file: ") + filename;
+		}
+		return ok;
+	}
+
+	// Recursively lists files with the given extension under `dir`, sorted so results are reproducible.
+	inline std::vector<std::string> findFiles(const std::string& dir, const std::string& extension = ".osgb") {
+		std::vector<std::string> files;
+		std::error_code ec;
+		for (std::filesystem::recursive_directory_iterator it(dir, ec), end; !ec && (it != end); it.increment(ec)) {
+			if (it->is_regular_file(ec) && (it->path().extension() == extension)) {
+				files.push_back(it->path().string());
+			}
+		}
+		std::sort(files.begin(), files.end());
+		return files;
+	}
+};
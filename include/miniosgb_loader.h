@@ -0,0 +1,471 @@
+#pragma once
+#include "miniosgb_io.h"
+#include "miniosgb_parallel.h"
+#include <exception>
+#include <functional>
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#define MINIOSGB_IO_URING 1
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#endif
+
+namespace miniosgb
+{
+	struct LoadOptions {
+		unsigned int threads = 0; // workers handed the loaded files, 0: one per core; also the readers without io_uring
+		unsigned int queueDepth = 256; // files read at once with io_uring, each into its own buffer
+		size_t bufferSize = 256 * 1024; // registered buffer per file; larger files are read into a heap buffer
+		bool useIoUring = true; // false: always the blocking reader pool
+	};
+
+	// A file handed to the callback of loadFiles(). `data` is valid during the callback only: the buffer is reused.
+	struct LoadedFile {
+		size_t index = 0; // in the file list
+		const unsigned char* data = nullptr;
+		size_t size = 0;
+		std::string error; // empty when the file was read
+	};
+
+#ifdef MINIOSGB_IO_URING
+	namespace details {
+		// Just enough of an io_uring for loadFiles(), on raw system calls so there is nothing to link.
+		class IoUring {
+		public:
+			IoUring() = default;
+			IoUring(const IoUring&) = delete;
+			IoUring& operator=(const IoUring&) = delete;
+			~IoUring() { close(); }
+
+			bool open(unsigned int entries) {
+				io_uring_params params;
+				memset(&params, 0, sizeof(params));
+				_fd = (int)syscall(__NR_io_uring_setup, entries, &params);
+				if (_fd < 0) {
+					return false;
+				}
+				_sqSize = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+				_cqSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+				if (params.features & IORING_FEAT_SINGLE_MMAP) {
+					_sqSize = _cqSize = std::max(_sqSize, _cqSize);
+				}
+				_sq = mmap(nullptr, _sqSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _fd, IORING_OFF_SQ_RING);
+				_cq = (params.features & IORING_FEAT_SINGLE_MMAP) ? _sq
+					: mmap(nullptr, _cqSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _fd, IORING_OFF_CQ_RING);
+				_sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+				const auto sqes = mmap(nullptr, _sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _fd, IORING_OFF_SQES);
+				if ((_sq == MAP_FAILED) || (_cq == MAP_FAILED) || (sqes == MAP_FAILED)) {
+					_sq = (_sq == MAP_FAILED) ? nullptr : _sq;
+					_cq = (_cq == MAP_FAILED) ? nullptr : _cq;
+					if (sqes != MAP_FAILED) {
+						munmap(sqes, _sqesSize);
+					}
+					close();
+					return false;
+				}
+				_sqes = (io_uring_sqe*)sqes;
+				const auto sq = (unsigned char*)_sq;
+				const auto cq = (unsigned char*)_cq;
+				_sqHead = (unsigned int*)(sq + params.sq_off.head);
+				_sqTail = (unsigned int*)(sq + params.sq_off.tail);
+				_sqMask = *(unsigned int*)(sq + params.sq_off.ring_mask);
+				_sqArray = (unsigned int*)(sq + params.sq_off.array);
+				_sqEntries = params.sq_entries;
+				_cqHead = (unsigned int*)(cq + params.cq_off.head);
+				_cqTail = (unsigned int*)(cq + params.cq_off.tail);
+				_cqMask = *(unsigned int*)(cq + params.cq_off.ring_mask);
+				_cqes = (io_uring_cqe*)(cq + params.cq_off.cqes);
+				_tail = *_sqTail;
+				return true;
+			}
+
+			void close() {
+				if (_sqes) {
+					munmap(_sqes, _sqesSize);
+				}
+				if (_cq && (_cq != _sq)) {
+					munmap(_cq, _cqSize);
+				}
+				if (_sq) {
+					munmap(_sq, _sqSize);
+				}
+				if (_fd >= 0) {
+					::close(_fd);
+				}
+				_sqes = nullptr;
+				_sq = _cq = nullptr;
+				_fd = -1;
+			}
+
+			bool supports(std::initializer_list<int> ops) {
+				const size_t size = sizeof(io_uring_probe) + 256 * sizeof(io_uring_probe_op);
+				std::vector<unsigned char> bytes(size);
+				const auto probe = (io_uring_probe*)bytes.data();
+				if (syscall(__NR_io_uring_register, _fd, IORING_REGISTER_PROBE, probe, 256) < 0) {
+					return false;
+				}
+				for (const auto op : ops) {
+					if ((op > probe->last_op) || !(probe->ops[op].flags & IO_URING_OP_SUPPORTED)) {
+						return false;
+					}
+				}
+				return true;
+			}
+
+			// Fails when the buffers can't be pinned, e.g. over RLIMIT_MEMLOCK on older kernels.
+			bool registerBuffers(const std::vector<iovec>& buffers) {
+				return syscall(__NR_io_uring_register, _fd, IORING_REGISTER_BUFFERS, buffers.data(), (unsigned int)buffers.size()) == 0;
+			}
+
+			// Next submission entry, zeroed; submits the queued ones first when the ring is full.
+			io_uring_sqe* next() {
+				if (_tail - __atomic_load_n(_sqHead, __ATOMIC_ACQUIRE) >= _sqEntries) {
+					enter(0);
+				}
+				const auto index = _tail & _sqMask;
+				auto sqe = &_sqes[index];
+				memset(sqe, 0, sizeof(*sqe));
+				_sqArray[index] = index;
+				++_tail;
+				return sqe;
+			}
+
+			// Submits the queued entries and waits until `waitFor` completions are available.
+			bool enter(unsigned int waitFor) {
+				__atomic_store_n(_sqTail, _tail, __ATOMIC_RELEASE);
+				for (;;) {
+					const auto queued = _tail - __atomic_load_n(_sqHead, __ATOMIC_ACQUIRE);
+					if ((queued == 0) && (waitFor == 0)) {
+						return true;
+					}
+					const auto result = syscall(__NR_io_uring_enter, _fd, queued, waitFor, (waitFor > 0) ? IORING_ENTER_GETEVENTS : 0, nullptr, 0);
+					if (result >= 0) {
+						return true;
+					}
+					if ((errno == EBUSY) && (waitFor > 0)) {
+						return true; // completions to reap first
+					}
+					if ((errno != EINTR) && (errno != EAGAIN)) {
+						return false;
+					}
+				}
+			}
+
+			// Calls fn(userData, result) for each available completion.
+			template<typename F> void reap(F&& fn) {
+				auto head = *_cqHead;
+				const auto tail = __atomic_load_n(_cqTail, __ATOMIC_ACQUIRE);
+				for (; head != tail; ++head) {
+					const auto& cqe = _cqes[head & _cqMask];
+					fn(cqe.user_data, cqe.res);
+				}
+				__atomic_store_n(_cqHead, head, __ATOMIC_RELEASE);
+			}
+
+		private:
+			int _fd = -1;
+			void* _sq = nullptr;
+			void* _cq = nullptr;
+			size_t _sqSize = 0;
+			size_t _cqSize = 0;
+			size_t _sqesSize = 0;
+			io_uring_sqe* _sqes = nullptr;
+			unsigned int* _sqHead = nullptr;
+			unsigned int* _sqTail = nullptr;
+			unsigned int* _sqArray = nullptr;
+			unsigned int _sqMask = 0;
+			unsigned int _sqEntries = 0;
+			unsigned int _tail = 0; // of the entries queued so far, published on enter()
+			unsigned int* _cqHead = nullptr;
+			unsigned int* _cqTail = nullptr;
+			unsigned int _cqMask = 0;
+			io_uring_cqe* _cqes = nullptr;
+		};
+
+		// Reads files `queueDepth` at a time through one ring: open and statx go out together, then the read, then
+		// the close, with one system call per batch instead of per file. Read files go to the workers through a
+		// queue, and their buffers come back to the ring once the callback returned.
+		class UringLoader {
+		public:
+			UringLoader(const std::vector<std::string>& files, const LoadOptions& options, const std::function<void(const LoadedFile&, unsigned int)>& fn)
+				: _files(files), _options(options), _fn(fn), _done(options.queueDepth) {}
+
+			bool open() {
+				const auto depth = std::max(_options.queueDepth, 1u);
+				// up to two entries per slot are queued at once, and a close may still be in flight for a reused slot
+				if (!_ring.open(2 * depth) || !_ring.supports({ IORING_OP_OPENAT, IORING_OP_STATX, IORING_OP_READ, IORING_OP_READ_FIXED, IORING_OP_CLOSE })) {
+					return false;
+				}
+				_slots.resize(depth);
+				_buffers.reset(new unsigned char[depth * _options.bufferSize]);
+				std::vector<iovec> iov(depth);
+				for (unsigned int i = 0; i < depth; ++i) {
+					iov[i] = { _buffers.get() + i * _options.bufferSize, _options.bufferSize };
+				}
+				_fixed = (_options.bufferSize > 0) && _ring.registerBuffers(iov);
+				return true;
+			}
+
+			void run() {
+				const auto threads = defaultThreadCount(_options.threads);
+				std::vector<std::thread> workers;
+				for (unsigned int t = 0; t < threads; ++t) {
+					workers.emplace_back([this, t] { work(t); });
+				}
+				std::vector<unsigned int> idle;
+				for (unsigned int i = (unsigned int)_slots.size(); i-- > 0;) {
+					idle.push_back(i);
+				}
+				size_t next = 0, delivered = 0;
+				unsigned int busy = 0; // slots reading
+				bool failed = false;
+				while ((delivered < _files.size()) && !_stop) {
+					{
+						std::unique_lock<std::mutex> lock(_mutex);
+						if ((busy == 0) && (idle.empty() || (next == _files.size()))) {
+							_returned.wait(lock, [this] { return !_free.empty() || _stop; });
+						}
+						idle.insert(idle.end(), _free.begin(), _free.end());
+						_free.clear();
+					}
+					for (; !idle.empty() && (next < _files.size()); ++next, ++busy) {
+						start(idle.back(), next);
+						idle.pop_back();
+					}
+					if ((busy > 0) && !waitAndReap(busy, delivered)) {
+						failed = true;
+						break;
+					}
+				}
+				// nothing may still write into the buffers once they are freed
+				while (!failed && ((busy > 0) || (_closing > 0))) {
+					failed = !waitAndReap(busy, delivered);
+				}
+				_done.close();
+				for (auto& worker : workers) {
+					worker.join();
+				}
+				if (_exception) {
+					std::rethrow_exception(_exception);
+				}
+				if (failed) {
+					throw std::runtime_error("io_uring_enter failed");
+				}
+			}
+
+		private:
+			enum Op : unsigned long long { Open, Statx, Read, Close };
+
+			struct Slot {
+				size_t file = 0;
+				int fd = -1;
+				int error = 0; // errno of the first failed operation
+				bool opened = false; // and sized
+				unsigned int pending = 0; // operations in flight
+				struct statx stat;
+				unsigned char* data = nullptr;
+				size_t size = 0;
+				size_t read = 0;
+				std::vector<unsigned char> large; // for files over the buffer size
+			};
+
+			const std::vector<std::string>& _files;
+			const LoadOptions& _options;
+			const std::function<void(const LoadedFile&, unsigned int)>& _fn;
+			IoUring _ring;
+			bool _fixed = false;
+			std::unique_ptr<unsigned char[]> _buffers;
+			std::vector<Slot> _slots;
+			unsigned int _closing = 0;
+			BoundedQueue<unsigned int> _done;
+			std::mutex _mutex;
+			std::condition_variable _returned;
+			std::vector<unsigned int> _free; // slots the workers are done with
+			std::atomic<bool> _stop{ false };
+			std::exception_ptr _exception;
+
+			static unsigned long long userData(unsigned int slot, Op op) { return ((unsigned long long)slot << 2) | op; }
+
+			void start(unsigned int index, size_t file) {
+				auto& slot = _slots[index];
+				slot.file = file;
+				slot.fd = -1;
+				slot.error = 0;
+				slot.opened = false;
+				slot.read = 0;
+				slot.pending = 2;
+				auto sqe = _ring.next();
+				sqe->opcode = IORING_OP_OPENAT;
+				sqe->fd = AT_FDCWD;
+				sqe->addr = (unsigned long long)_files[file].c_str();
+				sqe->open_flags = O_RDONLY | O_CLOEXEC;
+				sqe->user_data = userData(index, Open);
+				sqe = _ring.next();
+				sqe->opcode = IORING_OP_STATX;
+				sqe->fd = AT_FDCWD;
+				sqe->addr = (unsigned long long)_files[file].c_str();
+				sqe->len = STATX_SIZE;
+				sqe->off = (unsigned long long)&slot.stat;
+				sqe->user_data = userData(index, Statx);
+			}
+
+			void read(unsigned int index) {
+				auto& slot = _slots[index];
+				const bool fixed = _fixed && (slot.data == _buffers.get() + index * _options.bufferSize);
+				auto sqe = _ring.next();
+				sqe->opcode = fixed ? IORING_OP_READ_FIXED : IORING_OP_READ;
+				sqe->fd = slot.fd;
+				sqe->addr = (unsigned long long)(slot.data + slot.read);
+				sqe->len = (unsigned int)std::min<size_t>(slot.size - slot.read, 1u << 30);
+				sqe->off = slot.read;
+				sqe->buf_index = fixed ? (unsigned short)index : 0;
+				sqe->user_data = userData(index, Read);
+				slot.pending = 1;
+			}
+
+			// The file of the slot is read, or failed: close it and hand it to a worker.
+			void finish(unsigned int index, unsigned int& busy, size_t& delivered) {
+				auto& slot = _slots[index];
+				if (slot.fd >= 0) {
+					auto sqe = _ring.next();
+					sqe->opcode = IORING_OP_CLOSE;
+					sqe->fd = slot.fd;
+					sqe->user_data = userData(index, Close);
+					++_closing;
+					slot.fd = -1;
+				}
+				--busy;
+				++delivered;
+				_done.push(index);
+			}
+
+			bool waitAndReap(unsigned int& busy, size_t& delivered) {
+				if (!_ring.enter(1)) {
+					return false;
+				}
+				_ring.reap([&](unsigned long long data, int result) {
+					const auto index = (unsigned int)(data >> 2);
+					auto& slot = _slots[index];
+					switch ((Op)(data & 3)) {
+					case Close:
+						--_closing;
+						return;
+					case Open:
+						if (result >= 0) {
+							slot.fd = result;
+						}
+						break;
+					case Statx:
+						break;
+					case Read:
+						if (result > 0) {
+							slot.read += (size_t)result;
+						}
+						break;
+					}
+					if ((result < 0) && (slot.error == 0)) {
+						slot.error = -result;
+					}
+					if (--slot.pending > 0) {
+						return;
+					}
+					if ((Op)(data & 3) != Read) {
+						// opened and sized: read into the slot's buffer, or a heap buffer for large files
+						slot.opened = (slot.error == 0);
+						slot.size = (size_t)slot.stat.stx_size;
+						if ((slot.error == 0) && (slot.size > _options.bufferSize)) {
+							slot.large.resize(slot.size);
+							slot.data = slot.large.data();
+						} else {
+							slot.data = _buffers.get() + index * _options.bufferSize;
+						}
+						if ((slot.error == 0) && (slot.size > 0)) {
+							read(index);
+							return;
+						}
+					} else if ((slot.error == 0) && (result > 0) && (slot.read < slot.size)) {
+						read(index); // short read
+						return;
+					} else if ((slot.error == 0) && (slot.read < slot.size)) {
+						slot.error = EIO; // the file shrank
+					}
+					finish(index, busy, delivered);
+				});
+				return true;
+			}
+
+			void work(unsigned int worker) {
+				LoadedFile loaded;
+				for (unsigned int index; _done.pop(index);) {
+					auto& slot = _slots[index];
+					if (!_stop) {
+						loaded.index = slot.file;
+						loaded.error.clear();
+						loaded.data = slot.data;
+						loaded.size = slot.size;
+						if (slot.error != 0) {
+							loaded.data = nullptr;
+							loaded.size = 0;
+							loaded.error = std::string(slot.opened ? "can't read file: " : "can't open file: ") + _files[slot.file];
+						}
+						try {
+							_fn(loaded, worker);
+						} catch (...) {
+							std::lock_guard<std::mutex> lock(_mutex);
+							if (!_exception) {
+								_exception = std::current_exception();
+							}
+							_stop = true;
+						}
+					}
+					std::vector<unsigned char>().swap(slot.large);
+					std::lock_guard<std::mutex> lock(_mutex);
+					_free.push_back(index);
+					_returned.notify_one();
+				}
+			}
+		};
+	}
+#endif
+
+	// Whether loadFiles() can use io_uring here: Linux 5.6 or later, and not disabled by the system.
+	inline bool ioUringAvailable() {
+#ifdef MINIOSGB_IO_URING
+		details::IoUring ring;
+		return ring.open(2) && ring.supports({ IORING_OP_OPENAT, IORING_OP_STATX, IORING_OP_READ, IORING_OP_READ_FIXED, IORING_OP_CLOSE });
+#else
+		return false;
+#endif
+	}
+
+	// Reads the files and calls fn(const LoadedFile&, worker) for each, in completion order, on LoadOptions::threads
+	// workers, e.g. to Data::read() them. With io_uring, hundreds of reads are in flight at once from one submitting
+	// thread (the caller's); elsewhere, or when it's unavailable, the workers read with blocking calls themselves.
+	// The first exception thrown by fn stops the loading and is rethrown to the caller.
+	template<typename F> void loadFiles(const std::vector<std::string>& files, const LoadOptions& options, F&& fn) {
+		MINIOSGB_TRACE_SCOPE("io", "loadFiles");
+		if (files.empty()) {
+			return;
+		}
+#ifdef MINIOSGB_IO_URING
+		if (options.useIoUring) {
+			const std::function<void(const LoadedFile&, unsigned int)> callback = std::ref(fn);
+			details::UringLoader loader(files, options, callback);
+			if (loader.open()) {
+				loader.run();
+				return;
+			}
+		}
+#endif
+		std::vector<std::vector<unsigned char>> buffers(defaultThreadCount(options.threads));
+		parallelFor(files.size(), (unsigned int)buffers.size(), [&](size_t i, unsigned int worker) {
+			LoadedFile loaded;
+			loaded.index = i;
+			auto& buffer = buffers[worker];
+			if (readFile(files[i].c_str(), buffer, &loaded.error)) {
+				loaded.data = buffer.data();
+				loaded.size = buffer.size();
+			}
+			fn(loaded, worker);
+		});
+	}
+};
@@ -0,0 +1,186 @@
+#pragma once
+#include "miniosgb.h"
+#include <cfloat>
+#include <functional>
+#include <unordered_set>
+
+namespace miniosgb
+{
+	struct Box3d {
+		Vec3d min = { DBL_MAX, DBL_MAX, DBL_MAX };
+		Vec3d max = { -DBL_MAX, -DBL_MAX, -DBL_MAX };
+
+		bool valid() const { return (min.x <= max.x) && (min.y <= max.y) && (min.z <= max.z); }
+		void expand(double x, double y, double z) {
+			if (x < min.x) min.x = x;
+			if (y < min.y) min.y = y;
+			if (z < min.z) min.z = z;
+			if (x > max.x) max.x = x;
+			if (y > max.y) max.y = y;
+			if (z > max.z) max.z = z;
+		}
+		void expand(const Box3d& box) {
+			if (box.valid()) {
+				expand(box.min.x, box.min.y, box.min.z);
+				expand(box.max.x, box.max.y, box.max.z);
+			}
+		}
+	};
+
+	// https://registry.khronos.org/OpenGL-Refpages/gl4/html/glDrawElements.xhtml
+	enum class PrimitiveMode { Points = 0, Lines = 1, LineLoop = 2, LineStrip = 3, Triangles = 4, TriangleStrip = 5, TriangleFan = 6 };
+
+	inline Vec3f vertexAt(const Array& arr, unsigned int index) {
+		Vec3f v;
+		memcpy(&v, arr.elementData + size_t(index) * arr.elementSize, sizeof(Vec3f));
+		return v;
+	}
+
+	inline unsigned int indexAt(const PrimitiveSet& prim, unsigned int i) {
+		unsigned int index;
+		memcpy(&index, prim.indexData + size_t(i) * sizeof(unsigned int), sizeof(unsigned int));
+		return index;
+	}
+
+	// Calls fn(a, b, c) for every non-degenerate triangle of a triangle list/strip/fan primitive set.
+	// Other modes are ignored, and so are triangles referencing vertices beyond `vertexCount`.
+	template<typename F> void forEachTriangle(const PrimitiveSet& prim, unsigned int vertexCount, F&& fn) {
+		if ((prim.indexData == nullptr) || (prim.indexCount < 3)) {
+			return;
+		}
+		const auto emit = [&](unsigned int a, unsigned int b, unsigned int c) {
+			if ((a < vertexCount) && (b < vertexCount) && (c < vertexCount) && (a != b) && (b != c) && (a != c)) {
+				fn(a, b, c);
+			}
+		};
+		switch ((PrimitiveMode)prim.mode) {
+			case PrimitiveMode::Triangles:
+				for (unsigned int i = 0; i + 2 < prim.indexCount; i += 3) {
+					emit(indexAt(prim, i), indexAt(prim, i + 1), indexAt(prim, i + 2));
+				}
+				break;
+			case PrimitiveMode::TriangleStrip:
+				for (unsigned int i = 0; i + 2 < prim.indexCount; ++i) {
+					if (i & 1) {
+						emit(indexAt(prim, i + 1), indexAt(prim, i), indexAt(prim, i + 2));
+					} else {
+						emit(indexAt(prim, i), indexAt(prim, i + 1), indexAt(prim, i + 2));
+					}
+				}
+				break;
+			case PrimitiveMode::TriangleFan: {
+				const auto first = indexAt(prim, 0);
+				for (unsigned int i = 1; i + 1 < prim.indexCount; ++i) {
+					emit(first, indexAt(prim, i), indexAt(prim, i + 1));
+				}
+				break;
+			}
+			default:
+				break;
+		}
+	}
+
+	// Vertex positions of a geometry, or nullptr when it has none we can read as Vec3f.
+	inline const Array* positionsOf(const Geometry& geometry) {
+		const auto& vertices = geometry.vertexData;
+		if (vertices && (vertices->arrayType == Array::ArrayType::Vec3f) && vertices->elementData && (vertices->elementCount > 0)) {
+			return vertices.get();
+		}
+		return nullptr;
+	}
+
+	template<typename F> void forEachTriangle(const Geometry& geometry, F&& fn) {
+		const auto vertices = positionsOf(geometry);
+		if (vertices == nullptr) {
+			return;
+		}
+		for (const auto& prim : geometry.primitives) {
+			if (prim) {
+				forEachTriangle(*prim, vertices->elementCount, fn);
+			}
+		}
+	}
+
+	inline Texture2D* textureOf(const Drawable& drawable, unsigned int unit = 0) {
+		if (drawable.stateSet && (unit < drawable.stateSet->textureAttributesList.size())) {
+			for (const auto& attribute : drawable.stateSet->textureAttributesList[unit]) {
+				if (const auto texture = objectCast<Texture2D>(attribute.first.get())) {
+					return texture;
+				}
+			}
+		}
+		return nullptr;
+	}
+
+	inline Material* materialOf(const Drawable& drawable) {
+		if (drawable.stateSet) {
+			for (const auto& attribute : drawable.stateSet->attributes) {
+				if (const auto material = objectCast<Material>(attribute.first.get())) {
+					return material;
+				}
+			}
+		}
+		return nullptr;
+	}
+
+	// Texture coordinates of a unit, or nullptr unless they are Vec2f with one entry per vertex.
+	inline const Array* texCoordsOf(const Geometry& geometry, unsigned int unit = 0) {
+		const auto vertices = positionsOf(geometry);
+		if (vertices && (unit < geometry.texCoordDataList.size())) {
+			const auto& texCoords = geometry.texCoordDataList[unit];
+			if (texCoords && (texCoords->arrayType == Array::ArrayType::Vec2f) && texCoords->elementData
+				&& (texCoords->elementCount >= vertices->elementCount)) {
+				return texCoords.get();
+			}
+		}
+		return nullptr;
+	}
+
+	inline Vec2f texCoordAt(const Array& arr, unsigned int index) {
+		Vec2f v;
+		memcpy(&v, arr.elementData + size_t(index) * arr.elementSize, sizeof(Vec2f));
+		return v;
+	}
+
+	inline Box3d boundsOf(const Geometry& geometry) {
+		Box3d box;
+		if (const auto vertices = positionsOf(geometry)) {
+			for (unsigned int i = 0; i < vertices->elementCount; ++i) {
+				const auto v = vertexAt(*vertices, i);
+				box.expand(v.x, v.y, v.z);
+			}
+		}
+		return box;
+	}
+
+	// Visits each geometry reachable from `root` once.
+	// `finest` is false for geometries that a PagedLOD replaces by an external file at closer range, i.e.
+	// the coarse representation of a tile; geometries of leaf tiles are reported with `finest` = true.
+	inline void forEachGeometry(Object* root, const std::function<void(Geometry& geometry, bool finest)>& fn) {
+		std::unordered_set<Object*> visited;
+		const std::function<void(Object*, bool)> visit = [&](Object* obj, bool finest) {
+			if ((obj == nullptr) || !visited.insert(obj).second) {
+				return;
+			}
+			if (const auto geometry = objectCast<Geometry>(obj)) {
+				fn(*geometry, finest);
+			} else if (const auto geode = objectCast<Geode>(obj)) {
+				for (const auto& drawable : geode->drawables) {
+					visit(drawable.get(), finest);
+				}
+			} else if (const auto group = objectCast<Group>(obj)) {
+				if (const auto plod = objectCast<PagedLOD>(obj)) {
+					for (const auto& rangeData : plod->rangeDataList) {
+						if (!rangeData.filename.empty()) {
+							finest = false;
+						}
+					}
+				}
+				for (const auto& child : group->children) {
+					visit(child.get(), finest);
+				}
+			}
+		};
+		visit(root, true);
+	}
+};
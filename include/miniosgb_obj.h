@@ -0,0 +1,335 @@
+#pragma once
+#include "miniosgb_io.h"
+#include "miniosgb_mesh.h"
+#include "miniosgb_image.h"
+#include "miniosgb_parallel.h"
+#include <cstdint>
+#include <map>
+
+namespace miniosgb
+{
+	struct ObjOptions {
+		Vec3d offset; // added to vertices, e.g. the SRSOrigin of a ContextCapture dataset
+		Box3d region; // dataset export: keep geometries whose XY bounds (after offset) overlap it; invalid = everything
+		bool finestOnly = false; // single tile export: skip geometries a PagedLOD replaces by a finer file
+		bool normals = true;
+		unsigned int threads = 0; // 0: hardware concurrency
+	};
+
+	namespace details {
+		class ObjWriter {
+		public:
+			explicit ObjWriter(const ObjOptions& options) : _options(options) {}
+
+			~ObjWriter() {
+				if (_file) {
+					fclose(_file);
+				}
+			}
+
+			bool open(const char* filename, std::string* error) {
+				const auto path = std::filesystem::path(filename);
+				_directory = path.parent_path();
+				_stem = path.stem().string();
+				_mtlFilename = (_directory / (_stem + ".mtl")).string();
+				_file = openFile(filename, "wb");
+				if (_file == nullptr) {
+					if (error) {
+						*error = std::string("can't open file: ") + filename;
+					}
+					return false;
+				}
+				_filename = filename;
+				const auto header = "mtllib " + _stem + ".mtl\n";
+				return put(header, error);
+			}
+
+			// Formats the selected geometries of a batch of tiles in parallel and appends them in order.
+			bool addTiles(const std::vector<const Data*>& tiles, bool finestOnly, std::string* error) {
+				std::vector<Chunk> chunks;
+				std::map<std::pair<const Material*, const Texture2D*>, size_t> materials;
+				std::unordered_map<const Image*, std::string> images;
+				for (const auto data : tiles) {
+					forEachGeometry(data->rootObject.get(), [&](Geometry& geometry, bool finest) {
+						const auto vertices = positionsOf(geometry);
+						if ((vertices == nullptr) || (finestOnly && !finest) || !inRegion(geometry)) {
+							return;
+						}
+						Chunk chunk;
+						chunk.geometry = &geometry;
+						chunk.texCoords = texCoordsOf(geometry);
+						chunk.normals = normalsOf(geometry);
+						chunk.vertexBase = _vertexCount;
+						chunk.texCoordBase = _texCoordCount;
+						chunk.normalBase = _normalCount;
+						_vertexCount += vertices->elementCount;
+						_texCoordCount += chunk.texCoords ? vertices->elementCount : 0;
+						_normalCount += chunk.normals ? vertices->elementCount : 0;
+
+						const auto material = materialOf(geometry);
+						const auto texture = textureOf(geometry);
+						if (material || (texture && texture->image && texture->image->data)) {
+							const auto key = std::make_pair(material, (texture && texture->image && texture->image->data) ? texture : nullptr);
+							const auto it = materials.find(key);
+							if (it != materials.end()) {
+								chunk.material = it->second;
+							} else {
+								chunk.material = _materialCount++;
+								materials.emplace(key, chunk.material);
+								addMaterial(chunk.material, key.first, key.second ? imageFile(*key.second->image, images) : std::string());
+							}
+						}
+						chunks.push_back(chunk);
+					});
+				}
+
+				parallelFor(chunks.size(), _options.threads, [&](size_t i, unsigned int) {
+					MINIOSGB_TRACE_SCOPE("convert", "obj chunk");
+					format(chunks[i]);
+				});
+				for (const auto& chunk : chunks) {
+					if (!put(chunk.text, error)) {
+						return false;
+					}
+				}
+
+				// inline image files are written as they are, without decoding
+				std::vector<std::pair<const Image*, std::string>> imageList(images.begin(), images.end());
+				std::vector<std::string> imageErrors(imageList.size());
+				parallelFor(imageList.size(), _options.threads, [&](size_t i, unsigned int) {
+					const auto& image = *imageList[i].first;
+					writeFile((_directory / imageList[i].second).string().c_str(), { { image.data, image.dataLength } }, &imageErrors[i]);
+				});
+				for (const auto& imageError : imageErrors) {
+					if (!imageError.empty()) {
+						if (error) {
+							*error = imageError;
+						}
+						return false;
+					}
+				}
+				return true;
+			}
+
+			bool close(std::string* error) {
+				const auto ok = (fclose(_file) == 0);
+				_file = nullptr;
+				if (!ok) {
+					if (error) {
+						*error = "can't write file: " + _filename;
+					}
+					return false;
+				}
+				return writeFile(_mtlFilename.c_str(), { { _mtl.data(), _mtl.size() } }, error);
+			}
+
+		private:
+			struct Chunk {
+				const Geometry* geometry = nullptr;
+				const Array* texCoords = nullptr;
+				const Array* normals = nullptr;
+				size_t vertexBase = 0;
+				size_t texCoordBase = 0;
+				size_t normalBase = 0;
+				size_t material = SIZE_MAX;
+				std::string text;
+			};
+
+			const ObjOptions& _options;
+			FILE* _file = nullptr;
+			std::string _filename;
+			std::string _mtlFilename;
+			std::filesystem::path _directory;
+			std::string _stem;
+			std::string _mtl;
+			size_t _vertexCount = 0;
+			size_t _texCoordCount = 0;
+			size_t _normalCount = 0;
+			size_t _materialCount = 0;
+			size_t _imageCount = 0;
+
+			bool put(const std::string& text, std::string* error) {
+				if (!text.empty() && (fwrite(text.data(), 1, text.size(), _file) != text.size())) {
+					if (error) {
+						*error = "can't write file: " + _filename;
+					}
+					return false;
+				}
+				return true;
+			}
+
+			bool inRegion(const Geometry& geometry) const {
+				const auto& region = _options.region;
+				if (!region.valid()) {
+					return true;
+				}
+				const auto box = boundsOf(geometry);
+				return (box.min.x + _options.offset.x <= region.max.x) && (box.max.x + _options.offset.x >= region.min.x)
+					&& (box.min.y + _options.offset.y <= region.max.y) && (box.max.y + _options.offset.y >= region.min.y);
+			}
+
+			const Array* normalsOf(const Geometry& geometry) const {
+				const auto& normals = geometry.normalData;
+				const auto vertices = positionsOf(geometry);
+				if (_options.normals && normals && (normals->arrayType == Array::ArrayType::Vec3f) && normals->elementData
+					&& (normals->binding == Array::Binding::PerVertex) && (normals->elementCount >= vertices->elementCount)) {
+					return normals.get();
+				}
+				return nullptr;
+			}
+
+			std::string imageFile(const Image& image, std::unordered_map<const Image*, std::string>& images) {
+				const auto it = images.find(&image);
+				if (it != images.end()) {
+					return it->second;
+				}
+				ImageInfo info;
+				probeImage(image, info);
+				const char* extension = (info.format == ImageFormat::Jpeg) ? ".jpg" : ((info.format == ImageFormat::Png) ? ".png" : ".bin");
+				auto name = _stem + "_" + std::to_string(_imageCount++) + extension;
+				images.emplace(&image, name);
+				return name;
+			}
+
+			void addMaterial(size_t index, const Material* material, const std::string& image) {
+				const auto diffuse = material ? material->diffuse.front : Vec4f{ 1, 1, 1, 1 };
+				_mtl += "newmtl m";
+				appendNumber(_mtl, index);
+				_mtl += "\nKd ";
+				appendNumber(_mtl, diffuse.x);
+				_mtl += ' ';
+				appendNumber(_mtl, diffuse.y);
+				_mtl += ' ';
+				appendNumber(_mtl, diffuse.z);
+				_mtl += '\n';
+				if (diffuse.w < 1) {
+					_mtl += "d ";
+					appendNumber(_mtl, diffuse.w);
+					_mtl += '\n';
+				}
+				if (!image.empty()) {
+					_mtl += "map_Kd " + image + '\n';
+				}
+				_mtl += '\n';
+			}
+
+			void format(Chunk& chunk) const {
+				const auto& geometry = *chunk.geometry;
+				const auto& vertices = *positionsOf(geometry);
+				const auto count = vertices.elementCount;
+				auto& out = chunk.text;
+				out.reserve(size_t(count) * (chunk.texCoords ? 64 : 40));
+				const bool shifted = (_options.offset.x != 0) || (_options.offset.y != 0) || (_options.offset.z != 0);
+				for (unsigned int i = 0; i < count; ++i) {
+					const auto v = vertexAt(vertices, i);
+					out += "v ";
+					if (shifted) {
+						// doubles keep the precision of large georeferenced coordinates
+						appendNumber(out, v.x + _options.offset.x);
+						out += ' ';
+						appendNumber(out, v.y + _options.offset.y);
+						out += ' ';
+						appendNumber(out, v.z + _options.offset.z);
+					} else {
+						appendNumber(out, v.x);
+						out += ' ';
+						appendNumber(out, v.y);
+						out += ' ';
+						appendNumber(out, v.z);
+					}
+					out += '\n';
+				}
+				if (chunk.texCoords) {
+					for (unsigned int i = 0; i < count; ++i) {
+						const auto t = texCoordAt(*chunk.texCoords, i);
+						out += "vt ";
+						appendNumber(out, t.x);
+						out += ' ';
+						appendNumber(out, t.y);
+						out += '\n';
+					}
+				}
+				if (chunk.normals) {
+					for (unsigned int i = 0; i < count; ++i) {
+						const auto n = vertexAt(*chunk.normals, i);
+						out += "vn ";
+						appendNumber(out, n.x);
+						out += ' ';
+						appendNumber(out, n.y);
+						out += ' ';
+						appendNumber(out, n.z);
+						out += '\n';
+					}
+				}
+				if (chunk.material != SIZE_MAX) {
+					out += "usemtl m";
+					appendNumber(out, chunk.material);
+					out += '\n';
+				}
+				// OBJ indices are 1-based and global to the file
+				const auto corner = [&](unsigned int index) {
+					out += ' ';
+					appendNumber(out, chunk.vertexBase + index + 1);
+					if (chunk.texCoords || chunk.normals) {
+						out += '/';
+						if (chunk.texCoords) {
+							appendNumber(out, chunk.texCoordBase + index + 1);
+						}
+						if (chunk.normals) {
+							out += '/';
+							appendNumber(out, chunk.normalBase + index + 1);
+						}
+					}
+				};
+				forEachTriangle(geometry, [&](unsigned int a, unsigned int b, unsigned int c) {
+					out += 'f';
+					corner(a);
+					corner(b);
+					corner(c);
+					out += '\n';
+				});
+			}
+		};
+	}
+
+	// Writes all geometries of a parsed tile as `filename` (.obj), a .mtl next to it and the tile's texture images,
+	// copied as they are from the inline image files. Geometries are formatted in parallel.
+	inline bool writeObj(const Data& data, const char* filename, const ObjOptions& options = {}, std::string* error = nullptr) {
+		details::ObjWriter writer(options);
+		return writer.open(filename, error) && writer.addTiles({ &data }, options.finestOnly, error) && writer.close(error);
+	}
+
+	// Writes the finest-level geometries of `files` that overlap `options.region` into one OBJ/MTL.
+	// Tiles are loaded and formatted in batches, so memory stays bounded by a few tiles per thread.
+	inline bool writeObj(const std::vector<std::string>& files, const char* filename, const ObjOptions& options = {}, std::string* error = nullptr) {
+		details::ObjWriter writer(options);
+		if (!writer.open(filename, error)) {
+			return false;
+		}
+		const auto batchSize = size_t(defaultThreadCount(options.threads)) * 4;
+		std::vector<std::vector<unsigned char>> buffers(batchSize);
+		std::vector<std::unique_ptr<Data>> tiles(batchSize);
+		std::vector<std::string> errors(batchSize);
+		for (size_t first = 0; first < files.size(); first += batchSize) {
+			const auto count = std::min(batchSize, files.size() - first);
+			parallelFor(count, options.threads, [&](size_t i, unsigned int) {
+				errors[i].clear();
+				tiles[i] = loadFile(files[first + i].c_str(), buffers[i], &errors[i]);
+			});
+			std::vector<const Data*> batch;
+			for (size_t i = 0; i < count; ++i) {
+				if (!tiles[i]) {
+					if (error) {
+						*error = errors[i];
+					}
+					return false;
+				}
+				batch.push_back(tiles[i].get());
+			}
+			if (!writer.addTiles(batch, true, error)) {
+				return false;
+			}
+		}
+		return writer.close(error);
+	}
+};
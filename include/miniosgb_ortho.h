@@ -0,0 +1,169 @@
+#pragma once
+#include "miniosgb_raster.h"
+#include "miniosgb_image.h"
+
+namespace miniosgb
+{
+	// True orthophoto: the color of the highest finest-level surface per cell, seen straight from above.
+	struct OrthoOptions : RasterOptions {
+		unsigned char background[4] = { 0, 0, 0, 0 }; // RGBA of cells no surface covers
+	};
+
+	// Receives the finished mosaic strip by strip, top to bottom, as RGBA rows. Returning false cancels rendering.
+	typedef std::function<bool(unsigned int row, unsigned int rowCount, unsigned int columns, const unsigned char* rgba)> OrthoStripSink;
+
+	namespace details {
+		inline int wrapTexel(int i, int size, Texture::WrapMode mode) {
+			switch (mode) {
+				case Texture::WrapMode::Repeat:
+					i %= size;
+					return (i < 0) ? i + size : i;
+				case Texture::WrapMode::Mirror: {
+					const auto period = 2 * size;
+					i %= period;
+					if (i < 0) {
+						i += period;
+					}
+					return (i < size) ? i : period - 1 - i;
+				}
+				default:
+					return (i < 0) ? 0 : ((i >= size) ? size - 1 : i);
+			}
+		}
+
+		// Bilinear RGBA sample at (u, v) in OpenGL convention: v = 0 is the last row of a top-first decoded image.
+		inline void sampleBilinear(const DecodedImage& image, const Texture& texture, double u, double v, unsigned char* out) {
+			const auto x = u * image.width - 0.5;
+			const auto y = (1.0 - v) * image.height - 0.5;
+			const auto x0 = (int)std::floor(x);
+			const auto y0 = (int)std::floor(y);
+			const auto fx = x - x0;
+			const auto fy = y - y0;
+			const auto w = (int)image.width;
+			const auto h = (int)image.height;
+			const auto xa = wrapTexel(x0, w, texture.wrapS);
+			const auto xb = wrapTexel(x0 + 1, w, texture.wrapS);
+			const auto ya = wrapTexel(y0, h, texture.wrapT);
+			const auto yb = wrapTexel(y0 + 1, h, texture.wrapT);
+			const auto p00 = image.rgba.data() + (size_t(ya) * w + xa) * 4;
+			const auto p10 = image.rgba.data() + (size_t(ya) * w + xb) * 4;
+			const auto p01 = image.rgba.data() + (size_t(yb) * w + xa) * 4;
+			const auto p11 = image.rgba.data() + (size_t(yb) * w + xb) * 4;
+			for (int c = 0; c < 4; ++c) {
+				const auto top = p00[c] + (p10[c] - p00[c]) * fx;
+				const auto bottom = p01[c] + (p11[c] - p01[c]) * fx;
+				out[c] = (unsigned char)(top + (bottom - top) * fy + 0.5);
+			}
+		}
+	}
+
+	// Renders the finest-level surface of `files` top-down into an RGBA mosaic covering the requested extent.
+	// Textures are decoded with `decoder` once per tile and sampled bilinearly with their wrap modes; untextured
+	// geometries use their material's diffuse color. Tiles are rendered into worker-local color and depth windows
+	// and depth-merged into the current strip, so memory stays bounded by the strip plus one tile per thread.
+	inline bool renderOrtho(const std::vector<std::string>& files, const OrthoOptions& options, const ImageDecoder& decoder,
+		const OrthoStripSink& sink, std::string* error = nullptr) {
+		if (!details::validRaster(options, error)) {
+			return false;
+		}
+		const details::RasterGrid grid(options);
+		struct Worker {
+			std::vector<float> depth;
+			std::vector<unsigned char> color;
+			std::unordered_map<const Image*, DecodedImage> images;
+		};
+		std::vector<Worker> workers(defaultThreadCount(options.threads));
+		const auto stripCells = size_t(grid.stripRows) * grid.columns;
+		std::vector<float> stripDepth(stripCells, -FLT_MAX);
+		std::vector<unsigned char> stripColor(stripCells * 4);
+		const auto clearStrip = [&]() {
+			std::fill(stripDepth.begin(), stripDepth.end(), -FLT_MAX);
+			for (size_t i = 0; i < stripCells; ++i) {
+				memcpy(&stripColor[i * 4], options.background, 4);
+			}
+		};
+		clearStrip();
+		unsigned int stripRow0 = 0;
+		std::mutex stripMutex;
+
+		return details::rasterizeStrips(files, options, grid,
+			[&](unsigned int w, Data& data, const details::RasterGrid::Window& window) {
+				auto& worker = workers[w];
+				worker.depth.assign(window.size(), -FLT_MAX);
+				worker.color.assign(window.size() * 4, 0);
+				worker.images.clear();
+
+				Geometry* current = nullptr;
+				const Texture2D* texture = nullptr;
+				const DecodedImage* image = nullptr;
+				const Array* texCoords = nullptr;
+				unsigned char flat[4] = { 255, 255, 255, 255 };
+				details::forEachFinestTriangle(data, options.offset, [&](Geometry& geometry, unsigned int ia, unsigned int ib, unsigned int ic,
+					const Vec3d& a, const Vec3d& b, const Vec3d& c) {
+					if (current != &geometry) {
+						current = &geometry;
+						texture = textureOf(geometry);
+						texCoords = texCoordsOf(geometry);
+						image = nullptr;
+						if (texture && texture->image && texCoords && decoder) {
+							const auto it = worker.images.find(texture->image.get());
+							if (it != worker.images.end()) {
+								image = it->second.rgba.empty() ? nullptr : &it->second;
+							} else {
+								auto& decoded = worker.images[texture->image.get()];
+								MINIOSGB_TRACE_SCOPE("image", "decode");
+								if (decoder(*texture->image, decoded) && (decoded.width > 0) && (decoded.height > 0)
+									&& (decoded.rgba.size() >= size_t(decoded.width) * decoded.height * 4)) {
+									image = &decoded;
+								} else {
+									decoded.rgba.clear();
+								}
+							}
+						}
+						const auto material = materialOf(geometry);
+						const auto diffuse = material ? material->diffuse.front : Vec4f{ 1, 1, 1, 1 };
+						const float rgba[4] = { diffuse.x, diffuse.y, diffuse.z, diffuse.w };
+						for (int i = 0; i < 4; ++i) {
+							flat[i] = (unsigned char)(std::min(1.0f, std::max(0.0f, rgba[i])) * 255 + 0.5f);
+						}
+					}
+					Vec2f ta, tb, tc;
+					if (image) {
+						ta = texCoordAt(*texCoords, ia);
+						tb = texCoordAt(*texCoords, ib);
+						tc = texCoordAt(*texCoords, ic);
+					}
+					grid.scan(a, b, c, window, [&](size_t cell, double w0, double w1, double w2) {
+						const auto z = (float)(w0 * a.z + w1 * b.z + w2 * c.z);
+						if (z <= worker.depth[cell]) {
+							return;
+						}
+						worker.depth[cell] = z;
+						if (image) {
+							details::sampleBilinear(*image, *texture, w0 * ta.x + w1 * tb.x + w2 * tc.x, w0 * ta.y + w1 * tb.y + w2 * tc.y, &worker.color[cell * 4]);
+						} else {
+							memcpy(&worker.color[cell * 4], flat, 4);
+						}
+					});
+				});
+
+				std::lock_guard<std::mutex> lock(stripMutex);
+				for (unsigned int r = 0; r < window.rows; ++r) {
+					const auto src = size_t(r) * window.columns;
+					const auto dst = size_t(window.row0 + r - stripRow0) * grid.columns + window.col0;
+					for (unsigned int col = 0; col < window.columns; ++col) {
+						if (worker.depth[src + col] > stripDepth[dst + col]) {
+							stripDepth[dst + col] = worker.depth[src + col];
+							memcpy(&stripColor[(dst + col) * 4], &worker.color[(src + col) * 4], 4);
+						}
+					}
+				}
+			},
+			[&](unsigned int row0, unsigned int rowCount) {
+				const auto ok = sink(row0, rowCount, grid.columns, stripColor.data());
+				clearStrip();
+				stripRow0 = row0 + rowCount;
+				return ok;
+			}, error);
+	}
+};
@@ -0,0 +1,113 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace miniosgb
+{
+	inline unsigned int defaultThreadCount(unsigned int requested = 0) {
+		if (requested > 0) {
+			return requested;
+		}
+		const auto hardware = std::thread::hardware_concurrency();
+		return (hardware > 0) ? hardware : 1;
+	}
+
+	// Calls fn(index, worker) for every index in [0, count) on up to `threads` workers.
+	// Indices are handed out dynamically so uneven work (e.g. tiles of different size) stays balanced.
+	// The first exception thrown by fn stops the remaining work and is rethrown to the caller.
+	template<typename F> void parallelFor(size_t count, unsigned int threads, F&& fn) {
+		if (count == 0) {
+			return;
+		}
+		threads = defaultThreadCount(threads);
+		if (threads > count) {
+			threads = (unsigned int)count;
+		}
+		if (threads == 1) {
+			for (size_t i = 0; i < count; ++i) {
+				fn(i, 0u);
+			}
+			return;
+		}
+
+		std::atomic<size_t> next(0);
+		std::exception_ptr exception;
+		std::mutex exceptionMutex;
+		const auto work = [&](unsigned int worker) {
+			try {
+				for (size_t i = next++; i < count; i = next++) {
+					fn(i, worker);
+				}
+			} catch (...) {
+				std::lock_guard<std::mutex> lock(exceptionMutex);
+				if (!exception) {
+					exception = std::current_exception();
+				}
+				next = count;
+			}
+		};
+
+		std::vector<std::thread> workers;
+		workers.reserve(threads - 1);
+		for (unsigned int t = 1; t < threads; ++t) {
+			workers.emplace_back(work, t);
+		}
+		work(0);
+		for (auto& worker : workers) {
+			worker.join();
+		}
+		if (exception) {
+			std::rethrow_exception(exception);
+		}
+	}
+
+	// Multi-producer multi-consumer FIFO whose push() blocks while `capacity` items are queued,
+	// which gives pipeline stages backpressure. After close(), pop() drains the rest and then returns false.
+	template<typename T> class BoundedQueue {
+	public:
+		explicit BoundedQueue(size_t capacity) : _capacity(capacity > 0 ? capacity : 1) {}
+
+		bool push(T item) {
+			std::unique_lock<std::mutex> lock(_mutex);
+			_notFull.wait(lock, [this] { return _closed || (_items.size() < _capacity); });
+			if (_closed) {
+				return false;
+			}
+			_items.push_back(std::move(item));
+			_notEmpty.notify_one();
+			return true;
+		}
+
+		bool pop(T& item) {
+			std::unique_lock<std::mutex> lock(_mutex);
+			_notEmpty.wait(lock, [this] { return _closed || !_items.empty(); });
+			if (_items.empty()) {
+				return false;
+			}
+			item = std::move(_items.front());
+			_items.pop_front();
+			_notFull.notify_one();
+			return true;
+		}
+
+		void close() {
+			std::lock_guard<std::mutex> lock(_mutex);
+			_closed = true;
+			_notEmpty.notify_all();
+			_notFull.notify_all();
+		}
+
+	private:
+		const size_t _capacity;
+		std::deque<T> _items;
+		bool _closed = false;
+		std::mutex _mutex;
+		std::condition_variable _notEmpty;
+		std::condition_variable _notFull;
+	};
+};
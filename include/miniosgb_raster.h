@@ -0,0 +1,284 @@
+#pragma once
+#include "miniosgb_io.h"
+#include "miniosgb_mesh.h"
+#include "miniosgb_parallel.h"
+#include <cmath>
+
+namespace miniosgb
+{
+	// Top-down raster covering [minX, maxX] x [minY, maxY] in dataset coordinates.
+	// Row 0 is the northern edge (maxY), columns grow towards maxX; cells are sampled at their centers.
+	struct RasterOptions {
+		double minX = 0;
+		double minY = 0;
+		double maxX = 0;
+		double maxY = 0;
+		double resolution = 1;
+		Vec3d offset; // added to tile vertices, e.g. the SRSOrigin of a ContextCapture dataset
+		unsigned int threads = 0; // 0: hardware concurrency
+		unsigned int stripRows = 1024; // rows kept in memory at once
+	};
+
+	namespace details {
+		struct RasterGrid {
+			double originX = 0; // west edge
+			double originY = 0; // north edge
+			double resolution = 1;
+			unsigned int columns = 0;
+			unsigned int rows = 0;
+
+			unsigned int stripRows = 1;
+
+			explicit RasterGrid(const RasterOptions& options)
+				: originX(options.minX), originY(options.maxY), resolution(options.resolution) {
+				columns = (unsigned int)std::ceil((options.maxX - options.minX) / options.resolution);
+				rows = (unsigned int)std::ceil((options.maxY - options.minY) / options.resolution);
+				stripRows = std::max(1u, std::min(options.stripRows, rows));
+			}
+
+			// Sub-rectangle of the grid a worker renders one tile into.
+			struct Window {
+				unsigned int row0 = 0;
+				unsigned int col0 = 0;
+				unsigned int rows = 0;
+				unsigned int columns = 0;
+				size_t size() const { return size_t(rows) * columns; }
+			};
+
+			// Cells of rows [row0, row0 + rowCount) touched by `box`; empty when they don't overlap.
+			Window windowOf(const Box3d& box, unsigned int row0, unsigned int rowCount) const {
+				Window window;
+				const auto colBegin = std::max(0.0, std::floor((box.min.x - originX) / resolution));
+				const auto colEnd = std::max(0.0, std::min((double)columns, std::ceil((box.max.x - originX) / resolution)));
+				const auto rowBegin = std::max((double)row0, std::floor((originY - box.max.y) / resolution));
+				const auto rowEnd = std::max(0.0, std::min((double)(row0 + rowCount), std::ceil((originY - box.min.y) / resolution)));
+				if ((colBegin < colEnd) && (rowBegin < rowEnd)) {
+					window.row0 = (unsigned int)rowBegin;
+					window.col0 = (unsigned int)colBegin;
+					window.rows = (unsigned int)(rowEnd - rowBegin);
+					window.columns = (unsigned int)(colEnd - colBegin);
+				}
+				return window;
+			}
+
+			// Calls fn(cell, w0, w1, w2) for every cell center of `window` covered by the triangle projected on XY,
+			// where cell indexes the window row by row and w* are the barycentric weights of a, b and c.
+			// The projection is orthographic, so these weights interpolate attributes perspective-correctly.
+			template<typename F> void scan(const Vec3d& a, const Vec3d& b, const Vec3d& c, const Window& window, F&& fn) const {
+				const auto area = (b.x - a.x) * (c.y - a.y) - (b.y - a.y) * (c.x - a.x);
+				if (area == 0) {
+					return;
+				}
+				const auto minX = std::min(a.x, std::min(b.x, c.x));
+				const auto maxX = std::max(a.x, std::max(b.x, c.x));
+				const auto minY = std::min(a.y, std::min(b.y, c.y));
+				const auto maxY = std::max(a.y, std::max(b.y, c.y));
+				// cell centers inside the triangle bounds: originX + (col + 0.5) * resolution in [minX, maxX]
+				const auto colBegin = std::max((double)window.col0, std::ceil((minX - originX) / resolution - 0.5));
+				const auto colEnd = std::min((double)window.col0 + window.columns - 1, std::floor((maxX - originX) / resolution - 0.5));
+				const auto rowBegin = std::max((double)window.row0, std::ceil((originY - maxY) / resolution - 0.5));
+				const auto rowEnd = std::min((double)window.row0 + window.rows - 1, std::floor((originY - minY) / resolution - 0.5));
+				if ((colBegin > colEnd) || (rowBegin > rowEnd)) {
+					return;
+				}
+				const auto invArea = 1.0 / area;
+				for (auto r = (unsigned int)rowBegin; r <= (unsigned int)rowEnd; ++r) {
+					const auto y = originY - (r + 0.5) * resolution;
+					const auto line = size_t(r - window.row0) * window.columns;
+					for (auto col = (unsigned int)colBegin; col <= (unsigned int)colEnd; ++col) {
+						const auto x = originX + (col + 0.5) * resolution;
+						const auto w0 = ((b.x - x) * (c.y - y) - (b.y - y) * (c.x - x)) * invArea;
+						const auto w1 = ((c.x - x) * (a.y - y) - (c.y - y) * (a.x - x)) * invArea;
+						const auto w2 = 1.0 - w0 - w1;
+						if ((w0 >= 0) && (w1 >= 0) && (w2 >= 0)) {
+							fn(line + (col - window.col0), w0, w1, w2);
+						}
+					}
+				}
+			}
+		};
+
+		// Footprint of the finest-level geometry of a tile in dataset coordinates, empty for coarse-only tiles.
+		inline Box3d finestBounds(Data& data, const Vec3d& offset) {
+			Box3d box;
+			forEachGeometry(data.rootObject.get(), [&](Geometry& geometry, bool finest) {
+				if (finest) {
+					box.expand(boundsOf(geometry));
+				}
+			});
+			if (box.valid()) {
+				box.min = { box.min.x + offset.x, box.min.y + offset.y, box.min.z + offset.z };
+				box.max = { box.max.x + offset.x, box.max.y + offset.y, box.max.z + offset.z };
+			}
+			return box;
+		}
+
+		inline bool validRaster(const RasterOptions& options, std::string* error) {
+			if (!(options.resolution > 0) || !(options.maxX > options.minX) || !(options.maxY > options.minY)) {
+				if (error) {
+					*error = "invalid raster extent or resolution";
+				}
+				return false;
+			}
+			return true;
+		}
+
+		// Calls fn(path, box) for each file the PagedLODs of a loaded tile page in, with the path resolved like
+		// `filename`'s and the box of the PagedLOD's bounding sphere in dataset coordinates. Only USER_DEFINED_CENTER
+		// spheres are passed: in the other modes OSG computes the center at run time from the loaded children.
+		template<typename F> void forEachPagedFile(const Data& data, const std::string& filename, const Vec3d& offset, F&& fn) {
+			const auto directory = std::filesystem::path(filename).parent_path();
+			data.objects.forEach([&](Object* obj) {
+				const auto plod = objectCast<PagedLOD>(obj);
+				if ((plod == nullptr) || (plod->centerMode != 1) || !(plod->userDefinedRadius > 0)) {
+					return;
+				}
+				const auto& c = plod->userDefinedCenter;
+				const auto r = plod->userDefinedRadius;
+				Box3d box;
+				box.expand(c.x + offset.x - r, c.y + offset.y - r, c.z + offset.z - r);
+				box.expand(c.x + offset.x + r, c.y + offset.y + r, c.z + offset.z + r);
+				for (const auto& rangeData : plod->rangeDataList) {
+					if (!rangeData.filename.empty()) {
+						fn((directory / rangeData.filename).lexically_normal().generic_string(), box);
+					}
+				}
+			});
+		}
+
+		// Drives a strip-by-strip top-down rasterization of `files`.
+		// For each strip only the tiles overlapping it are loaded, one tile per worker at a time, and handed to
+		// renderTile(worker, data, window). Once all tiles of a strip are done, finishStrip(row0, rowCount) is called;
+		// returning false cancels.
+		// With more than one strip, a tile that was never loaded is bounded by the PagedLOD spheres paging it in, and
+		// once loaded by its finest geometry, so coarse-only tiles are read once and the others once per strip they
+		// reach. Tiles no loaded PagedLOD references are loaded at the first strip, in waves of growing file name
+		// length, so that the usual layouts load parents before the children they bound.
+		template<typename RenderTile, typename FinishStrip>
+		bool rasterizeStrips(const std::vector<std::string>& files, const RasterOptions& options, const RasterGrid& grid,
+			RenderTile&& renderTile, FinishStrip&& finishStrip, std::string* error) {
+			struct Footprint {
+				Box3d bounds; // of the finest geometry once loaded, else of the spheres paging the tile in
+				bool loaded = false;
+				bool bounded = false; // loaded, or referenced by a loaded PagedLOD
+			};
+			const auto threads = defaultThreadCount(options.threads);
+			const auto stripRows = std::max(1u, std::min(options.stripRows, grid.rows));
+			const auto indexed = (stripRows < grid.rows);
+			std::vector<std::vector<unsigned char>> buffers(threads);
+			std::vector<Footprint> footprints(files.size());
+			std::unordered_map<std::string, size_t> indices; // by normalized path
+			std::vector<size_t> order(files.size()); // by file name length
+			std::mutex mutex;
+			if (indexed) {
+				for (size_t i = 0; i < files.size(); ++i) {
+					indices.emplace(std::filesystem::path(files[i]).lexically_normal().generic_string(), i);
+					order[i] = i;
+				}
+				std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return files[a].size() < files[b].size(); });
+			}
+			try {
+				for (unsigned int row0 = 0; row0 < grid.rows; row0 += stripRows) {
+					const auto rowCount = std::min(stripRows, grid.rows - row0);
+					const auto stripMaxY = grid.originY - row0 * grid.resolution;
+					const auto stripMinY = stripMaxY - rowCount * grid.resolution;
+					const auto overlaps = [&](const Box3d& box) {
+						return box.valid() && (box.max.y >= stripMinY) && (box.min.y <= stripMaxY) && (box.max.x >= options.minX) && (box.min.x <= options.maxX);
+					};
+
+					for (size_t begin = 0; begin < files.size();) {
+						// with tiles still unbounded, one wave per name length, else the whole strip at once
+						const auto unbounded = [&](size_t k) { return !footprints[order[k]].bounded; };
+						size_t end = files.size();
+						bool unboundedLater = false;
+						if (indexed) {
+							size_t first = begin;
+							while ((first < files.size()) && !unbounded(first)) {
+								++first;
+							}
+							if (first < files.size()) {
+								end = begin + 1;
+								while ((end < files.size()) && (files[order[end]].size() == files[order[begin]].size())) {
+									++end;
+								}
+								for (auto k = end; (k < files.size()) && !unboundedLater; ++k) {
+									unboundedLater = unbounded(k);
+								}
+							}
+						}
+
+						std::vector<size_t> candidates;
+						for (auto k = begin; k < end; ++k) {
+							const auto i = indexed ? order[k] : k;
+							const auto& footprint = footprints[i];
+							// a tile not loaded yet may page in unbounded ones, so it goes while there are any left
+							if (!indexed || overlaps(footprint.bounds) || (!footprint.loaded && (!footprint.bounded || unboundedLater))) {
+								candidates.push_back(i);
+							}
+						}
+						begin = end;
+
+						parallelFor(candidates.size(), threads, [&](size_t c, unsigned int worker) {
+							MINIOSGB_TRACE_SCOPE("convert", "raster tile");
+							const auto i = candidates[c];
+							std::string loadError;
+							const auto data = loadFile(files[i].c_str(), buffers[worker], &loadError);
+							if (!data) {
+								throw std::runtime_error(loadError);
+							}
+							const auto box = finestBounds(*data, options.offset);
+							if (indexed) {
+								std::lock_guard<std::mutex> lock(mutex);
+								forEachPagedFile(*data, files[i], options.offset, [&](const std::string& path, const Box3d& sphere) {
+									const auto it = indices.find(path);
+									if ((it != indices.end()) && !footprints[it->second].loaded) {
+										footprints[it->second].bounds.expand(sphere);
+										footprints[it->second].bounded = true;
+									}
+								});
+								footprints[i].bounds = box;
+								footprints[i].loaded = footprints[i].bounded = true;
+							}
+							if (box.valid()) {
+								const auto window = grid.windowOf(box, row0, rowCount);
+								if (window.size() > 0) {
+									renderTile(worker, *data, window);
+								}
+							}
+						});
+					}
+
+					if (!finishStrip(row0, rowCount)) {
+						if (error) {
+							*error = "rasterization cancelled";
+						}
+						return false;
+					}
+				}
+			} catch (const std::exception& ex) {
+				if (error) {
+					*error = ex.what();
+				}
+				return false;
+			}
+			return true;
+		}
+
+		// Calls fn(geometry, ia, ib, ic, a, b, c) for every finest-level triangle, with a, b and c in dataset coordinates.
+		template<typename F> void forEachFinestTriangle(Data& data, const Vec3d& offset, F&& fn) {
+			forEachGeometry(data.rootObject.get(), [&](Geometry& geometry, bool finest) {
+				const auto vertices = finest ? positionsOf(geometry) : nullptr;
+				if (vertices == nullptr) {
+					return;
+				}
+				const auto toDataset = [&](unsigned int index) {
+					const auto v = vertexAt(*vertices, index);
+					return Vec3d{ v.x + offset.x, v.y + offset.y, v.z + offset.z };
+				};
+				forEachTriangle(geometry, [&](unsigned int ia, unsigned int ib, unsigned int ic) {
+					fn(geometry, ia, ib, ic, toDataset(ia), toDataset(ib), toDataset(ic));
+				});
+			});
+		}
+	}
+};
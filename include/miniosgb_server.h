@@ -0,0 +1,757 @@
+#pragma once
+#include "miniosgb_cache.h"
+#include "miniosgb_gltf.h"
+#include "miniosgb_parallel.h"
+#ifdef __linux__
+#include <csignal>
+#include <ctime>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+
+namespace miniosgb
+{
+	struct ServerOptions {
+		std::string root; // the Data dir; its files are served under /tiles/
+		std::string address = "127.0.0.1";
+		unsigned short port = 8080; // 0: any free port, see TileServer::port()
+		unsigned int threads = 0; // GLB conversion and manifest workers, 0: one per core
+		size_t maxRequestSize = 16 * 1024; // request line and headers
+		TileCacheOptions cache; // of the converted GLBs, by default up to 1 GB
+		GltfOptions gltf;
+	};
+
+	namespace details {
+		struct HttpRequest {
+			std::string method;
+			std::string path; // percent-decoded
+			std::string query; // as sent
+			bool keepAlive = true;
+			bool hasBody = false;
+			std::string ifNoneMatch;
+			std::string ifModifiedSince;
+		};
+
+		inline bool equalsIgnoreCase(std::string_view a, std::string_view b) {
+			return (a.size() == b.size()) && std::equal(a.begin(), a.end(), b.begin(), [](char x, char y) { return tolower((unsigned char)x) == tolower((unsigned char)y); });
+		}
+
+		inline std::string_view trim(std::string_view s) {
+			while (!s.empty() && ((s.front() == ' ') || (s.front() == '\t'))) {
+				s.remove_prefix(1);
+			}
+			while (!s.empty() && ((s.back() == ' ') || (s.back() == '\t'))) {
+				s.remove_suffix(1);
+			}
+			return s;
+		}
+
+		// Percent-decodes `encoded` ('+' as space in queries), refusing control characters.
+		inline bool percentDecode(std::string_view encoded, std::string& decoded, bool query) {
+			const auto hex = [](char c) {
+				return ((c >= '0') && (c <= '9')) ? c - '0' : ((c >= 'a') && (c <= 'f')) ? c - 'a' + 10 : ((c >= 'A') && (c <= 'F')) ? c - 'A' + 10 : -1;
+			};
+			decoded.clear();
+			for (size_t i = 0; i < encoded.size(); ++i) {
+				auto c = encoded[i];
+				if (c == '%') {
+					if ((i + 2 >= encoded.size()) || (hex(encoded[i + 1]) < 0) || (hex(encoded[i + 2]) < 0)) {
+						return false;
+					}
+					c = (char)(hex(encoded[i + 1]) * 16 + hex(encoded[i + 2]));
+					i += 2;
+				} else if (query && (c == '+')) {
+					c = ' ';
+				}
+				if ((unsigned char)c < 0x20) {
+					return false;
+				}
+				decoded += c;
+			}
+			return true;
+		}
+
+		// The request line and the headers the server acts on, from the bytes before the blank line.
+		inline bool parseHttpRequest(std::string_view text, HttpRequest& request) {
+			const auto lineEnd = text.find("\r\n");
+			const auto line = text.substr(0, lineEnd);
+			const auto methodEnd = line.find(' ');
+			const auto targetEnd = (methodEnd != std::string_view::npos) ? line.find(' ', methodEnd + 1) : std::string_view::npos;
+			if (targetEnd == std::string_view::npos) {
+				return false;
+			}
+			request = HttpRequest();
+			request.method = std::string(line.substr(0, methodEnd));
+			const auto target = line.substr(methodEnd + 1, targetEnd - methodEnd - 1);
+			const auto version = line.substr(targetEnd + 1);
+			if ((version != "HTTP/1.1") && (version != "HTTP/1.0")) {
+				return false;
+			}
+			request.keepAlive = (version == "HTTP/1.1");
+			const auto queryStart = target.find('?');
+			if (target.empty() || (target[0] != '/') || !percentDecode(target.substr(0, queryStart), request.path, false)) {
+				return false;
+			}
+			if (queryStart != std::string_view::npos) {
+				request.query = std::string(target.substr(queryStart + 1));
+			}
+			for (auto pos = lineEnd; (pos != std::string_view::npos) && (pos + 2 < text.size());) {
+				const auto end = text.find("\r\n", pos + 2);
+				const auto header = text.substr(pos + 2, (end == std::string_view::npos) ? std::string_view::npos : end - pos - 2);
+				pos = end;
+				const auto colon = header.find(':');
+				if (colon == std::string_view::npos) {
+					return false;
+				}
+				const auto name = header.substr(0, colon);
+				const auto value = trim(header.substr(colon + 1));
+				if (equalsIgnoreCase(name, "connection")) {
+					if (equalsIgnoreCase(value, "close")) {
+						request.keepAlive = false;
+					} else if (equalsIgnoreCase(value, "keep-alive")) {
+						request.keepAlive = true;
+					}
+				} else if (equalsIgnoreCase(name, "if-none-match")) {
+					request.ifNoneMatch = std::string(value);
+				} else if (equalsIgnoreCase(name, "if-modified-since")) {
+					request.ifModifiedSince = std::string(value);
+				} else if (equalsIgnoreCase(name, "transfer-encoding") || (equalsIgnoreCase(name, "content-length") && (value != "0"))) {
+					request.hasBody = true;
+				}
+			}
+			return true;
+		}
+
+		// The value of `name` in an application/x-www-form-urlencoded query.
+		inline std::string queryValue(std::string_view query, std::string_view name) {
+			while (!query.empty()) {
+				const auto end = query.find('&');
+				const auto pair = query.substr(0, end);
+				const auto equals = pair.find('=');
+				std::string key, value;
+				if (percentDecode(pair.substr(0, equals), key, true) && (key == name)
+					&& percentDecode((equals != std::string_view::npos) ? pair.substr(equals + 1) : std::string_view(), value, true)) {
+					return value;
+				}
+				query = (end != std::string_view::npos) ? query.substr(end + 1) : std::string_view();
+			}
+			return std::string();
+		}
+
+		inline std::string httpDate(time_t time) {
+			tm parts;
+			gmtime_r(&time, &parts);
+			char text[64];
+			strftime(text, sizeof(text), "%a, %d %b %Y %H:%M:%S GMT", &parts);
+			return text;
+		}
+
+		inline bool parseHttpDate(const std::string& text, time_t& time) {
+			tm parts;
+			memset(&parts, 0, sizeof(parts));
+			const auto end = strptime(text.c_str(), "%a, %d %b %Y %H:%M:%S GMT", &parts);
+			if ((end == nullptr) || (*end != '\0')) {
+				return false;
+			}
+			time = timegm(&parts);
+			return true;
+		}
+
+		// RFC 9110 13.1.2: weak comparison, any of a list, or "*".
+		inline bool etagMatches(std::string_view list, std::string_view etag) {
+			while (!list.empty()) {
+				const auto end = list.find(',');
+				auto tag = trim(list.substr(0, end));
+				if (tag.substr(0, 2) == "W/") {
+					tag.remove_prefix(2);
+				}
+				if ((tag == "*") || (tag == etag)) {
+					return true;
+				}
+				list = (end != std::string_view::npos) ? list.substr(end + 1) : std::string_view();
+			}
+			return false;
+		}
+
+		inline const char* httpStatusText(int status) {
+			switch (status) {
+			case 200: return "OK";
+			case 304: return "Not Modified";
+			case 400: return "Bad Request";
+			case 404: return "Not Found";
+			case 405: return "Method Not Allowed";
+			case 431: return "Request Header Fields Too Large";
+			default: return "Internal Server Error";
+			}
+		}
+
+		inline void appendJsonString(std::string& out, std::string_view s) {
+			out += '"';
+			for (const auto c : s) {
+				if ((c == '"') || (c == '\\')) {
+					out += '\\';
+					out += c;
+				} else if ((unsigned char)c < 0x20) {
+					char escaped[8];
+					snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+					out += escaped;
+				} else {
+					out += c;
+				}
+			}
+			out += '"';
+		}
+	}
+
+	// Embeddable HTTP/1.1 server of a tile dataset, for local clients and tests:
+	//   GET|HEAD /tiles/<path>.osgb     the file, sent with sendfile()
+	//   GET|HEAD /tiles/<path>.glb      the .osgb beside it converted to GLB, kept in a TileCache
+	//   GET|HEAD /manifest[?prefix=p]   JSON list of the .osgb files (found at start()) and their sizes
+	// One thread runs an epoll loop over non-blocking sockets: it parses requests, answers file and conditional
+	// requests (ETag / Last-Modified from the .osgb) itself and writes every response without blocking. GLB conversion
+	// and manifests run on a worker pool, whose responses come back through an eventfd; cached GLBs are written from the
+	// cache's buffer, without a copy. Requests are answered in order on each keep-alive connection.
+	class TileServer {
+	public:
+		explicit TileServer(const ServerOptions& options) : _options(options), _cache(options.cache), _jobs(std::numeric_limits<size_t>::max()) {}
+		TileServer(const TileServer&) = delete;
+		TileServer& operator=(const TileServer&) = delete;
+		~TileServer() { stop(); }
+
+		bool start(std::string* error = nullptr) {
+			const auto fail = [&](const std::string& message) {
+				if (error) {
+					*error = message + ": " + strerror(errno);
+				}
+				closeFds();
+				return false;
+			};
+			std::error_code ec;
+			if (!std::filesystem::is_directory(_options.root, ec)) {
+				errno = ENOTDIR;
+				return fail("can't serve " + _options.root);
+			}
+			for (const auto& file : findFiles(_options.root)) {
+				const auto relative = std::filesystem::path(file).lexically_relative(_options.root).generic_string();
+				_manifest.emplace_back(relative, (size_t)std::filesystem::file_size(file, ec));
+			}
+
+			addrinfo hints;
+			memset(&hints, 0, sizeof(hints));
+			hints.ai_family = AF_UNSPEC;
+			hints.ai_socktype = SOCK_STREAM;
+			hints.ai_flags = AI_PASSIVE | AI_NUMERICHOST;
+			addrinfo* addresses = nullptr;
+			if (getaddrinfo(_options.address.c_str(), std::to_string(_options.port).c_str(), &hints, &addresses) != 0) {
+				errno = EINVAL;
+				return fail("can't resolve " + _options.address);
+			}
+			_listen = socket(addresses->ai_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+			const int one = 1;
+			const bool bound = (_listen >= 0) && (setsockopt(_listen, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)) == 0)
+				&& (bind(_listen, addresses->ai_addr, addresses->ai_addrlen) == 0) && (listen(_listen, SOMAXCONN) == 0);
+			freeaddrinfo(addresses);
+			if (!bound) {
+				return fail("can't listen on " + _options.address + ":" + std::to_string(_options.port));
+			}
+			sockaddr_storage local;
+			socklen_t localLength = sizeof(local);
+			getsockname(_listen, (sockaddr*)&local, &localLength);
+			_port = ntohs((local.ss_family == AF_INET6) ? ((sockaddr_in6*)&local)->sin6_port : ((sockaddr_in*)&local)->sin_port);
+
+			_epoll = epoll_create1(EPOLL_CLOEXEC);
+			_wake = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+			if ((_epoll < 0) || (_wake < 0) || !watch(_listen, listenTag, EPOLLIN, EPOLL_CTL_ADD) || !watch(_wake, wakeTag, EPOLLIN, EPOLL_CTL_ADD)) {
+				return fail("can't create the event loop");
+			}
+			for (unsigned int t = defaultThreadCount(_options.threads); t > 0; --t) {
+				_workers.emplace_back([this] { work(); });
+			}
+			_loop = std::thread([this] { run(); });
+			return true;
+		}
+
+		// The port listened on, e.g. when ServerOptions::port is 0.
+		unsigned short port() const { return _port; }
+
+		TileCacheStatistics cacheStatistics() const { return _cache.statistics(); }
+
+		// Closes every connection, after the workers finished their current request.
+		void stop() {
+			if (_loop.joinable()) {
+				_stopping = true;
+				wake();
+				_loop.join();
+			}
+			_jobs.close();
+			for (auto& worker : _workers) {
+				worker.join();
+			}
+			_workers.clear();
+			_connections.clear();
+			closeFds();
+		}
+
+	private:
+		struct Response {
+			int status = 200;
+			const char* contentType = "text/plain";
+			std::string headers; // extra header lines, each ending with \r\n
+			std::string text; // the body, unless one of:
+			std::shared_ptr<const CachedTile> tile; // its buffer
+			int file = -1;
+			size_t fileSize = 0;
+		};
+
+		struct Connection {
+			int fd = -1;
+			std::string input;
+			bool busy = false; // a worker prepares the response
+			bool writing = false;
+			bool eof = false; // the client sent all it will
+			bool head = false; // HEAD: headers only
+			bool keepAlive = true;
+			std::string header;
+			size_t headerSent = 0;
+			Response response;
+			size_t bodySent = 0;
+
+			~Connection() {
+				if (response.file >= 0) {
+					::close(response.file);
+				}
+				if (fd >= 0) {
+					::close(fd);
+				}
+			}
+		};
+
+		struct Job {
+			unsigned long long connection;
+			details::HttpRequest request;
+			std::string source; // .osgb of a GLB
+			std::string etag; // of a GLB
+			std::string lastModified;
+		};
+
+		static constexpr unsigned long long listenTag = 0;
+		static constexpr unsigned long long wakeTag = 1;
+		static constexpr int acceptRetryMs = 100; // while out of descriptors
+
+		const ServerOptions _options;
+		TileCache _cache;
+		std::vector<std::pair<std::string, size_t>> _manifest;
+		int _listen = -1;
+		int _epoll = -1;
+		int _wake = -1;
+		unsigned short _port = 0;
+		bool _acceptPaused = false; // out of descriptors: _listen is not watched, owned by the loop
+		std::atomic<bool> _stopping{ false };
+		std::thread _loop;
+		std::unordered_map<unsigned long long, std::unique_ptr<Connection>> _connections; // by id, owned by the loop
+		unsigned long long _nextConnection = wakeTag + 1;
+		BoundedQueue<Job> _jobs;
+		std::vector<std::thread> _workers;
+		std::mutex _doneMutex;
+		std::vector<std::pair<unsigned long long, Response>> _done; // worker responses for the loop
+		std::mutex _glbKeysMutex;
+		std::unordered_map<std::string, std::string> _glbKeys; // .osgb to the cache key of its latest conversion
+
+		void closeFds() {
+			for (auto fd : { &_listen, &_epoll, &_wake }) {
+				if (*fd >= 0) {
+					::close(*fd);
+					*fd = -1;
+				}
+			}
+		}
+
+		bool watch(int fd, unsigned long long tag, unsigned int events, int operation) {
+			epoll_event event;
+			event.events = events;
+			event.data.u64 = tag;
+			return epoll_ctl(_epoll, operation, fd, &event) == 0;
+		}
+
+		void wake() {
+			const unsigned long long one = 1;
+			(void)!::write(_wake, &one, sizeof(one));
+		}
+
+		void run() {
+			// a write to a closed connection fails with EPIPE instead of raising SIGPIPE (sendfile has no MSG_NOSIGNAL);
+			// the signal is thread-directed, so blocking it here leaves the process's handling alone
+			sigset_t pipe;
+			sigemptyset(&pipe);
+			sigaddset(&pipe, SIGPIPE);
+			pthread_sigmask(SIG_BLOCK, &pipe, nullptr);
+			epoll_event events[64];
+			while (!_stopping) {
+				const auto count = epoll_wait(_epoll, events, 64, _acceptPaused ? acceptRetryMs : -1);
+				if (count == 0) {
+					resumeAccept(); // descriptors may have been freed outside the server
+				}
+				for (int i = 0; i < count; ++i) {
+					const auto tag = events[i].data.u64;
+					if (tag == listenTag) {
+						accept();
+					} else if (tag == wakeTag) {
+						unsigned long long value;
+						(void)!::read(_wake, &value, sizeof(value));
+						std::vector<std::pair<unsigned long long, Response>> done;
+						{
+							std::lock_guard<std::mutex> lock(_doneMutex);
+							done.swap(_done);
+						}
+						for (auto& it : done) {
+							const auto connection = _connections.find(it.first);
+							if (connection != _connections.end()) {
+								connection->second->busy = false;
+								if (respond(it.first, *connection->second, std::move(it.second))) {
+									process(it.first, *connection->second);
+								}
+							} else if (it.second.file >= 0) {
+								::close(it.second.file);
+							}
+						}
+					} else if (_connections.count(tag) > 0) {
+						auto& connection = *_connections[tag];
+						if ((events[i].events & EPOLLERR) || ((events[i].events & EPOLLHUP) && connection.busy)) {
+							close(tag);
+						} else if (events[i].events & EPOLLOUT) {
+							if (flush(tag, connection)) {
+								process(tag, connection);
+							}
+						} else {
+							receive(tag, connection);
+						}
+					}
+				}
+			}
+		}
+
+		void accept() {
+			for (;;) {
+				const int fd = accept4(_listen, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+				if (fd < 0) {
+					if ((errno == EMFILE) || (errno == ENFILE) || (errno == ENOBUFS) || (errno == ENOMEM)) {
+						// the pending connection stays pending, and the level-triggered socket would wake the loop
+						// right away: stop listening until a connection closes or the retry timeout passes
+						_acceptPaused = watch(_listen, listenTag, 0, EPOLL_CTL_MOD);
+					} else if (errno == EINTR) {
+						continue;
+					}
+					return;
+				}
+				const int one = 1;
+				setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+				const auto id = _nextConnection++;
+				auto connection = std::make_unique<Connection>();
+				connection->fd = fd;
+				if (watch(fd, id, EPOLLIN, EPOLL_CTL_ADD)) {
+					_connections.emplace(id, std::move(connection));
+				}
+			}
+		}
+
+		void close(unsigned long long id) {
+			_connections.erase(id); // closing the socket removes it from the epoll set
+			resumeAccept();
+		}
+
+		void resumeAccept() {
+			if (_acceptPaused) {
+				_acceptPaused = !watch(_listen, listenTag, EPOLLIN, EPOLL_CTL_MOD);
+			}
+		}
+
+		void receive(unsigned long long id, Connection& connection) {
+			char chunk[16384];
+			while (connection.input.size() <= 4 * _options.maxRequestSize) { // else handle some pipelined requests first
+				const auto received = recv(connection.fd, chunk, sizeof(chunk), 0);
+				if (received > 0) {
+					connection.input.append(chunk, (size_t)received);
+				} else if (received == 0) {
+					connection.eof = true;
+					break;
+				} else if (errno == EINTR) {
+					continue;
+				} else if ((errno == EAGAIN) || (errno == EWOULDBLOCK)) {
+					break;
+				} else {
+					close(id);
+					return;
+				}
+			}
+			process(id, connection);
+		}
+
+		// Handles the complete requests received, in order, until one waits for a worker or for the socket.
+		void process(unsigned long long id, Connection& connection) {
+			while (!connection.busy && !connection.writing) {
+				const auto end = connection.input.find("\r\n\r\n");
+				if ((end == std::string::npos) && (connection.input.size() > _options.maxRequestSize)) {
+					connection.keepAlive = false;
+					if (!respond(id, connection, error(431, "request too large"))) {
+						return;
+					}
+					continue;
+				}
+				if (end == std::string::npos) {
+					if (connection.eof) {
+						close(id); // nothing more to answer
+					}
+					return;
+				}
+				details::HttpRequest request;
+				const bool parsed = (end <= _options.maxRequestSize) && details::parseHttpRequest(std::string_view(connection.input).substr(0, end), request);
+				connection.input.erase(0, end + 4);
+				connection.head = (request.method == "HEAD");
+				connection.keepAlive = parsed && request.keepAlive && !request.hasBody
+					&& !(connection.eof && (connection.input.find("\r\n\r\n") == std::string::npos)); // the last request
+				bool alive;
+				if (!parsed || request.hasBody) {
+					alive = respond(id, connection, error((end > _options.maxRequestSize) ? 431 : 400, "bad request"));
+				} else if ((request.method != "GET") && (request.method != "HEAD")) {
+					auto response = error(405, "method not allowed");
+					response.headers = "Allow: GET, HEAD\r\n";
+					alive = respond(id, connection, std::move(response));
+				} else {
+					alive = route(id, connection, std::move(request));
+				}
+				if (!alive) {
+					return;
+				}
+			}
+			if (connection.busy && (connection.eof || (connection.input.size() > 4 * _options.maxRequestSize))) {
+				watch(connection.fd, id, 0, EPOLL_CTL_MOD); // nothing to read until the worker is done
+			}
+		}
+
+		// Answers the request, or hands it to a worker; false when the connection was closed.
+		bool route(unsigned long long id, Connection& connection, details::HttpRequest&& request) {
+			if (request.path == "/manifest") {
+				connection.busy = true;
+				_jobs.push({ id, std::move(request), std::string(), std::string(), std::string() });
+				return true;
+			}
+			const std::string prefix = "/tiles/";
+			const auto relative = std::filesystem::path(request.path.substr(std::min(prefix.size(), request.path.size()))).lexically_normal();
+			const auto extension = relative.extension();
+			if ((request.path.compare(0, prefix.size(), prefix) != 0) || relative.empty() || relative.is_absolute()
+				|| (*relative.begin() == "..") || ((extension != ".osgb") && (extension != ".glb"))) {
+				return respond(id, connection, error(404, "not found"));
+			}
+			auto source = std::filesystem::path(_options.root) / relative;
+			source.replace_extension(".osgb");
+			const int file = ::open(source.c_str(), O_RDONLY | O_CLOEXEC);
+			struct stat st;
+			if ((file < 0) || (fstat(file, &st) != 0) || !S_ISREG(st.st_mode)) {
+				if (file >= 0) {
+					::close(file);
+				}
+				return respond(id, connection, error(404, "not found"));
+			}
+			const bool glb = (extension == ".glb");
+			char etag[80];
+			snprintf(etag, sizeof(etag), "\"%llx-%llx%s\"", (unsigned long long)st.st_size,
+				(unsigned long long)st.st_mtim.tv_sec * 1000000000ull + (unsigned long long)st.st_mtim.tv_nsec, glb ? "-glb" : "");
+			const auto lastModified = details::httpDate(st.st_mtim.tv_sec);
+			time_t since = 0;
+			const bool notModified = !request.ifNoneMatch.empty() ? details::etagMatches(request.ifNoneMatch, etag)
+				: (!request.ifModifiedSince.empty() && details::parseHttpDate(request.ifModifiedSince, since) && (st.st_mtim.tv_sec <= since));
+			if (notModified || glb) {
+				::close(file);
+			}
+			if (notModified) {
+				Response response;
+				response.status = 304;
+				response.contentType = nullptr;
+				response.headers = std::string("ETag: ") + etag + "\r\nLast-Modified: " + lastModified + "\r\n";
+				return respond(id, connection, std::move(response));
+			}
+			if (glb) {
+				connection.busy = true;
+				_jobs.push({ id, std::move(request), source.string(), etag, lastModified });
+				return true;
+			}
+			Response response;
+			response.contentType = "application/octet-stream";
+			response.headers = std::string("ETag: ") + etag + "\r\nLast-Modified: " + lastModified + "\r\n";
+			response.file = file;
+			response.fileSize = (size_t)st.st_size;
+			return respond(id, connection, std::move(response));
+		}
+
+		static Response error(int status, const char* message) {
+			Response response;
+			response.status = status;
+			response.text = std::string(message) + "\n";
+			return response;
+		}
+
+		void work() {
+			for (Job job; _jobs.pop(job);) {
+				Response response;
+				try {
+					response = (job.request.path == "/manifest") ? manifest(job.request) : glb(job);
+				} catch (const std::exception& ex) {
+					response = error(500, ex.what());
+				}
+				{
+					std::lock_guard<std::mutex> lock(_doneMutex);
+					_done.emplace_back(job.connection, std::move(response));
+				}
+				wake();
+			}
+		}
+
+		Response manifest(const details::HttpRequest& request) {
+			const auto prefix = details::queryValue(request.query, "prefix");
+			Response response;
+			response.contentType = "application/json";
+			response.text = "{\"tiles\":[";
+			bool first = true;
+			for (const auto& tile : _manifest) {
+				if (tile.first.compare(0, prefix.size(), prefix) == 0) {
+					response.text += first ? "\n" : ",\n";
+					response.text += "{\"path\":";
+					details::appendJsonString(response.text, tile.first);
+					response.text += ",\"size\":" + std::to_string(tile.second) + "}";
+					first = false;
+				}
+			}
+			response.text += "\n]}\n";
+			return response;
+		}
+
+		Response glb(const Job& job) {
+			// keyed by the validator too, so a changed .osgb is converted again instead of served stale under its new ETag
+			const auto key = job.source + "#" + job.etag;
+			{
+				std::lock_guard<std::mutex> lock(_glbKeysMutex);
+				auto& latest = _glbKeys[job.source];
+				if (latest != key) {
+					if (!latest.empty()) {
+						_cache.erase(latest);
+					}
+					latest = key;
+				}
+			}
+			auto tile = _cache.get(key, [&](CachedTile& tile) {
+				std::vector<unsigned char> buffer;
+				const auto data = loadFile(job.source.c_str(), buffer, &tile.error);
+				Glb glb;
+				if (data && buildGlb(*data, glb, _options.gltf, &tile.error)) {
+					tile.buffer.reserve(glb.size());
+					for (const auto& slice : glb.slices) {
+						tile.buffer.insert(tile.buffer.end(), (const unsigned char*)slice.data, (const unsigned char*)slice.data + slice.size);
+					}
+				}
+			});
+			if (!tile->error.empty()) {
+				return error(500, tile->error.c_str());
+			}
+			Response response;
+			response.contentType = "model/gltf-binary";
+			response.headers = "ETag: " + job.etag + "\r\nLast-Modified: " + job.lastModified + "\r\n";
+			response.tile = std::move(tile);
+			return response;
+		}
+
+		// Starts writing the response; false when the connection was closed.
+		bool respond(unsigned long long id, Connection& connection, Response&& response) {
+			const auto length = response.tile ? response.tile->buffer.size() : (response.file >= 0) ? response.fileSize : response.text.size();
+			connection.header = "HTTP/1.1 " + std::to_string(response.status) + " " + details::httpStatusText(response.status) + "\r\n";
+			if (response.status != 304) {
+				connection.header += "Content-Length: " + std::to_string(length) + "\r\n";
+			}
+			if (response.contentType) {
+				connection.header += std::string("Content-Type: ") + response.contentType + "\r\n";
+			}
+			connection.header += response.headers;
+			connection.header += connection.keepAlive ? "Connection: keep-alive\r\n\r\n" : "Connection: close\r\n\r\n";
+			if ((connection.head || (response.status == 304)) && (response.file >= 0)) {
+				::close(response.file);
+				response.file = -1;
+			}
+			if (connection.head || (response.status == 304)) {
+				response.text.clear();
+				response.tile.reset();
+				response.fileSize = 0;
+			}
+			connection.headerSent = 0;
+			connection.bodySent = 0;
+			connection.response = std::move(response);
+			connection.writing = true;
+			return flush(id, connection);
+		}
+
+		// Writes what the socket takes and waits for EPOLLOUT when it's full; false when the connection was closed.
+		bool flush(unsigned long long id, Connection& connection) {
+			auto& response = connection.response;
+			const auto body = response.tile ? response.tile->buffer.data() : (const unsigned char*)response.text.data();
+			const auto bodySize = response.tile ? response.tile->buffer.size() : response.text.size();
+			for (;;) {
+				ssize_t sent;
+				if (connection.headerSent < connection.header.size() || ((response.file < 0) && (connection.bodySent < bodySize))) {
+					iovec iov[2] = {
+						{ (void*)(connection.header.data() + connection.headerSent), connection.header.size() - connection.headerSent },
+						{ (void*)(body + connection.bodySent), (response.file < 0) ? bodySize - connection.bodySent : 0 },
+					};
+					msghdr message;
+					memset(&message, 0, sizeof(message));
+					message.msg_iov = iov;
+					message.msg_iovlen = 2;
+					sent = sendmsg(connection.fd, &message, MSG_NOSIGNAL);
+					if (sent > 0) {
+						const auto headerPart = std::min((size_t)sent, connection.header.size() - connection.headerSent);
+						connection.headerSent += headerPart;
+						connection.bodySent += (size_t)sent - headerPart;
+						continue;
+					}
+				} else if ((response.file >= 0) && (connection.bodySent < response.fileSize)) {
+					off_t offset = (off_t)connection.bodySent;
+					sent = sendfile(connection.fd, response.file, &offset, response.fileSize - connection.bodySent);
+					if (sent > 0) {
+						connection.bodySent += (size_t)sent;
+						continue;
+					}
+					if (sent == 0) {
+						close(id); // the file shrank
+						return false;
+					}
+				} else {
+					break;
+				}
+				if ((sent < 0) && (errno == EINTR)) {
+					continue;
+				}
+				if ((sent < 0) && ((errno == EAGAIN) || (errno == EWOULDBLOCK))) {
+					watch(connection.fd, id, EPOLLOUT, EPOLL_CTL_MOD);
+					return true;
+				}
+				close(id);
+				return false;
+			}
+
+			if (response.file >= 0) {
+				::close(response.file);
+			}
+			connection.response = Response();
+			connection.header.clear();
+			connection.writing = false;
+			if (!connection.keepAlive) {
+				close(id);
+				return false;
+			}
+			watch(connection.fd, id, EPOLLIN, EPOLL_CTL_MOD);
+			return true;
+		}
+	};
+};
+#endif
@@ -0,0 +1,344 @@
+#pragma once
+#include "miniosgb_writer.h"
+#include "miniosgb_parallel.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+namespace miniosgb
+{
+	// Synthetic ContextCapture-like dataset: a grid of root tiles, each a quadtree of PagedLOD files.
+	struct SynthOptions {
+		WriteOptions write; // OSGB version and bracket mode of every file
+		unsigned int tilesX = 4; // root tiles
+		unsigned int tilesY = 4;
+		unsigned int depth = 3; // files per root tile: 1 + 4 + ... + 4^(depth - 1)
+		unsigned int trianglesPerGeometry = 2048;
+		unsigned int geometriesPerTile = 1;
+		unsigned int textureSize = 256; // square PNG shared by the dataset; 0 for untextured geometries
+		bool shareObjects = true; // geometries of a file reference one StateSet and one UV, index and texture object
+		double tileSize = 100; // root tile edge in dataset units
+		float pixelSize = 512; // PagedLOD PIXEL_SIZE_ON_SCREEN threshold of the finer files
+		unsigned int threads = 0; // 0: hardware concurrency
+	};
+
+	struct SynthStats {
+		size_t files = 0;
+		unsigned long long bytes = 0;
+		double seconds = 0;
+	};
+
+	namespace details {
+		inline unsigned int crc32(const unsigned char* data, size_t size, unsigned int crc = 0) {
+			static const auto table = [] {
+				std::vector<unsigned int> t(256);
+				for (unsigned int n = 0; n < 256; ++n) {
+					auto c = n;
+					for (int k = 0; k < 8; ++k) {
+						c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+					}
+					t[n] = c;
+				}
+				return t;
+			}();
+			crc = ~crc;
+			for (size_t i = 0; i < size; ++i) {
+				crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+			}
+			return ~crc;
+		}
+
+		// RGB PNG of a checker pattern, with stored (uncompressed) deflate blocks so no zlib is needed.
+		inline std::vector<unsigned char> syntheticPng(unsigned int size) {
+			std::vector<unsigned char> raw;
+			raw.reserve(size_t(size) * (size * 3 + 1));
+			for (unsigned int y = 0; y < size; ++y) {
+				raw.push_back(0); // filter: none
+				for (unsigned int x = 0; x < size; ++x) {
+					const bool odd = ((x / 16) ^ (y / 16)) & 1;
+					raw.push_back((unsigned char)(odd ? 255 * x / size : 64));
+					raw.push_back((unsigned char)(odd ? 255 * y / size : 128));
+					raw.push_back((unsigned char)(odd ? 96 : 192));
+				}
+			}
+
+			std::vector<unsigned char> png = { 0x89, 'P', 'N', 'G', 0x0D, 0x0A, 0x1A, 0x0A };
+			const auto put32 = [](std::vector<unsigned char>& out, unsigned int value) {
+				for (int b = 3; b >= 0; --b) {
+					out.push_back((unsigned char)(value >> (8 * b)));
+				}
+			};
+			const auto chunk = [&](const char* type, const std::vector<unsigned char>& body) {
+				put32(png, (unsigned int)body.size());
+				const auto start = png.size();
+				png.insert(png.end(), type, type + 4);
+				png.insert(png.end(), body.begin(), body.end());
+				put32(png, crc32(png.data() + start, png.size() - start));
+			};
+			std::vector<unsigned char> header;
+			put32(header, size);
+			put32(header, size);
+			header.insert(header.end(), { 8, 2, 0, 0, 0 }); // 8-bit RGB
+			chunk("IHDR", header);
+
+			std::vector<unsigned char> zlib = { 0x78, 0x01 };
+			unsigned int a = 1, b = 0; // adler32
+			for (size_t p = 0; p < raw.size();) {
+				const auto length = (unsigned int)std::min<size_t>(raw.size() - p, 65535);
+				zlib.push_back((p + length == raw.size()) ? 1 : 0);
+				zlib.insert(zlib.end(), { (unsigned char)length, (unsigned char)(length >> 8), (unsigned char)~length, (unsigned char)(~length >> 8) });
+				zlib.insert(zlib.end(), raw.begin() + p, raw.begin() + p + length);
+				for (size_t i = p; i < p + length; ++i) {
+					a = (a + raw[i]) % 65521;
+					b = (b + a) % 65521;
+				}
+				p += length;
+			}
+			put32(zlib, (b << 16) | a);
+			chunk("IDAT", zlib);
+			chunk("IEND", {});
+			return png;
+		}
+
+		class DatasetSynthesizer {
+		public:
+			DatasetSynthesizer(const std::string& dir, const SynthOptions& options) : _dir(dir), _options(options) {
+				if (options.textureSize > 0) {
+					_png = syntheticPng(options.textureSize);
+				}
+				// an n x n vertex grid has 2 (n - 1)^2 triangles
+				const auto cells = std::max(1.0, std::round(std::sqrt(options.trianglesPerGeometry / 2.0)));
+				_cells = (unsigned int)cells;
+				const auto n = _cells + 1;
+				for (unsigned int j = 0; j < n; ++j) {
+					for (unsigned int i = 0; i < n; ++i) {
+						_texCoords.push_back({ float(i) / _cells, float(j) / _cells });
+					}
+				}
+				for (unsigned int j = 0; j < _cells; ++j) {
+					for (unsigned int i = 0; i < _cells; ++i) {
+						const auto v = j * n + i;
+						_indices.insert(_indices.end(), { v, v + 1, v + n + 1, v, v + n + 1, v + n });
+					}
+				}
+			}
+
+			bool run(SynthStats& stats, std::string* error) {
+				const auto start = std::chrono::steady_clock::now();
+				std::error_code ec;
+				std::filesystem::create_directories(_dir + "/Data", ec);
+				const auto metadata = std::string("<?xml version=\"1.0\" encoding=\"utf-8\"?>\n<ModelMetadata version=\"1\">\n")
+					+ "\t<SRS>ENU:30,120</SRS>\n\t<SRSOrigin>0,0,0</SRSOrigin>\n</ModelMetadata>\n";
+				if (!writeFile((_dir + "/metadata.xml").c_str(), { { metadata.data(), metadata.size() } }, error)) {
+					return false;
+				}
+
+				const auto roots = size_t(_options.tilesX) * _options.tilesY;
+				std::mutex errorMutex;
+				std::string firstError;
+				parallelFor(roots, _options.threads, [&](size_t index, unsigned int) {
+					const auto x = (unsigned int)(index % _options.tilesX);
+					const auto y = (unsigned int)(index / _options.tilesX);
+					char name[32];
+					snprintf(name, sizeof(name), "Tile_+%03u_+%03u", x, y);
+					std::error_code dirError;
+					std::filesystem::create_directories(_dir + "/Data/" + name, dirError);
+					std::string tileError;
+					if (!writeNode(name, std::string(name), 0, x * _options.tileSize, y * _options.tileSize, _options.tileSize, &tileError)) {
+						std::lock_guard<std::mutex> lock(errorMutex);
+						if (firstError.empty()) {
+							firstError = tileError;
+						}
+					}
+				});
+				stats.files = _files;
+				stats.bytes = _bytes;
+				stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+				if (!firstError.empty()) {
+					if (error) {
+						*error = firstError;
+					}
+					return false;
+				}
+				return true;
+			}
+
+			// Encodes the root file of the first tile into `buffer`.
+			bool encodeRoot(std::vector<unsigned char>& buffer, std::string* error) const {
+				std::vector<std::vector<Vec3f>> positions;
+				const auto data = makeNode("Tile_+000_+000", "Tile_+000_+000", 0, 0, 0, _options.tileSize, positions);
+				buffer.clear();
+				return writeOsgb(data, [&buffer](const unsigned char* p, size_t n) {
+					buffer.insert(buffer.end(), p, p + n);
+					return true;
+				}, _options.write, error);
+			}
+
+		private:
+			const std::string _dir;
+			const SynthOptions& _options;
+			std::vector<unsigned char> _png;
+			unsigned int _cells = 1;
+			std::vector<Vec2f> _texCoords; // shared by all geometries: every geometry is the same grid
+			std::vector<unsigned int> _indices;
+			std::atomic<size_t> _files{ 0 };
+			std::atomic<unsigned long long> _bytes{ 0 };
+
+			static float heightAt(double x, double y) {
+				return (float)(20 + 8 * std::sin(x * 0.013) * std::cos(y * 0.017) + 2 * std::sin(x * 0.11 + y * 0.07));
+			}
+
+			StateSet* makeStateSet(Data& data) const {
+				auto stateSet = data.create<StateSet>();
+				auto material = data.create<Material>();
+				material->ambient = { false, { 0.2f, 0.2f, 0.2f, 1 }, { 0.2f, 0.2f, 0.2f, 1 } };
+				material->diffuse = { false, { 0.8f, 0.8f, 0.8f, 1 }, { 0.8f, 0.8f, 0.8f, 1 } };
+				material->specular = { false, { 0, 0, 0, 1 }, { 0, 0, 0, 1 } };
+				material->emission = { false, { 0, 0, 0, 1 }, { 0, 0, 0, 1 } };
+				material->shininess = { false, 0, 0 };
+				stateSet->attributes.push_back({ material, 1 });
+				if (!_png.empty()) {
+					auto image = data.create<Image>();
+					image->data = _png.data();
+					image->dataLength = (unsigned int)_png.size();
+					auto texture = data.create<Texture2D>();
+					texture->image = image;
+					stateSet->textureModesList.push_back({ { 0x0DE1, 1 } }); // GL_TEXTURE_2D: ON
+					stateSet->textureAttributesList.push_back({ { texture, 1 } });
+				}
+				return stateSet;
+			}
+
+			// Geometries of a square, split into geometriesPerTile strips along X. `positions` keeps the vertex storage.
+			Geode* makeGeode(Data& data, double x0, double y0, double size, std::vector<std::vector<Vec3f>>& positions) const {
+				auto geode = data.create<Geode>();
+				const auto count = std::max(1u, _options.geometriesPerTile);
+				const auto n = _cells + 1;
+				StateSet* sharedStateSet = nullptr;
+				Vec2Array* sharedTexCoords = nullptr;
+				DrawElementsUInt* sharedIndices = nullptr;
+				for (unsigned int g = 0; g < count; ++g) {
+					positions.emplace_back();
+					auto& vertices = positions.back();
+					vertices.reserve(size_t(n) * n);
+					const auto stripX = x0 + size * g / count;
+					const auto stripWidth = size / count;
+					for (unsigned int j = 0; j < n; ++j) {
+						for (unsigned int i = 0; i < n; ++i) {
+							const auto x = stripX + stripWidth * i / _cells;
+							const auto y = y0 + size * j / _cells;
+							vertices.push_back({ (float)x, (float)y, heightAt(x, y) });
+						}
+					}
+					auto geometry = data.create<Geometry>();
+					auto vertexArray = data.create<Vec3Array>();
+					vertexArray->binding = Array::Binding::PerVertex;
+					vertexArray->elementCount = (unsigned int)vertices.size();
+					vertexArray->elementData = (const unsigned char*)vertices.data();
+					geometry->vertexData = vertexArray;
+
+					const auto share = _options.shareObjects && (g > 0);
+					if (!share) {
+						sharedTexCoords = data.create<Vec2Array>();
+						sharedTexCoords->binding = Array::Binding::PerVertex;
+						sharedTexCoords->elementCount = (unsigned int)_texCoords.size();
+						sharedTexCoords->elementData = (const unsigned char*)_texCoords.data();
+						sharedIndices = data.create<DrawElementsUInt>();
+						sharedIndices->mode = 4; // GL_TRIANGLES
+						sharedIndices->indexCount = (unsigned int)_indices.size();
+						sharedIndices->indexData = (const unsigned char*)_indices.data();
+						sharedStateSet = makeStateSet(data);
+					}
+					geometry->texCoordDataList.push_back(sharedTexCoords);
+					geometry->primitives.push_back(sharedIndices);
+					geometry->stateSet = sharedStateSet;
+					geode->drawables.push_back(geometry);
+				}
+				return geode;
+			}
+
+			// The content of one quadtree node file: a PagedLOD over its quadrants, or a Group at the finest level.
+			Data makeNode(const char* rootName, const std::string& name, unsigned int level, double x0, double y0, double size, std::vector<std::vector<Vec3f>>& positions) const {
+				Data data;
+				auto geode = makeGeode(data, x0, y0, size, positions);
+				if (level + 1 >= _options.depth) {
+					auto group = data.create<Group>();
+					group->children.push_back(geode);
+					data.rootObject = group;
+				} else {
+					auto plod = data.create<PagedLOD>();
+					plod->centerMode = 1; // USER_DEFINED_CENTER
+					plod->userDefinedCenter = { x0 + size / 2, y0 + size / 2, heightAt(x0 + size / 2, y0 + size / 2) };
+					plod->userDefinedRadius = size * 0.75;
+					plod->rangeMode = LOD::RangeMode::PixelSizeOnScreen;
+					plod->children.push_back(geode);
+					plod->rangeList.push_back({ 0, _options.pixelSize });
+					plod->rangeDataList.resize(5);
+					for (unsigned int q = 0; q < 4; ++q) {
+						plod->rangeList.push_back({ _options.pixelSize, 1e30f });
+						plod->rangeDataList[q + 1].filename = data.copyString(childName(rootName, name, level, q) + ".osgb");
+					}
+					data.rootObject = plod;
+				}
+				return data;
+			}
+
+			// Writes the file of one quadtree node and, recursively, the files of its finer quadrants.
+			bool writeNode(const char* rootName, const std::string& name, unsigned int level, double x0, double y0, double size, std::string* error) {
+				std::vector<std::vector<Vec3f>> positions;
+				auto data = makeNode(rootName, name, level, x0, y0, size, positions);
+				const auto leaf = (level + 1 >= _options.depth);
+
+				const auto filename = _dir + "/Data/" + rootName + "/" + name + ".osgb";
+				FILE* file = openFile(filename.c_str(), "wb");
+				if (file == nullptr) {
+					*error = "can't open file: " + filename;
+					return false;
+				}
+				unsigned long long bytes = 0;
+				const auto written = writeOsgb(data, [file, &bytes](const unsigned char* p, size_t n) {
+					bytes += n;
+					return fwrite(p, 1, n, file) == n;
+				}, _options.write, error);
+				if ((fclose(file) != 0) || !written) {
+					if (written) {
+						*error = "can't write file: " + filename;
+					}
+					return false;
+				}
+				++_files;
+				_bytes += bytes;
+				data.rootObject.reset();
+				positions.clear();
+
+				if (!leaf) {
+					const auto half = size / 2;
+					for (unsigned int q = 0; q < 4; ++q) {
+						if (!writeNode(rootName, childName(rootName, name, level, q), level + 1, x0 + half * (q & 1), y0 + half * (q >> 1), half, error)) {
+							return false;
+						}
+					}
+				}
+				return true;
+			}
+
+			// Tile_+000_+000_L1_2, Tile_+000_+000_L2_21, ...: level and quadrant path like ContextCapture names.
+			static std::string childName(const char* rootName, const std::string& name, unsigned int level, unsigned int quadrant) {
+				std::string path = (level == 0) ? std::string() : name.substr(name.rfind('_') + 1);
+				return std::string(rootName) + "_L" + std::to_string(level + 1) + "_" + path + char('0' + quadrant);
+			}
+		};
+	}
+
+	// Writes <dir>/metadata.xml and <dir>/Data/Tile_+XXX_+YYY/... with tilesX * tilesY root tiles in parallel.
+	inline bool synthesizeDataset(const std::string& dir, const SynthOptions& options = {}, SynthStats* stats = nullptr, std::string* error = nullptr) {
+		SynthStats local;
+		details::DatasetSynthesizer synthesizer(dir, options);
+		return synthesizer.run(stats ? *stats : local, error);
+	}
+
+	// One synthetic tile in memory, the root file of the first tile of the dataset synthesizeDataset() would write.
+	inline bool synthesizeTile(std::vector<unsigned char>& buffer, const SynthOptions& options = {}, std::string* error = nullptr) {
+		return details::DatasetSynthesizer(std::string(), options).encodeRoot(buffer, error);
+	}
+};
@@ -0,0 +1,213 @@
+#pragma once
+#include "miniosgb_io.h"
+
+namespace miniosgb
+{
+	// Streams an uncompressed, stripped baseline TIFF, optionally a GeoTIFF, row by row. Since strips are
+	// uncompressed their offsets are known up front, so the header is written first and pixel rows go straight to
+	// disk without ever holding the whole image.
+	struct TiffWriter {
+		enum class Format { Rgba8, Float32 };
+
+		// GeoTIFF georeferencing of a north-up raster in projected coordinates; pixels are areas (PixelIsArea).
+		struct GeoReference {
+			double west = 0; // of the top-left corner
+			double north = 0;
+			double resolution = 1; // pixel size in CRS units
+			unsigned int epsg = 0; // projected CRS, e.g. a UTM zone; 0: left undefined
+		};
+
+		~TiffWriter() {
+			if (_file) {
+				fclose(_file);
+			}
+		}
+
+		// `geo` nullptr for a plain image.
+		bool open(const char* filename, unsigned int width, unsigned int height, Format format, const GeoReference* geo = nullptr, std::string* error = nullptr) {
+			_width = width;
+			_height = height;
+			_rowBytes = size_t(width) * 4;
+			const auto spp = (format == Format::Rgba8) ? 4u : 1u;
+			const unsigned int rowsPerStrip = std::max(1u, (unsigned int)(65536 / std::max<size_t>(_rowBytes, 1)));
+			const auto strips = (height + rowsPerStrip - 1) / rowsPerStrip;
+			if ((width == 0) || (height == 0) || (_rowBytes * height > 0xFFFFFFFFull - 65536 - strips * 8ull)) {
+				return fail("tiff size out of range", error);
+			}
+
+			std::vector<unsigned char> header(8);
+			const auto put16 = [&](size_t pos, unsigned int v) {
+				header[pos] = v & 0xFF;
+				header[pos + 1] = (v >> 8) & 0xFF;
+			};
+			const auto put32 = [&](size_t pos, unsigned int v) {
+				put16(pos, v & 0xFFFF);
+				put16(pos + 2, v >> 16);
+			};
+			header[0] = 'I';
+			header[1] = 'I';
+			put16(2, 42);
+			put32(4, 8);
+
+			// IFD entries, in tag order; each adder returns the entry's index
+			struct Entry {
+				unsigned short tag;
+				unsigned short type;
+				unsigned int count;
+				std::vector<unsigned char> value;
+			};
+			std::vector<Entry> entries;
+			const auto shorts = [&](unsigned short tag, const std::vector<unsigned int>& values) {
+				Entry e{ tag, 3, (unsigned int)values.size(), {} };
+				for (const auto v : values) {
+					e.value.push_back(v & 0xFF);
+					e.value.push_back((v >> 8) & 0xFF);
+				}
+				entries.push_back(std::move(e));
+				return entries.size() - 1;
+			};
+			const auto longs = [&](unsigned short tag, const std::vector<unsigned int>& values) {
+				Entry e{ tag, 4, (unsigned int)values.size(), {} };
+				for (const auto v : values) {
+					for (int b = 0; b < 4; ++b) {
+						e.value.push_back((v >> (8 * b)) & 0xFF);
+					}
+				}
+				entries.push_back(std::move(e));
+				return entries.size() - 1;
+			};
+			const auto doubles = [&](unsigned short tag, const std::vector<double>& values) {
+				Entry e{ tag, 12, (unsigned int)values.size(), {} };
+				for (const auto v : values) {
+					unsigned char bytes[8];
+					memcpy(bytes, &v, 8);
+					e.value.insert(e.value.end(), bytes, bytes + 8);
+				}
+				entries.push_back(std::move(e));
+				return entries.size() - 1;
+			};
+
+			std::vector<unsigned int> stripOffsets(strips), stripByteCounts(strips);
+			longs(256, { width }); // ImageWidth
+			longs(257, { height }); // ImageLength
+			shorts(258, std::vector<unsigned int>(spp, (format == Format::Rgba8) ? 8u : 32u)); // BitsPerSample
+			shorts(259, { 1 }); // Compression: none
+			shorts(262, { (format == Format::Rgba8) ? 2u : 1u }); // PhotometricInterpretation: RGB / BlackIsZero
+			const auto stripOffsetsEntry = longs(273, stripOffsets); // StripOffsets, filled below
+			shorts(277, { spp }); // SamplesPerPixel
+			longs(278, { rowsPerStrip }); // RowsPerStrip
+			const auto stripByteCountsEntry = longs(279, stripByteCounts); // StripByteCounts, filled below
+			shorts(284, { 1 }); // PlanarConfiguration: chunky
+			if (format == Format::Rgba8) {
+				shorts(338, { 2 }); // ExtraSamples: unassociated alpha
+			}
+			shorts(339, std::vector<unsigned int>(spp, (format == Format::Rgba8) ? 1u : 3u)); // SampleFormat: uint / float
+			if (geo) {
+				doubles(33550, { geo->resolution, geo->resolution, 0 }); // ModelPixelScaleTag
+				doubles(33922, { 0, 0, 0, geo->west, geo->north, 0 }); // ModelTiepointTag
+				// GeoKeyDirectoryTag: version 1.1.0, then { key, location (0: the value itself), count, value } by key
+				std::vector<unsigned int> keys = {
+					1, 1, 0, 0,
+					1024, 0, 1, 1, // GTModelTypeGeoKey: projected
+					1025, 0, 1, 1, // GTRasterTypeGeoKey: PixelIsArea
+				};
+				if (geo->epsg != 0) {
+					keys.insert(keys.end(), { 3072, 0, 1, geo->epsg }); // ProjectedCSTypeGeoKey
+				}
+				keys[3] = (unsigned int)(keys.size() / 4 - 1);
+				shorts(34735, keys);
+			}
+
+			// IFD followed by the out-of-line values, then the pixel data
+			const auto ifdSize = 2 + entries.size() * 12 + 4;
+			auto valuePos = 8 + ifdSize;
+			for (const auto& e : entries) {
+				if (e.value.size() > 4) {
+					valuePos += (e.value.size() + 1) & ~size_t(1);
+				}
+			}
+			const auto dataPos = valuePos;
+			for (unsigned int s = 0; s < strips; ++s) {
+				const auto rows = std::min(rowsPerStrip, height - s * rowsPerStrip);
+				stripOffsets[s] = (unsigned int)(dataPos + size_t(s) * rowsPerStrip * _rowBytes);
+				stripByteCounts[s] = (unsigned int)(rows * _rowBytes);
+			}
+			// same sizes as the placeholders, so the layout above holds
+			for (unsigned int s = 0; s < strips; ++s) {
+				for (int b = 0; b < 4; ++b) {
+					entries[stripOffsetsEntry].value[s * 4 + b] = (stripOffsets[s] >> (8 * b)) & 0xFF;
+					entries[stripByteCountsEntry].value[s * 4 + b] = (stripByteCounts[s] >> (8 * b)) & 0xFF;
+				}
+			}
+
+			header.resize(dataPos, 0);
+			put16(8, (unsigned int)entries.size());
+			auto entryPos = size_t(10);
+			valuePos = 8 + ifdSize;
+			for (const auto& e : entries) {
+				put16(entryPos, e.tag);
+				put16(entryPos + 2, e.type);
+				put32(entryPos + 4, e.count);
+				if (e.value.size() <= 4) {
+					std::copy(e.value.begin(), e.value.end(), header.begin() + entryPos + 8);
+				} else {
+					put32(entryPos + 8, (unsigned int)valuePos);
+					std::copy(e.value.begin(), e.value.end(), header.begin() + valuePos);
+					valuePos += (e.value.size() + 1) & ~size_t(1);
+				}
+				entryPos += 12;
+			}
+			put32(entryPos, 0); // no next IFD
+
+			_file = details::openFile(filename, "wb");
+			if (_file == nullptr) {
+				return fail(std::string("can't open file: ") + filename, error);
+			}
+			if (fwrite(header.data(), 1, header.size(), _file) != header.size()) {
+				return fail("tiff write failed", error);
+			}
+			_rowsWritten = 0;
+			return true;
+		}
+
+		// Appends `rowCount` rows of width * 4 bytes each.
+		bool writeRows(const void* rows, unsigned int rowCount, std::string* error = nullptr) {
+			if ((_file == nullptr) || (_rowsWritten + rowCount > _height)) {
+				return fail("tiff rows out of range", error);
+			}
+			const auto bytes = _rowBytes * rowCount;
+			if (fwrite(rows, 1, bytes, _file) != bytes) {
+				return fail("tiff write failed", error);
+			}
+			_rowsWritten += rowCount;
+			return true;
+		}
+
+		bool close(std::string* error = nullptr) {
+			if (_file == nullptr) {
+				return fail("tiff not open", error);
+			}
+			const auto complete = (_rowsWritten == _height);
+			const auto closed = (fclose(_file) == 0);
+			_file = nullptr;
+			if (!complete || !closed) {
+				return fail(complete ? "tiff close failed" : "tiff incomplete", error);
+			}
+			return true;
+		}
+
+	private:
+		FILE* _file = nullptr;
+		unsigned int _width = 0;
+		unsigned int _height = 0;
+		unsigned int _rowsWritten = 0;
+		size_t _rowBytes = 0;
+
+		static bool fail(const std::string& message, std::string* error) {
+			if (error) {
+				*error = message;
+			}
+			return false;
+		}
+	};
+};
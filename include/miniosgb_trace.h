@@ -0,0 +1,166 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Trace events of the load pipeline (file open/map, header, object graph, image probe/decode, conversion stages),
+// for chrome://tracing or ui.perfetto.dev. Events are recorded only when MINIOSGB_TRACE is defined before the
+// first miniosgb header; otherwise MINIOSGB_TRACE_SCOPE compiles to nothing.
+#define MINIOSGB_TRACE_CONCAT_(a, b) a##b
+#define MINIOSGB_TRACE_CONCAT(a, b) MINIOSGB_TRACE_CONCAT_(a, b)
+#ifdef MINIOSGB_TRACE
+#define MINIOSGB_TRACE_SCOPE(category, name) ::miniosgb::trace::Scope MINIOSGB_TRACE_CONCAT(miniosgbTraceScope, __LINE__)(category, name)
+#else
+#define MINIOSGB_TRACE_SCOPE(category, name) ((void)0)
+#endif
+
+#ifndef MINIOSGB_TRACE_CAPACITY
+#define MINIOSGB_TRACE_CAPACITY 16384 // events kept per thread, a power of two
+#endif
+
+namespace miniosgb
+{
+	namespace trace
+	{
+		struct Event {
+			const char* category; // string literals
+			const char* name;
+			long long begin; // ns since the first event of the process
+			long long end;
+			unsigned int thread;
+		};
+
+		namespace details {
+			inline long long now() {
+				static const auto epoch = std::chrono::steady_clock::now();
+				return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - epoch).count();
+			}
+
+			// Latest events of one thread at a time; only that thread writes, so recording takes no lock.
+			struct Ring {
+				static constexpr size_t capacity = MINIOSGB_TRACE_CAPACITY;
+				static_assert((capacity & (capacity - 1)) == 0, "MINIOSGB_TRACE_CAPACITY must be a power of two");
+				std::vector<Event> events = std::vector<Event>(capacity);
+				std::atomic<size_t> count{ 0 }; // events ever recorded
+
+				void push(const Event& event) {
+					const auto n = count.load(std::memory_order_relaxed);
+					events[n & (capacity - 1)] = event;
+					count.store(n + 1, std::memory_order_release);
+				}
+			};
+
+			// Rings outlive their threads: a thread that exits hands its ring to the next new thread, so short-lived
+			// pool threads don't grow memory, and their events stay until overwritten.
+			struct Registry {
+				std::mutex mutex;
+				std::vector<std::shared_ptr<Ring>> rings;
+				std::vector<std::shared_ptr<Ring>> free;
+				unsigned int nextThread = 1;
+			};
+
+			inline Registry& registry() {
+				static Registry instance;
+				return instance;
+			}
+
+			struct ThreadRing {
+				std::shared_ptr<Ring> ring;
+				unsigned int thread;
+
+				ThreadRing() {
+					auto& r = registry();
+					std::lock_guard<std::mutex> lock(r.mutex);
+					thread = r.nextThread++;
+					if (r.free.empty()) {
+						ring = std::make_shared<Ring>();
+						r.rings.push_back(ring);
+					} else {
+						ring = r.free.back();
+						r.free.pop_back();
+					}
+				}
+
+				~ThreadRing() {
+					auto& r = registry();
+					std::lock_guard<std::mutex> lock(r.mutex);
+					r.free.push_back(ring);
+				}
+			};
+
+			inline ThreadRing& threadRing() {
+				thread_local ThreadRing instance;
+				return instance;
+			}
+		}
+
+		// Records [construction, destruction) as one complete event of the calling thread.
+		class Scope {
+		public:
+			Scope(const char* category, const char* name) : _category(category), _name(name), _begin(details::now()) {}
+			~Scope() {
+				auto& ring = details::threadRing();
+				ring.ring->push({ _category, _name, _begin, details::now(), ring.thread });
+			}
+			Scope(const Scope&) = delete;
+			Scope& operator=(const Scope&) = delete;
+
+		private:
+			const char* _category;
+			const char* _name;
+			long long _begin;
+		};
+
+		// The events kept by all threads. Take them once the traced work is done: events recorded meanwhile may be torn.
+		inline std::vector<Event> events() {
+			auto& r = details::registry();
+			std::lock_guard<std::mutex> lock(r.mutex);
+			std::vector<Event> all;
+			for (const auto& ring : r.rings) {
+				const auto count = ring->count.load(std::memory_order_acquire);
+				const auto kept = std::min(count, details::Ring::capacity);
+				for (auto i = count - kept; i < count; ++i) {
+					all.push_back(ring->events[i & (details::Ring::capacity - 1)]);
+				}
+			}
+			return all;
+		}
+
+		// Chrome trace event format, complete ("X") events in microseconds.
+		inline std::string chromeTraceJson() {
+			const auto all = events();
+			std::string json = "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+			char line[512];
+			for (size_t i = 0; i < all.size(); ++i) {
+				const auto& e = all[i];
+				snprintf(line, sizeof(line), "%s\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":%u}",
+					(i > 0) ? "," : "", e.name, e.category, e.begin / 1e3, (e.end - e.begin) / 1e3, e.thread);
+				json += line;
+			}
+			json += "\n]}\n";
+			return json;
+		}
+
+		// Drops the events recorded so far. Only while no thread is tracing.
+		inline void clear() {
+			auto& r = details::registry();
+			std::lock_guard<std::mutex> lock(r.mutex);
+			for (const auto& ring : r.rings) {
+				ring->count.store(0, std::memory_order_relaxed);
+			}
+		}
+
+		constexpr bool compiledIn() {
+#ifdef MINIOSGB_TRACE
+			return true;
+#else
+			return false;
+#endif
+		}
+	}
+};
@@ -0,0 +1,622 @@
+#pragma once
+#include "miniosgb_io.h"
+#include <functional>
+
+namespace miniosgb
+{
+	struct WriteOptions {
+		unsigned int version = 161; // OSG 3.6.5
+		bool useBinaryBrackets = true;
+	};
+
+	// Receives the encoded stream in order. Returning false aborts writing.
+	typedef std::function<bool(const unsigned char* data, size_t size)> WriteSink;
+
+	namespace details {
+		// Mirror of Reader for the classes it supports. Every object is written with the same field layout the
+		// reader consumes for the target version, so whatever is written here can be read back.
+		//
+		// Binary brackets store the distance to their end bracket. Instead of seeking back to patch them, the
+		// object graph is encoded twice: the first pass only measures bracket sizes, the second streams the
+		// bytes through a small buffer straight to the sink. Large payloads (arrays, indices, images) are passed
+		// to the sink directly from their source memory.
+		struct Writer {
+			struct Error : std::runtime_error {
+				Error(const std::string& message) : std::runtime_error(message) {}
+			};
+
+			Writer(const WriteOptions& options, const WriteSink* sink)
+				: _version(options.version), _useBinaryBrackets(options.useBinaryBrackets), _sink(sink) {
+			}
+
+			const unsigned int _version;
+			const bool _useBinaryBrackets;
+			const WriteSink* _sink; // nullptr while measuring
+			size_t _pos = 0;
+
+			std::vector<unsigned char> _pending;
+			std::vector<size_t> _openBrackets; // measuring: index into _bracketSizes
+			std::vector<unsigned long long> _bracketSizes;
+			size_t _nextBracket = 0;
+
+			void flush() {
+				if (_sink && !_pending.empty()) {
+					if (!(*_sink)(_pending.data(), _pending.size())) {
+						throw Error("write aborted by sink");
+					}
+				}
+				_pending.clear();
+			}
+
+			void writeBytes(const void* data, size_t size) {
+				_pos += size;
+				if (_sink == nullptr) {
+					return;
+				}
+				if (size >= 4096) {
+					flush();
+					if (!(*_sink)((const unsigned char*)data, size)) {
+						throw Error("write aborted by sink");
+					}
+					return;
+				}
+				const auto p = (const unsigned char*)data;
+				_pending.insert(_pending.end(), p, p + size);
+				if (_pending.size() >= 65536) {
+					flush();
+				}
+			}
+
+			template<typename T> void write(const T& value) {
+				writeBytes(&value, sizeof(T));
+			}
+
+			void write(const bool& value) {
+				const unsigned char b = value ? 1 : 0;
+				writeBytes(&b, 1);
+			}
+
+			void write(std::string_view value) {
+				write((int)value.size());
+				writeBytes(value.data(), value.size());
+			}
+
+			void write(const std::string& value) {
+				write(std::string_view(value));
+			}
+
+			void WriteBeginBracket() {
+				if (!_useBinaryBrackets) {
+					return;
+				}
+				if (_sink == nullptr) {
+					_openBrackets.push_back(_bracketSizes.size());
+					_bracketSizes.push_back(_pos);
+				}
+				const auto size = (_sink == nullptr) ? 0 : _bracketSizes[_nextBracket++];
+				if (_version > 148) {
+					write((long long)size);
+				} else {
+					write((int)size);
+				}
+			}
+
+			void WriteEndBracket() {
+				if (_useBinaryBrackets && (_sink == nullptr)) {
+					auto& begin = _bracketSizes[_openBrackets.back()];
+					begin = _pos - begin;
+					_openBrackets.pop_back();
+				}
+			}
+
+			std::unordered_map<const void*, unsigned int> _ids;
+			unsigned int _nextId = 1;
+
+			// Returns true when `obj` was already written and only its id is needed.
+			bool findOrCreateId(const void* obj, unsigned int* id) {
+				const auto it = _ids.find(obj);
+				if (it != _ids.end()) {
+					*id = it->second;
+					return true;
+				}
+				*id = _nextId++;
+				_ids[obj] = *id;
+				return false;
+			}
+
+			void writeObjectIfValid(const Object* obj) {
+				write(obj != nullptr);
+				if (obj) {
+					writeObject(obj);
+				}
+			}
+
+			void writeObject(const Object* obj) {
+				if (obj == nullptr) {
+					write(std::string("NULL"));
+					return;
+				}
+				const auto className = classNameOf(obj);
+				write(className);
+				WriteBeginBracket();
+				unsigned int id;
+				const auto written = findOrCreateId(obj, &id);
+				write(id);
+				if (!written) {
+					if (const auto plod = objectCast<PagedLOD>(obj)) {
+						writeObjectFields<Object>(*plod);
+						writeObjectFields<Node>(*plod);
+						writeObjectFields<LOD>(*plod);
+						writeObjectFields<PagedLOD>(*plod);
+					} else if (const auto group = objectCast<Group>(obj)) {
+						writeObjectFields<Object>(*group);
+						writeObjectFields<Node>(*group);
+						writeObjectFields<Group>(*group);
+					} else if (const auto geode = objectCast<Geode>(obj)) {
+						writeObjectFields<Object>(*geode);
+						writeObjectFields<Node>(*geode);
+						writeObjectFields<Geode>(*geode);
+					} else if (const auto geometry = objectCast<Geometry>(obj)) {
+						writeObjectFields<Object>(*geometry);
+						if (_version >= 154) {
+							writeNodeFields(*geometry, false);
+						}
+						writeObjectFields<Drawable>(*geometry);
+						writeObjectFields<Geometry>(*geometry);
+					} else if (const auto prim = objectCast<PrimitiveSet>(obj)) {
+						writeObjectFields<Object>(*prim);
+						writeObjectFields<PrimitiveSet>(*prim);
+					} else if (const auto stateSet = objectCast<StateSet>(obj)) {
+						writeObjectFields<Object>(*stateSet);
+						writeObjectFields<StateSet>(*stateSet);
+					} else if (const auto material = objectCast<Material>(obj)) {
+						writeObjectFields<Object>(*material);
+						writeObjectFields<StateAttribute>(*material);
+						writeObjectFields<Material>(*material);
+					} else if (const auto texture = objectCast<Texture2D>(obj)) {
+						writeObjectFields<Object>(*texture);
+						writeObjectFields<StateAttribute>(*texture);
+						writeObjectFields<Texture>(*texture);
+						writeObjectFields<Texture2D>(*texture);
+					} else if (const auto arr = objectCast<Array>(obj)) {
+						writeObjectFields<Object>(*arr);
+						writeObjectFields<Array>(*arr);
+					}
+				}
+				WriteEndBracket();
+			}
+
+			std::string classNameOf(const Object* obj) const {
+				if (objectCast<PrimitiveSet>(obj)) {
+					// the generic primitive sets of pre-112 files carry 32-bit indices as well
+					return "osg::DrawElementsUInt";
+				}
+				if (const auto arr = objectCast<Array>(obj)) {
+					if (arr->arrayType == Array::ArrayType::Vec4f) {
+						throw Error("unsupported object class: osg::Vec4Array");
+					}
+				}
+				if (objectCast<LOD>(obj) && !objectCast<PagedLOD>(obj)) {
+					throw Error("unsupported object class: osg::LOD");
+				}
+				if (!objectCast<PagedLOD>(obj) && !objectCast<Group>(obj) && !objectCast<Geode>(obj)
+					&& !objectCast<Geometry>(obj) && !objectCast<StateSet>(obj) && !objectCast<Material>(obj)
+					&& !objectCast<Texture2D>(obj) && !objectCast<Array>(obj)) {
+					throw Error(std::string("unsupported object class: ") + obj->className());
+				}
+				return std::string("osg::") + obj->className();
+			}
+
+			template<typename T> void writeObjectFields(const T& obj) { writeObjectFields(static_cast<const T&>(obj)); }
+
+			void writeNodeFields(const Node& obj, bool withStateSet) {
+				write(false); // InitialBound
+				write(false); // computeBoundCallback
+				write(false); // updateCallback
+				write(false); // eventCallback
+				write(false); // cullCallback
+				write(true); // cullingActive
+				write(0xFFFFFFFFu); // nodeMask
+				if (_version < 77) {
+					write(false); // descriptions
+				}
+				writeObjectIfValid(withStateSet ? obj.stateSet.get() : nullptr);
+			}
+
+			void writeArray(const Array* arr) {
+				// InputStream::readArray() layout of pre-112 geometries
+				write(arr != nullptr);
+				if (arr == nullptr) {
+					return;
+				}
+				unsigned int id;
+				const auto written = findOrCreateId(arr, &id);
+				write(id);
+				if (written) {
+					return;
+				}
+				switch (arr->arrayType) {
+					case Array::ArrayType::Vec2f: write(15); break; // ID_VEC2_ARRAY
+					case Array::ArrayType::Vec3f: write(16); break; // ID_VEC3_ARRAY
+					case Array::ArrayType::Vec4f: write(17); break; // ID_VEC4_ARRAY
+					default: throw Error("unsupported array type");
+				}
+				write(arr->elementCount);
+				writeBytes(arr->elementData, size_t(arr->elementCount) * arr->elementSize);
+				write(false); // hasIndices
+				write(arr->binding);
+				write((unsigned int)arr->normalize);
+			}
+
+			void writeBracketedArray(const Array* arr) {
+				write(arr != nullptr);
+				if (arr) {
+					WriteBeginBracket();
+					writeArray(arr);
+					WriteEndBracket();
+				}
+			}
+
+			void writeImage(const Image* image) {
+				// OutputStream::writeImage() https://github.com/openscenegraph/OpenSceneGraph/blob/OpenSceneGraph-3.6/src/osgDB/OutputStream.cpp
+				write(image != nullptr);
+				if (image == nullptr) {
+					return;
+				}
+				if (_version > 94) {
+					write(std::string("osg::Image"));
+				}
+				unsigned int id;
+				const auto written = findOrCreateId(image, &id);
+				write(id);
+				if (written) {
+					return;
+				}
+				write(std::string()); // name
+				write(0u); // writeHint
+				write(1u); // IMAGE_INLINE_FILE
+				write(image->dataLength);
+				writeBytes(image->data, image->dataLength);
+				writeObjectFields<Object>(*image);
+			}
+
+			void writeHeader() {
+				write(0x1AFB45456C910EA1ll);
+				write(1u); // Scene
+				write(_version);
+				write(_useBinaryBrackets ? 0x04u : 0u);
+				write(std::string("0")); // no compressor
+			}
+
+			void writeObjectFields(const Object&) {
+				write(std::string()); // name
+				write(2u); // dataVariance: UNSPECIFIED
+				if (_version < 77) {
+					writeObject(nullptr); // UserData
+				} else {
+					write(false); // UserDataContainer
+				}
+			}
+
+			void writeObjectFields(const Node& obj) {
+				writeNodeFields(obj, true);
+			}
+
+			void writeObjectFields(const Group& obj) {
+				write(!obj.children.empty());
+				if (!obj.children.empty()) {
+					write((unsigned int)obj.children.size());
+					WriteBeginBracket();
+					for (const auto& child : obj.children) {
+						writeObject(child.get());
+					}
+					WriteEndBracket();
+				}
+			}
+
+			void writeObjectFields(const LOD& obj) {
+				write(obj.centerMode);
+				const auto userDefined = (obj.userDefinedRadius != 0);
+				write(userDefined);
+				if (userDefined) {
+					write(obj.userDefinedCenter);
+					write(obj.userDefinedRadius);
+				}
+				write(obj.rangeMode);
+				write(!obj.rangeList.empty());
+				if (!obj.rangeList.empty()) {
+					write((unsigned int)obj.rangeList.size());
+					WriteBeginBracket();
+					for (const auto& range : obj.rangeList) {
+						write(range.min);
+						write(range.max);
+					}
+					WriteEndBracket();
+				}
+			}
+
+			void writeObjectFields(const PagedLOD& obj) {
+				write(true);
+				write(false); // hasDatabasePath
+				if (_version < 70) {
+					write(0u); // frameNumberOfLastTraversal
+				}
+				write(0u); // numChildrenThatCannotBeExpired
+				write(false); // disableExternalChildrenPaging
+				write(!obj.rangeDataList.empty());
+				if (!obj.rangeDataList.empty()) {
+					write((unsigned int)obj.rangeDataList.size());
+					WriteBeginBracket();
+					for (const auto& rangeData : obj.rangeDataList) {
+						write(rangeData.filename);
+					}
+					WriteEndBracket();
+					write((unsigned int)obj.rangeDataList.size());
+					WriteBeginBracket();
+					for (const auto& rangeData : obj.rangeDataList) {
+						write(rangeData.priorityOffset);
+						write(rangeData.priorityScale);
+					}
+					WriteEndBracket();
+				}
+				writeObjectFields<Group>(obj);
+			}
+
+			void writeObjectFields(const Geode& obj) {
+				write(!obj.drawables.empty());
+				if (!obj.drawables.empty()) {
+					write((unsigned int)obj.drawables.size());
+					WriteBeginBracket();
+					for (const auto& drawable : obj.drawables) {
+						writeObject(drawable.get());
+					}
+					WriteEndBracket();
+				}
+			}
+
+			void writeObjectFields(const Drawable& obj) {
+				writeObjectIfValid(obj.stateSet.get());
+				write(false); // InitialBound
+				write(false); // computeBoundingBoxCallback
+				write(false); // shape
+				write(false); // supportsDisplayList
+				write(false); // useDisplayList
+				write(true); // useVertexBufferObjects
+				write(false); // updateCallback
+				write(false); // eventCallback
+				write(false); // cullCallback
+				write(false); // drawCallback
+			}
+
+			void writeObjectFields(const PrimitiveSet& obj) {
+				write(0); // NumInstances
+				write(obj.mode);
+				write(obj.indexCount);
+				writeBytes(obj.indexData, size_t(obj.indexCount) * sizeof(unsigned int));
+			}
+
+			void writeObjectFields(const Geometry& obj) {
+				if (_version < 112) {
+					// the list holds the primitive sets inline, with no null marker: a null read from 112+ is dropped
+					write((unsigned int)std::count_if(obj.primitives.begin(), obj.primitives.end(), [](const Ref<PrimitiveSet>& prim) { return bool(prim); }));
+					WriteBeginBracket();
+					for (const auto& prim : obj.primitives) {
+						if (!prim) {
+							continue;
+						}
+						write(0u); // NumInstances
+						write(prim->mode);
+						write(prim->indexCount);
+						writeBytes(prim->indexData, size_t(prim->indexCount) * sizeof(unsigned int));
+					}
+					WriteEndBracket();
+					writeBracketedArray(obj.vertexData.get());
+					writeBracketedArray(obj.normalData.get());
+					writeBracketedArray(obj.colorData.get());
+					writeBracketedArray(obj.secondaryColorData.get());
+					writeBracketedArray(obj.fogCoordData.get());
+					write(!obj.texCoordDataList.empty());
+					if (!obj.texCoordDataList.empty()) {
+						write((unsigned int)obj.texCoordDataList.size());
+						WriteBeginBracket();
+						for (const auto& texCoordData : obj.texCoordDataList) {
+							WriteBeginBracket();
+							writeArray(texCoordData.get());
+							WriteEndBracket();
+						}
+						WriteEndBracket();
+					}
+					write(false); // VertexAttribData
+					write(false); // FastPathHint
+				} else {
+					write((unsigned int)obj.primitives.size());
+					for (const auto& prim : obj.primitives) {
+						writeObject(prim.get());
+					}
+					writeObjectIfValid(obj.vertexData.get());
+					writeObjectIfValid(obj.normalData.get());
+					writeObjectIfValid(obj.colorData.get());
+					writeObjectIfValid(obj.secondaryColorData.get());
+					writeObjectIfValid(obj.fogCoordData.get());
+					write((unsigned int)obj.texCoordDataList.size());
+					for (const auto& texCoordData : obj.texCoordDataList) {
+						writeObject(texCoordData.get());
+					}
+					write(0u); // VertexAttribData
+				}
+			}
+
+			void writeObjectFields(const StateSet& obj) {
+				const auto writeModes = [this](const StateSet::ModeList& modes) {
+					write((unsigned int)modes.size());
+					WriteBeginBracket();
+					for (const auto& mode : modes) {
+						write(mode.first);
+						write(mode.second);
+					}
+					WriteEndBracket();
+				};
+				const auto writeAttributes = [this](const StateSet::AttributeList& attributes) {
+					write((unsigned int)attributes.size());
+					WriteBeginBracket();
+					for (const auto& attribute : attributes) {
+						writeObject(attribute.first.get());
+						write(attribute.second);
+					}
+					WriteEndBracket();
+				};
+				write(!obj.modes.empty());
+				if (!obj.modes.empty()) {
+					writeModes(obj.modes);
+				}
+				write(!obj.attributes.empty());
+				if (!obj.attributes.empty()) {
+					writeAttributes(obj.attributes);
+				}
+				write(!obj.textureModesList.empty());
+				if (!obj.textureModesList.empty()) {
+					write((unsigned int)obj.textureModesList.size());
+					WriteBeginBracket();
+					for (const auto& modes : obj.textureModesList) {
+						writeModes(modes);
+					}
+					WriteEndBracket();
+				}
+				write(!obj.textureAttributesList.empty());
+				if (!obj.textureAttributesList.empty()) {
+					write((unsigned int)obj.textureAttributesList.size());
+					WriteBeginBracket();
+					for (const auto& attributes : obj.textureAttributesList) {
+						writeAttributes(attributes);
+					}
+					WriteEndBracket();
+				}
+				write(false); // UniformList
+				write(obj.renderingHint);
+				write(0u); // renderBinMode: INHERIT_RENDERBIN_DETAILS
+				write(0u); // binNumber
+				write(std::string()); // binName
+				write(false); // nestRenderBins
+				write(false); // updateCallback
+				write(false); // eventCallback
+				if (_version >= 151) {
+					write(false); // DefineList
+				}
+			}
+
+			void writeObjectFields(const StateAttribute&) {
+				write(false); // updateCallback
+				write(false); // eventCallback
+			}
+
+			void writeObjectFields(const Material& obj) {
+				write(0u); // colorMode: OFF
+				const auto writeProperty = [this](const auto& property) {
+					write(true);
+					write(property.frontAndBack);
+					write(property.front);
+					write(property.back);
+				};
+				writeProperty(obj.ambient);
+				writeProperty(obj.diffuse);
+				writeProperty(obj.specular);
+				writeProperty(obj.emission);
+				writeProperty(obj.shininess);
+			}
+
+			void writeObjectFields(const Texture& obj) {
+				write(true); write(obj.wrapS);
+				write(true); write(obj.wrapT);
+				write(true); write(obj.wrapR);
+				write(true); write(0x2703u); // minFilter: GL_LINEAR_MIPMAP_LINEAR
+				write(true); write(0x2601u); // magFilter: GL_LINEAR
+				write(1.0f); // maxAnisotropy
+				write(true); // useHardwareMipMapGeneration
+				write(false); // unRefImageDataAfterApply
+				write(false); // clientStorageHint
+				write(true); // resizeNonPowerOfTwoHint
+				const double borderColor[4] = { 0, 0, 0, 0 };
+				writeBytes(borderColor, sizeof(borderColor));
+				write(0); // borderWidth
+				write(0); // internalFormatMode: USE_IMAGE_DATA_FORMAT
+				write(false); // internalFormat
+				write(false); // sourceFormat
+				write(false); // sourceType
+				write(false); // shadowComparison
+				write(0x0203u); // shadowComparisonFunc: GL_LEQUAL
+				write(0x1909u); // shadowTextureMode: GL_LUMINANCE
+				write(0.0f); // shadowAmbient
+				if ((_version >= 95) && (_version < 154)) {
+					write(false); // ImageAttachment
+				}
+				if (_version >= 98) {
+					write(false); // Swizzle
+				}
+				if (_version >= 155) {
+					write(0.0f); // minLOD
+					write(-1.0f); // maxLOD
+					write(0.0f); // lodBias
+				}
+			}
+
+			void writeObjectFields(const Texture2D& obj) {
+				writeImage(obj.image.get());
+				write(0u); // textureWidth
+				write(0u); // textureHeight
+			}
+
+			void writeObjectFields(const Array& obj) {
+				write(obj.binding);
+				write(obj.normalize);
+				write(true); // PreserveDataType
+				write(obj.elementCount);
+				writeBytes(obj.elementData, size_t(obj.elementCount) * obj.elementSize);
+			}
+		};
+
+	}
+
+	// Encodes `data` as an OSGB stream. Only the classes Data::read() understands can be written.
+	inline bool writeOsgb(const Data& data, const WriteSink& sink, const WriteOptions& options = {}, std::string* error = nullptr) {
+		try {
+			if (!data.rootObject) {
+				throw details::Writer::Error("no root object");
+			}
+			details::Writer measure(options, nullptr);
+			measure.writeHeader();
+			measure.writeObject(data.rootObject.get());
+
+			details::Writer writer(options, &sink);
+			writer._bracketSizes = std::move(measure._bracketSizes);
+			writer.writeHeader();
+			writer.writeObject(data.rootObject.get());
+			writer.flush();
+			return true;
+		} catch (const std::exception& ex) {
+			if (error) {
+				*error = std::string("miniosgb writer error: ") + ex.what();
+			}
+			return false;
+		}
+	}
+
+	inline bool writeOsgb(const Data& data, const char* filename, const WriteOptions& options = {}, std::string* error = nullptr) {
+		FILE* file = details::openFile(filename, "wb");
+		if (file == nullptr) {
+			if (error) {
+				*error = std::string("can't open file: ") + filename;
+			}
+			return false;
+		}
+		const auto ok = writeOsgb(data, [file](const unsigned char* bytes, size_t size) {
+			return fwrite(bytes, 1, size, file) == size;
+		}, options, error);
+		if ((fclose(file) != 0) && ok) {
+			if (error) {
+				*error = std::string("can't write file: ") + filename;
+			}
+			return false;
+		}
+		return ok;
+	}
+};
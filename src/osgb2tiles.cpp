@@ -0,0 +1,116 @@
+#include "miniosgb_3dtiles.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+// Parses `count` comma separated numbers.
+static bool ParseNumbers(const std::string& text, double* values, int count)
+{
+	const char* p = text.c_str();
+	for (int i = 0; i < count; ++i) {
+		char* end = nullptr;
+		values[i] = strtod(p, &end);
+		if (end == p) {
+			return false;
+		}
+		p = end;
+		while ((*p == ',') || (*p == ' ')) {
+			++p;
+		}
+	}
+	return true;
+}
+
+// Reads the georeference of a Smart3D/ContextCapture metadata.xml. Only ENU SRS can be placed without a projection library.
+static bool ReadMetadata(const std::filesystem::path& filename, miniosgb::TilesetOptions& options)
+{
+	std::ifstream file(filename);
+	if (!file) {
+		return false;
+	}
+	std::stringstream content;
+	content << file.rdbuf();
+	const auto xml = content.str();
+	const auto element = [&xml](const char* name) {
+		const auto open = std::string("<") + name + ">";
+		const auto begin = xml.find(open);
+		if (begin == std::string::npos) {
+			return std::string();
+		}
+		const auto end = xml.find("</", begin);
+		return xml.substr(begin + open.size(), (end == std::string::npos) ? std::string::npos : end - begin - open.size());
+	};
+
+	const auto srs = element("SRS");
+	double latLon[2] = { 0, 0 };
+	if ((srs.compare(0, 4, "ENU:") != 0) || !ParseNumbers(srs.substr(4), latLon, 2)) {
+		printf("warning: SRS \"%s\" is not supported, tileset left in local coordinates\n", srs.c_str());
+		return false;
+	}
+	double origin[3] = { 0, 0, 0 };
+	ParseNumbers(element("SRSOrigin"), origin, 3);
+	options.transform = miniosgb::enuTransform(latLon[0], latLon[1], 0);
+	// the tiles are relative to SRSOrigin, given in the ENU frame
+	for (int r = 0; r < 3; ++r) {
+		options.transform[12 + r] += options.transform[r] * origin[0] + options.transform[4 + r] * origin[1] + options.transform[8 + r] * origin[2];
+	}
+	return true;
+}
+
+int main(int argc, char** argv)
+{
+	if (argc < 3) {
+		printf("  Usage:\n");
+		printf("    osgb2tiles <project dir | Data dir> <output dir> [-glb] [-j <threads>] [-sse <max screen space error>] [-trace <json>]\n");
+		printf("\n");
+		return 0;
+	}
+
+	miniosgb::TilesetOptions options;
+	const char* traceFile = nullptr;
+	for (int i = 3; i < argc; ++i) {
+		if (strcmp(argv[i], "-glb") == 0) {
+			options.format = miniosgb::TilesetOptions::Format::Glb;
+		} else if ((strcmp(argv[i], "-j") == 0) && (i + 1 < argc)) {
+			options.convertThreads = (unsigned int)atoi(argv[++i]);
+		} else if ((strcmp(argv[i], "-sse") == 0) && (i + 1 < argc)) {
+			options.maxScreenSpaceError = atof(argv[++i]);
+		} else if ((strcmp(argv[i], "-trace") == 0) && (i + 1 < argc)) {
+			traceFile = argv[++i];
+		} else {
+			printf("FAILED: unknown option %s\n", argv[i]);
+			return 1;
+		}
+	}
+
+	std::filesystem::path dataDir = argv[1];
+	if (std::filesystem::is_directory(dataDir / "Data")) {
+		dataDir /= "Data";
+	}
+	ReadMetadata(dataDir.parent_path() / "metadata.xml", options);
+
+	miniosgb::TilesetStats stats;
+	std::string error;
+	const bool ok = miniosgb::convertTo3dTiles(dataDir.string(), argv[2], options, &stats, &error);
+	const auto seconds = (stats.seconds > 0) ? stats.seconds : 1e-9;
+	printf("%zu tiles, %zu failed, %.3f s, %.1f tiles/s, read %.1f MB/s, write %.1f MB/s\n",
+		stats.tiles, stats.failed, stats.seconds, stats.tiles / seconds,
+		stats.bytesRead / seconds / 1e6, stats.bytesWritten / seconds / 1e6);
+	if (traceFile) {
+		if (!miniosgb::trace::compiledIn()) {
+			printf("warning: built without MINIOSGB_TRACE, the trace is empty\n");
+		}
+		const auto json = miniosgb::trace::chromeTraceJson();
+		std::string traceError;
+		if (!miniosgb::writeFile(traceFile, { { json.data(), json.size() } }, &traceError)) {
+			printf("FAILED: %s\n", traceError.c_str());
+		}
+	}
+	if (!ok) {
+		printf("FAILED: %s\n", error.c_str());
+		return 1;
+	}
+	return 0;
+}
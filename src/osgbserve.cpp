@@ -0,0 +1,60 @@
+#include "miniosgb_server.h"
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+int main(int argc, char** argv)
+{
+	if (argc < 2) {
+		printf("  Usage:\n");
+		printf("    osgbserve <project dir | Data dir> [-address <ip>] [-port <port>] [-j <threads>] [-cache <MB>]\n");
+		printf("      GET /tiles/<path>.osgb, /tiles/<path>.glb, /manifest?prefix=<path prefix>\n");
+		printf("\n");
+		return 0;
+	}
+
+	miniosgb::ServerOptions options;
+	std::filesystem::path dataDir = argv[1];
+	if (std::filesystem::is_directory(dataDir / "Data")) {
+		dataDir /= "Data";
+	}
+	options.root = dataDir.string();
+	for (int i = 2; i < argc; ++i) {
+		const auto hasValue = (i + 1 < argc);
+		if ((strcmp(argv[i], "-address") == 0) && hasValue) {
+			options.address = argv[++i];
+		} else if ((strcmp(argv[i], "-port") == 0) && hasValue) {
+			options.port = (unsigned short)atoi(argv[++i]);
+		} else if ((strcmp(argv[i], "-j") == 0) && hasValue) {
+			options.threads = (unsigned int)atoi(argv[++i]);
+		} else if ((strcmp(argv[i], "-cache") == 0) && hasValue) {
+			options.cache.capacity = size_t(atoi(argv[++i])) << 20;
+		} else {
+			printf("FAILED: unknown option %s\n", argv[i]);
+			return 1;
+		}
+	}
+
+	// served until SIGINT or SIGTERM
+	sigset_t signals;
+	sigemptyset(&signals);
+	sigaddset(&signals, SIGINT);
+	sigaddset(&signals, SIGTERM);
+	pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+
+	miniosgb::TileServer server(options);
+	std::string error;
+	if (!server.start(&error)) {
+		printf("FAILED: %s\n", error.c_str());
+		return 1;
+	}
+	printf("serving %s on http://%s:%u/\n", options.root.c_str(), options.address.c_str(), (unsigned int)server.port());
+	fflush(stdout);
+	int signal = 0;
+	sigwait(&signals, &signal);
+	server.stop();
+	const auto stats = server.cacheStatistics();
+	printf("glb cache: %zu hits, %zu misses, %zu coalesced, %zu evictions\n", stats.hits, stats.misses, stats.coalesced, stats.evictions);
+	return 0;
+}
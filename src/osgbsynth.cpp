@@ -0,0 +1,55 @@
+#include "miniosgb_synth.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+int main(int argc, char** argv)
+{
+	if (argc < 2) {
+		printf("  Usage:\n");
+		printf("    osgbsynth <output dir> [-version <osgb version>] [-brackets 0|1] [-tiles <x> <y>] [-depth <levels>]\n");
+		printf("              [-triangles <per geometry>] [-geometries <per tile>] [-texture <size, 0 for none>] [-share 0|1] [-j <threads>]\n");
+		printf("\n");
+		return 0;
+	}
+
+	miniosgb::SynthOptions options;
+	for (int i = 2; i < argc; ++i) {
+		const auto hasValue = (i + 1 < argc);
+		if ((strcmp(argv[i], "-version") == 0) && hasValue) {
+			options.write.version = (unsigned int)atoi(argv[++i]);
+		} else if ((strcmp(argv[i], "-brackets") == 0) && hasValue) {
+			options.write.useBinaryBrackets = (atoi(argv[++i]) != 0);
+		} else if ((strcmp(argv[i], "-tiles") == 0) && (i + 2 < argc)) {
+			options.tilesX = (unsigned int)atoi(argv[++i]);
+			options.tilesY = (unsigned int)atoi(argv[++i]);
+		} else if ((strcmp(argv[i], "-depth") == 0) && hasValue) {
+			options.depth = (unsigned int)atoi(argv[++i]);
+		} else if ((strcmp(argv[i], "-triangles") == 0) && hasValue) {
+			options.trianglesPerGeometry = (unsigned int)atoi(argv[++i]);
+		} else if ((strcmp(argv[i], "-geometries") == 0) && hasValue) {
+			options.geometriesPerTile = (unsigned int)atoi(argv[++i]);
+		} else if ((strcmp(argv[i], "-texture") == 0) && hasValue) {
+			options.textureSize = (unsigned int)atoi(argv[++i]);
+		} else if ((strcmp(argv[i], "-share") == 0) && hasValue) {
+			options.shareObjects = (atoi(argv[++i]) != 0);
+		} else if ((strcmp(argv[i], "-j") == 0) && hasValue) {
+			options.threads = (unsigned int)atoi(argv[++i]);
+		} else {
+			printf("FAILED: unknown option %s\n", argv[i]);
+			return 1;
+		}
+	}
+
+	miniosgb::SynthStats stats;
+	std::string error;
+	const bool ok = miniosgb::synthesizeDataset(argv[1], options, &stats, &error);
+	const auto seconds = (stats.seconds > 0) ? stats.seconds : 1e-9;
+	printf("%zu files, %.1f MB, %.3f s, %.1f files/s, %.1f MB/s\n",
+		stats.files, stats.bytes / 1e6, stats.seconds, stats.files / seconds, stats.bytes / seconds / 1e6);
+	if (!ok) {
+		printf("FAILED: %s\n", error.c_str());
+		return 1;
+	}
+	return 0;
+}
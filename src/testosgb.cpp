@@ -1,10 +1,23 @@
 ﻿#include "miniosgb.h"
+#include "miniosgb_io.h"
+#include "miniosgb_loader.h"
+#include "miniosgb_parallel.h"
+#include <algorithm>
 #include <cstdio>
+#include <cstdlib>
+#include <cstring>
 #include <memory>
 #include <unordered_set>
 #include <filesystem>
+#include <chrono>
+#include <map>
+#include <mutex>
 
 void ReadFile(const char* filename, bool dump);
+void ValidateFiles(const std::filesystem::path& dir, unsigned int threads, const miniosgb::ReadOptions& options, bool batch);
+void PrintStatistics(const miniosgb::ReadStatistics& statistics);
+void WriteTrace(const char* filename);
+void PrintMemoryUsage(const miniosgb::MemoryUsage& usage, const char* title = "memory");
 
 int main(int argc, char** argv)
 {
@@ -12,9 +25,42 @@ int main(int argc, char** argv)
 		printf("  Usage:\n");
 		printf("    Dump OSGB file :  testosgb <file>\n");
 		printf("    Test OSGB files:  testosgb <dir>\n");
+		printf("    Test in parallel: testosgb -j <threads> [-stats] [-tsc] [-intern] [-batch] [-trace <json>] <dir>   (0 threads: one per core)\n");
+		printf("                      -stats: objects, bytes and parse time per class; -tsc: time with the TSC\n");
+		printf("                      -intern: share identical materials and state sets across files, and count state classes\n");
+		printf("                      -batch: read with io_uring where available instead of memory mapping\n");
+		printf("                      -trace: Chrome trace of the run, with MINIOSGB_TRACE builds\n");
 		printf("\n");
 		return 0;
 	}
+
+	if ((strcmp(argv[1], "-j") == 0) && (argc >= 4)) {
+		miniosgb::ReadOptions options;
+		const char* traceFile = nullptr;
+		bool batch = false;
+		for (int i = 3; i + 1 < argc; ++i) {
+			if ((strcmp(argv[i], "-trace") == 0) && (i + 2 < argc)) {
+				traceFile = argv[++i];
+			} else if (strcmp(argv[i], "-stats") == 0) {
+				options.collectStatistics = true;
+			} else if (strcmp(argv[i], "-tsc") == 0) {
+				options.collectStatistics = true;
+				options.useTsc = true;
+			} else if (strcmp(argv[i], "-intern") == 0) {
+				options.interner = &miniosgb::StateInterner::global();
+			} else if (strcmp(argv[i], "-batch") == 0) {
+				batch = true;
+			} else {
+				printf("FAILED: unknown option %s\n", argv[i]);
+				return 1;
+			}
+		}
+		ValidateFiles(argv[argc - 1], (unsigned int)atoi(argv[2]), options, batch);
+		if (traceFile) {
+			WriteTrace(traceFile);
+		}
+		return 0;
+	}
 	
 	const std::filesystem::path path = argv[1];
 	if (std::filesystem::is_directory(path)) {
@@ -34,37 +80,252 @@ int main(int argc, char** argv)
 
 void DumpObject(miniosgb::Object* obj, int level = 0);
 
+// Reader errors carry the offset they occurred at, and I/O errors the file name; leave both out so equal failures group.
+std::string FailureKind(const std::string& error)
+{
+	const auto at = error.find(" at offset ");
+	if (at != std::string::npos) {
+		const auto colon = error.find(": ", at);
+		return error.substr(0, at) + ((colon != std::string::npos) ? error.substr(colon) : std::string());
+	}
+	if (error.compare(0, 6, "can't ") == 0) {
+		return error.substr(0, error.find(": "));
+	}
+	return error;
+}
+
+// Parses every .osgb under `dir` on a thread pool. Files are memory mapped and each worker reuses its mapping
+// object, or with `batch` they are read by loadFiles(); results are printed in file order through one buffered
+// stream, followed by a summary.
+void ValidateFiles(const std::filesystem::path& dir, unsigned int threads, const miniosgb::ReadOptions& options, bool batch)
+{
+	struct Result {
+		bool done = false;
+		bool ok = false;
+		size_t bytes = 0;
+		double seconds = 0;
+		std::string error;
+	};
+	const auto files = miniosgb::findFiles(dir.string());
+	threads = miniosgb::defaultThreadCount(threads);
+	std::vector<Result> results(files.size());
+	std::vector<miniosgb::MappedFile> mappings(threads);
+	std::vector<miniosgb::ReadStatistics> statistics(threads);
+	std::vector<miniosgb::MemoryUsage> memory(threads);
+	std::mutex outputMutex;
+	std::string output;
+	size_t nextOutput = 0;
+
+	const auto parse = [&](Result& result, const unsigned char* buffer, size_t length, unsigned int worker) {
+		result.bytes = length;
+		const auto data = miniosgb::Data::read(buffer, length, options, &result.error);
+		result.ok = data && data->rootObject;
+		if (data && options.interner) {
+			data->objects.forEach([&](miniosgb::Object* obj) {
+				if (const auto stateSet = miniosgb::objectCast<miniosgb::StateSet>(obj)) {
+					options.interner->stateClassOf(*stateSet);
+				}
+			});
+		}
+		if (data && options.collectStatistics) {
+			statistics[worker].merge(data->statistics);
+			memory[worker].merge(data->memoryUsage());
+		}
+		if (!result.ok && result.error.empty()) {
+			result.error = "no root object, or data after it";
+		}
+	};
+	const auto report = [&](Result& result) {
+		std::lock_guard<std::mutex> lock(outputMutex);
+		result.done = true;
+		for (; (nextOutput < results.size()) && results[nextOutput].done; ++nextOutput) {
+			const auto& r = results[nextOutput];
+			output += "read " + files[nextOutput] + (r.ok ? " OK\n" : " FAILED: " + r.error + "\n");
+		}
+		if (output.size() >= 65536) {
+			fwrite(output.data(), 1, output.size(), stdout);
+			output.clear();
+		}
+	};
+
+	const auto start = std::chrono::steady_clock::now();
+	if (batch) {
+		// latency of a file: from its read completing to its parse completing
+		miniosgb::LoadOptions loadOptions;
+		loadOptions.threads = threads;
+		miniosgb::loadFiles(files, loadOptions, [&](const miniosgb::LoadedFile& file, unsigned int worker) {
+			auto& result = results[file.index];
+			const auto fileStart = std::chrono::steady_clock::now();
+			result.error = file.error;
+			if (file.error.empty()) {
+				parse(result, file.data, file.size, worker);
+			}
+			result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - fileStart).count();
+			report(result);
+		});
+	} else {
+		miniosgb::parallelFor(files.size(), threads, [&](size_t i, unsigned int worker) {
+			auto& result = results[i];
+			const auto fileStart = std::chrono::steady_clock::now();
+			auto& mapping = mappings[worker];
+			if (mapping.open(files[i].c_str(), &result.error)) {
+				parse(result, mapping.data(), mapping.size(), worker);
+			}
+			mapping.close();
+			result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - fileStart).count();
+			report(result);
+		});
+	}
+	fwrite(output.data(), 1, output.size(), stdout);
+	const auto seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	size_t bytes = 0;
+	std::map<std::string, size_t> failures;
+	std::vector<size_t> histogram; // bucket b: latency in [2^b, 2^(b+1)) microseconds
+	for (const auto& result : results) {
+		bytes += result.bytes;
+		if (!result.ok) {
+			++failures[FailureKind(result.error)];
+		}
+		size_t bucket = 0;
+		for (auto us = (unsigned long long)(result.seconds * 1e6); us > 1; us >>= 1) {
+			++bucket;
+		}
+		if (histogram.size() <= bucket) {
+			histogram.resize(bucket + 1);
+		}
+		++histogram[bucket];
+	}
+	size_t failed = 0;
+	for (const auto& failure : failures) {
+		failed += failure.second;
+	}
+
+	const auto elapsed = (seconds > 0) ? seconds : 1e-9;
+	printf("\n%zu files, %zu OK, %zu FAILED, %d threads%s\n", files.size(), files.size() - failed, failed, (int)threads,
+		!batch ? "" : miniosgb::ioUringAvailable() ? ", io_uring" : ", blocking reads");
+	printf("%.3f s, %.1f files/s, %.1f MB/s\n", seconds, files.size() / elapsed, bytes / elapsed / 1e6);
+	if (!failures.empty()) {
+		std::vector<std::pair<size_t, std::string>> sorted;
+		for (const auto& failure : failures) {
+			sorted.emplace_back(failure.second, failure.first);
+		}
+		std::sort(sorted.begin(), sorted.end(), [](const auto& a, const auto& b) { return a.first > b.first; });
+		printf("failures:\n");
+		for (const auto& failure : sorted) {
+			printf("  %8zu  %s\n", failure.first, failure.second.c_str());
+		}
+	}
+	if (!files.empty()) {
+		size_t peak = 0;
+		for (const auto count : histogram) {
+			peak = std::max(peak, count);
+		}
+		printf("latency per file:\n");
+		size_t first = 0;
+		while (histogram[first] == 0) {
+			++first;
+		}
+		for (size_t b = first; b < histogram.size(); ++b) {
+			printf("  %9llu us - %9llu us  %8zu  %s\n", (b > 0) ? (1ull << b) : 0ull, 2ull << b, histogram[b], std::string((histogram[b] * 40 + peak - 1) / peak, '#').c_str());
+		}
+	}
+	if (options.collectStatistics) {
+		for (size_t i = 1; i < statistics.size(); ++i) {
+			statistics[0].merge(statistics[i]);
+			memory[0].merge(memory[i]);
+		}
+		PrintStatistics(statistics[0]);
+		PrintMemoryUsage(memory[0]);
+	}
+	if (options.interner) {
+		const auto counts = options.interner->counts();
+		printf("shared state: %zu materials, %zu textures, %zu state sets, %zu state classes, %zu bytes; %zu objects replaced\n",
+			counts.materials, counts.textures, counts.stateSets, counts.stateClasses, options.interner->capacity(), counts.hits);
+	}
+}
+
+void WriteTrace(const char* filename)
+{
+	if (!miniosgb::trace::compiledIn()) {
+		printf("warning: built without MINIOSGB_TRACE, the trace is empty\n");
+	}
+	const auto json = miniosgb::trace::chromeTraceJson();
+	std::string error;
+	if (!miniosgb::writeFile(filename, { { json.data(), json.size() } }, &error)) {
+		printf("FAILED: %s\n", error.c_str());
+	}
+}
+
+void PrintMemoryUsage(const miniosgb::MemoryUsage& usage, const char* title)
+{
+	printf("%s:\n", title);
+	printf("  %-34s %12zu\n", "source buffer", usage.sourceBuffer);
+	printf("  %-34s %12zu\n", "  referenced payload", usage.referencedPayload);
+	printf("  %-34s %12zu\n", "detached payload", usage.detached);
+	printf("  %-34s %12zu\n", "objects", usage.objects);
+	printf("  %-34s %12zu\n", "vectors", usage.vectors);
+	printf("  %-34s %12zu\n", "statistics", usage.statistics);
+	printf("  %-34s %12zu\n", "owned by Data", usage.owned());
+}
+
+// Classes by parse time, then the shared reference hits and the version dependent layouts met.
+void PrintStatistics(const miniosgb::ReadStatistics& statistics)
+{
+	unsigned long long bytes = 0, ticks = 0;
+	std::vector<std::pair<std::string, miniosgb::ReadStatistics::Class>> classes(statistics.classes.begin(), statistics.classes.end());
+	for (const auto& c : classes) {
+		bytes += c.second.bytes;
+		ticks += c.second.ticks;
+	}
+	std::sort(classes.begin(), classes.end(), [](const auto& a, const auto& b) { return a.second.ticks > b.second.ticks; });
+	printf("classes:\n");
+	printf("  %-34s %10s %12s %7s %10s %7s %9s\n", "", "objects", "bytes", "", "ms", "", "ns/object");
+	for (const auto& c : classes) {
+		const auto seconds = c.second.ticks / statistics.ticksPerSecond;
+		printf("  %-34s %10zu %12llu %6.1f%% %10.3f %6.1f%% %9.0f\n", c.first.c_str(), c.second.objects, c.second.bytes,
+			100.0 * c.second.bytes / std::max(bytes, 1ull), seconds * 1e3, 100.0 * c.second.ticks / std::max(ticks, 1ull),
+			seconds * 1e9 / std::max<size_t>(c.second.objects, 1));
+	}
+	printf("shared references: %zu objects, %zu arrays, %zu images\n", statistics.objectHits, statistics.arrayHits, statistics.imageHits);
+	printf("version dependent layouts:\n");
+	for (size_t i = 0; i < statistics.branches.size(); ++i) {
+		if (statistics.branches[i] > 0) {
+			printf("  %-34s %10zu\n", miniosgb::ReadStatistics::branchName((miniosgb::ReadStatistics::Branch)i), statistics.branches[i]);
+		}
+	}
+}
+
 void ReadFile(const char* filename, bool dump)
 {
-	printf_s("read %s ", filename);
+	printf("read %s ", filename);
 
-	FILE* file = nullptr;
-	fopen_s(&file, filename, "rb");
-	if (file == nullptr) {
+	std::vector<unsigned char> fileBuf;
+	if (!miniosgb::readFile(filename, fileBuf)) {
 		printf("FAILED: can't open\n");
 		return;
 	}
 
-	fseek(file, 0, SEEK_END);
-	const auto fileLen = ftell(file);
-	const auto fileBuf = std::make_unique<unsigned char[]>((size_t)fileLen);
-	fseek(file, 0, SEEK_SET);
-	fread_s(fileBuf.get(), fileLen, 1, fileLen, file);
-	fclose(file);
-
 	std::string error;
-	const auto data = miniosgb::Data::read(fileBuf.get(), fileLen, &error);
+	miniosgb::ReadOptions options;
+	options.collectStatistics = dump;
+	const auto data = miniosgb::Data::read(fileBuf.data(), fileBuf.size(), options, &error);
 	if (data) {
 		if (data->rootObject) {
-			printf_s("OK\n");
+			printf("OK\n");
 			if (dump) {
 				DumpObject(data->rootObject.get());
+				PrintStatistics(data->statistics);
+				PrintMemoryUsage(data->memoryUsage());
+				data->detach();
+				std::vector<unsigned char>().swap(fileBuf);
+				PrintMemoryUsage(data->memoryUsage(), "memory after detach (positions, texture coordinates, indices)");
 			}
 		} else {
-			printf_s("EMPTY\n");
+			printf("EMPTY\n");
 		}
 	} else {
-		printf_s("FAILED: %s\n", error.c_str());
+		printf("FAILED: %s\n", error.c_str());
 	}
 }
 
@@ -72,182 +333,183 @@ std::unordered_set<miniosgb::Object*> dumpedObjects;
 void DumpObject(miniosgb::Object* obj, int level) {
 	const auto indent = std::string(size_t(level * 2), ' ');
 	if (obj == nullptr) {
-		//printf_s("%sNULL\n", indent.c_str());
-		printf_s("NULL\n");
+		//printf("%sNULL\n", indent.c_str());
+		printf("NULL\n");
 		return;
 	}
 	if (dumpedObjects.find(obj) != dumpedObjects.end()) {
-		printf_s("%s(%d) {...}\n", obj->className(), obj->uniqueId);
+		printf("%s(%d) {...}\n", obj->className(), obj->uniqueId);
 		return;
 	} else {
 		dumpedObjects.insert(obj);
 	}
-	//printf_s("%sObject {\n", indent.c_str());
-	printf_s("%s(%d) {", obj->className(), obj->uniqueId);
-	if (const auto& node = dynamic_cast<miniosgb::Node*>(obj)) {
-		printf_s("\n%s  <Node>\n", indent.c_str());
-		printf_s("%s  StateSet= ", indent.c_str());
+	//printf("%sObject {\n", indent.c_str());
+	printf("%s(%d) {", obj->className(), obj->uniqueId);
+	if (const auto& node = miniosgb::objectCast<miniosgb::Node>(obj)) {
+		printf("\n%s  <Node>\n", indent.c_str());
+		printf("%s  StateSet= ", indent.c_str());
 		DumpObject(node->stateSet.get(), level + 1);
-		printf_s("%s", indent.c_str());
+		printf("%s", indent.c_str());
 	}
-	if (const auto& geode = dynamic_cast<miniosgb::Geode*>(obj)) {
-		printf_s("\n%s  <Geode>\n", indent.c_str());
-		printf_s("%s  Drawables= %zd [\n", indent.c_str(), geode->drawables.size());
+	if (const auto& geode = miniosgb::objectCast<miniosgb::Geode>(obj)) {
+		printf("\n%s  <Geode>\n", indent.c_str());
+		printf("%s  Drawables= %zd [\n", indent.c_str(), geode->drawables.size());
 		for (size_t i = 0, size = geode->drawables.size(); i < size; ++i) {
 			const auto& drawable = geode->drawables[i];
-			printf_s("%s    Drawable %zd: ", indent.c_str(), i);
+			printf("%s    Drawable %zd: ", indent.c_str(), i);
 			if (drawable) {
 				DumpObject(drawable.get(), level + 2);
 			}
 		}
-		printf_s("%s  ]\n", indent.c_str());
-		printf_s("%s", indent.c_str());
+		printf("%s  ]\n", indent.c_str());
+		printf("%s", indent.c_str());
 	}
-	if (const auto& primitiveSet = dynamic_cast<miniosgb::PrimitiveSet*>(obj)) {
-		printf_s("\n%s  <PrimitiveSet>\n", indent.c_str());
-		printf_s("%s  Mode= %d\n", indent.c_str(), primitiveSet->mode);
-		printf_s("%s  IndexCount= %d\n", indent.c_str(), primitiveSet->indexCount);
-		printf_s("%s  IndexData= %p\n", indent.c_str(), primitiveSet->indexData);
-		printf_s("%s", indent.c_str());
+	if (const auto& primitiveSet = miniosgb::objectCast<miniosgb::PrimitiveSet>(obj)) {
+		printf("\n%s  <PrimitiveSet>\n", indent.c_str());
+		printf("%s  Mode= %d\n", indent.c_str(), primitiveSet->mode);
+		printf("%s  IndexCount= %d\n", indent.c_str(), primitiveSet->indexCount);
+		printf("%s  IndexData= %p\n", indent.c_str(), primitiveSet->indexData);
+		printf("%s", indent.c_str());
 	}
-	if (const auto& geometry = dynamic_cast<miniosgb::Geometry*>(obj)) {
-		printf_s("\n%s  <Geometry>\n", indent.c_str());
-		printf_s("%s  Primitives= %zd [\n", indent.c_str(), geometry->primitives.size());
+	if (const auto& geometry = miniosgb::objectCast<miniosgb::Geometry>(obj)) {
+		printf("\n%s  <Geometry>\n", indent.c_str());
+		printf("%s  Primitives= %zd [\n", indent.c_str(), geometry->primitives.size());
 		for (size_t i = 0, size = geometry->primitives.size(); i < size; ++i) {
 			const auto& prim = geometry->primitives[i];
-			printf_s("%s    Primitive %zd: ", indent.c_str(), i);
+			printf("%s    Primitive %zd: ", indent.c_str(), i);
 			DumpObject(prim.get(), level + 2);
 		}
-		printf_s("%s  ]\n", indent.c_str());
-		printf_s("%s  VertexData: ", indent.c_str());
+		printf("%s  ]\n", indent.c_str());
+		printf("%s  VertexData: ", indent.c_str());
 		DumpObject(geometry->vertexData.get(), level + 1);
-		printf_s("%s  TexCoordDataList: %zd [\n", indent.c_str(), geometry->texCoordDataList.size());
+		printf("%s  TexCoordDataList: %zd [\n", indent.c_str(), geometry->texCoordDataList.size());
 		for (size_t i = 0, size = geometry->texCoordDataList.size(); i < size; ++i) {
 			const auto& texCoordData = geometry->texCoordDataList[i];
-			printf_s("%s    TexCoordData %zd: ", indent.c_str(), i);
+			printf("%s    TexCoordData %zd: ", indent.c_str(), i);
 			DumpObject(texCoordData.get(), level + 2);
 		}
-		printf_s("%s  ]\n", indent.c_str());
-		printf_s("%s", indent.c_str());
+		printf("%s  ]\n", indent.c_str());
+		printf("%s", indent.c_str());
 	}
-	if (const auto& group = dynamic_cast<miniosgb::Group*>(obj)) {
-		printf_s("\n%s  <Group>\n", indent.c_str());
-		printf_s("%s  Children= %zd [\n", indent.c_str(), group->children.size());
+	if (const auto& group = miniosgb::objectCast<miniosgb::Group>(obj)) {
+		printf("\n%s  <Group>\n", indent.c_str());
+		printf("%s  Children= %zd [\n", indent.c_str(), group->children.size());
 		for (size_t i = 0, size = group->children.size(); i < size; ++i) {
 			const auto& child = group->children[i];
-			printf_s("%s    Child %zd: ", indent.c_str(), i);
+			printf("%s    Child %zd: ", indent.c_str(), i);
 			DumpObject(child.get(), level + 2);
 		}
-		printf_s("%s  ]\n", indent.c_str());
-		printf_s("%s", indent.c_str());
+		printf("%s  ]\n", indent.c_str());
+		printf("%s", indent.c_str());
 	}
-	if (const auto& lod = dynamic_cast<miniosgb::LOD*>(obj)) {
-		printf_s("\n%s  <LOD>\n", indent.c_str());
-		printf_s("%s  CenterMode= %d\n", indent.c_str(), lod->centerMode);
-		printf_s("%s  UserDefinedCenter= (%f, %f, %f)\n", indent.c_str(), lod->userDefinedCenter.x, lod->userDefinedCenter.y, lod->userDefinedCenter.z);
-		printf_s("%s  UserDefinedRadius= %f\n", indent.c_str(), lod->userDefinedRadius);
-		printf_s("%s  RangeList= %zd [\n", indent.c_str(), lod->rangeList.size());
+	if (const auto& lod = miniosgb::objectCast<miniosgb::LOD>(obj)) {
+		printf("\n%s  <LOD>\n", indent.c_str());
+		printf("%s  CenterMode= %d\n", indent.c_str(), lod->centerMode);
+		printf("%s  RangeMode= %d\n", indent.c_str(), (int)lod->rangeMode);
+		printf("%s  UserDefinedCenter= (%f, %f, %f)\n", indent.c_str(), lod->userDefinedCenter.x, lod->userDefinedCenter.y, lod->userDefinedCenter.z);
+		printf("%s  UserDefinedRadius= %f\n", indent.c_str(), lod->userDefinedRadius);
+		printf("%s  RangeList= %zd [\n", indent.c_str(), lod->rangeList.size());
 		for (size_t i = 0, size = lod->rangeList.size(); i < size; ++i) {
 			const auto& range = lod->rangeList[i];
-			printf_s("%s    RangeList %zd= { Min=%g, Max=%g }\n", indent.c_str(), i, range.min, range.max);
+			printf("%s    RangeList %zd= { Min=%g, Max=%g }\n", indent.c_str(), i, range.min, range.max);
 		}
-		printf_s("%s  ]\n", indent.c_str());
-		printf_s("%s", indent.c_str());
+		printf("%s  ]\n", indent.c_str());
+		printf("%s", indent.c_str());
 	}
-	if (const auto& plod = dynamic_cast<miniosgb::PagedLOD*>(obj)) {
-		printf_s("\n%s  <PagedLOD>\n", indent.c_str());
-		printf_s("%s  RangeDataList= %zd [\n", indent.c_str(), plod->rangeDataList.size());
+	if (const auto& plod = miniosgb::objectCast<miniosgb::PagedLOD>(obj)) {
+		printf("\n%s  <PagedLOD>\n", indent.c_str());
+		printf("%s  RangeDataList= %zd [\n", indent.c_str(), plod->rangeDataList.size());
 		for (size_t i = 0, size = plod->rangeDataList.size(); i < size; ++i) {
-			printf_s("%s    RangeData %zd:\n", indent.c_str(), i);
+			printf("%s    RangeData %zd:\n", indent.c_str(), i);
 			const auto& rangeData = plod->rangeDataList[i];
-			printf_s("%s      Filename= %s\n", indent.c_str(), rangeData.filename.c_str());
-			printf_s("%s      PriorityOffset= %f\n", indent.c_str(), rangeData.priorityOffset);
-			printf_s("%s      PriorityScale= %f\n", indent.c_str(), rangeData.priorityScale);
-		}
-		printf_s("%s  ]\n", indent.c_str());
-		printf_s("%s", indent.c_str());
-	}
-	if (const auto& arr = dynamic_cast<miniosgb::Array*>(obj)) {
-		printf_s("\n%s  <Array>\n", indent.c_str());
-		printf_s("%s  ArrayType= %d\n", indent.c_str(), arr->arrayType);
-		printf_s("%s  ElementSize= %d\n", indent.c_str(), arr->elementSize);
-		printf_s("%s  ElementCount= %d\n", indent.c_str(), arr->elementCount);
-		printf_s("%s  Binding= %d\n", indent.c_str(), arr->binding);
-		printf_s("%s  Normalize= %d\n", indent.c_str(), arr->normalize);
-		printf_s("%s", indent.c_str());
-	}
-	if (const auto& stateSet = dynamic_cast<miniosgb::StateSet*>(obj)) {
-		printf_s("\n%s  <StateSet>\n", indent.c_str());
-		printf_s("%s  RenderingHint= %d\n", indent.c_str(), stateSet->renderingHint);
-		printf_s("%s  Attributes= %zd [\n", indent.c_str(), stateSet->attributes.size());
+			printf("%s      Filename= %.*s\n", indent.c_str(), (int)rangeData.filename.size(), rangeData.filename.data());
+			printf("%s      PriorityOffset= %f\n", indent.c_str(), rangeData.priorityOffset);
+			printf("%s      PriorityScale= %f\n", indent.c_str(), rangeData.priorityScale);
+		}
+		printf("%s  ]\n", indent.c_str());
+		printf("%s", indent.c_str());
+	}
+	if (const auto& arr = miniosgb::objectCast<miniosgb::Array>(obj)) {
+		printf("\n%s  <Array>\n", indent.c_str());
+		printf("%s  ArrayType= %d\n", indent.c_str(), (int)arr->arrayType);
+		printf("%s  ElementSize= %d\n", indent.c_str(), arr->elementSize);
+		printf("%s  ElementCount= %d\n", indent.c_str(), arr->elementCount);
+		printf("%s  Binding= %d\n", indent.c_str(), (int)arr->binding);
+		printf("%s  Normalize= %d\n", indent.c_str(), arr->normalize);
+		printf("%s", indent.c_str());
+	}
+	if (const auto& stateSet = miniosgb::objectCast<miniosgb::StateSet>(obj)) {
+		printf("\n%s  <StateSet>\n", indent.c_str());
+		printf("%s  RenderingHint= %d\n", indent.c_str(), (int)stateSet->renderingHint);
+		printf("%s  Attributes= %zd [\n", indent.c_str(), stateSet->attributes.size());
 		for (size_t i = 0, size = stateSet->attributes.size(); i < size; ++i) {
 			const auto& p = stateSet->attributes[i];
-			printf_s("%s    {\n", indent.c_str());
-			printf_s("%s      Attribute %zd: ", indent.c_str(), i);
+			printf("%s    {\n", indent.c_str());
+			printf("%s      Attribute %zd: ", indent.c_str(), i);
 			DumpObject(p.first.get(), level + 3);
-			printf_s("%s      Value= %d\n", indent.c_str(), p.second);
-			printf_s("%s    }\n", indent.c_str());
+			printf("%s      Value= %d\n", indent.c_str(), p.second);
+			printf("%s    }\n", indent.c_str());
 		}
-		printf_s("%s  ]\n", indent.c_str());
-		printf_s("%s  TextureAttributesList= %zd [\n", indent.c_str(), stateSet->textureAttributesList.size());
+		printf("%s  ]\n", indent.c_str());
+		printf("%s  TextureAttributesList= %zd [\n", indent.c_str(), stateSet->textureAttributesList.size());
 		for (size_t i = 0, size = stateSet->textureAttributesList.size(); i < size; ++i) {
 			const auto& texutreAttributes = stateSet->textureAttributesList[i];
-			printf_s("%s    TextureAttributes %zd= %zd: [\n", indent.c_str(), i, texutreAttributes.size());
+			printf("%s    TextureAttributes %zd= %zd: [\n", indent.c_str(), i, texutreAttributes.size());
 			for (size_t j = 0, size_ = texutreAttributes.size(); j < size_; ++j) {
 				const auto& p = texutreAttributes[j];
-				printf_s("%s      {\n", indent.c_str());
-				printf_s("%s        TextureAttribute %zd: ", indent.c_str(), j);
+				printf("%s      {\n", indent.c_str());
+				printf("%s        TextureAttribute %zd: ", indent.c_str(), j);
 				DumpObject(p.first.get(), level + 4);
-				printf_s("%s        Value= %d\n", indent.c_str(), p.second);
-				printf_s("%s      }\n", indent.c_str());
+				printf("%s        Value= %d\n", indent.c_str(), p.second);
+				printf("%s      }\n", indent.c_str());
 			}
-			printf_s("%s    ]\n", indent.c_str());
-		}
-		printf_s("%s  ]\n", indent.c_str());
-		printf_s("%s", indent.c_str());
-	}
-	if (const auto& material = dynamic_cast<miniosgb::Material*>(obj)) {
-		printf_s("\n%s  <Material>\n", indent.c_str());
-		printf_s("%s    Ambient:\n", indent.c_str());
-		printf_s("%s      FrontAndBack= %d\n", indent.c_str(), material->ambient.frontAndBack);
-		printf_s("%s      Front= (%f, %f, %f, %f)\n", indent.c_str(), material->ambient.front.x, material->ambient.front.y, material->ambient.front.z, material->ambient.front.w);
-		printf_s("%s      Back= (%f, %f, %f, %f)\n", indent.c_str(), material->ambient.back.x, material->ambient.back.y, material->ambient.back.z, material->ambient.back.w);
-		printf_s("%s    Diffuse:\n", indent.c_str());
-		printf_s("%s      FrontAndBack= %d\n", indent.c_str(), material->diffuse.frontAndBack);
-		printf_s("%s      Front= (%f, %f, %f, %f)\n", indent.c_str(), material->diffuse.front.x, material->diffuse.front.y, material->diffuse.front.z, material->diffuse.front.w);
-		printf_s("%s      Back= (%f, %f, %f, %f)\n", indent.c_str(), material->diffuse.back.x, material->diffuse.back.y, material->diffuse.back.z, material->diffuse.back.w);
-		printf_s("%s    Specular:\n", indent.c_str());
-		printf_s("%s      FrontAndBack= %d\n", indent.c_str(), material->specular.frontAndBack);
-		printf_s("%s      Front= (%f, %f, %f, %f)\n", indent.c_str(), material->specular.front.x, material->specular.front.y, material->specular.front.z, material->specular.front.w);
-		printf_s("%s      Back= (%f, %f, %f, %f)\n", indent.c_str(), material->specular.back.x, material->specular.back.y, material->specular.back.z, material->specular.back.w);
-		printf_s("%s    Emission:\n", indent.c_str());
-		printf_s("%s      FrontAndBack= %d\n", indent.c_str(), material->emission.frontAndBack);
-		printf_s("%s      Front= (%f, %f, %f, %f)\n", indent.c_str(), material->emission.front.x, material->emission.front.y, material->emission.front.z, material->emission.front.w);
-		printf_s("%s      Back= (%f, %f, %f, %f)\n", indent.c_str(), material->emission.back.x, material->emission.back.y, material->emission.back.z, material->emission.back.w);
-		printf_s("%s    Shininess:\n", indent.c_str());
-		printf_s("%s      FrontAndBack= %d\n", indent.c_str(), material->shininess.frontAndBack);
-		printf_s("%s      Front= %f\n", indent.c_str(), material->shininess.front);
-		printf_s("%s      Back= %f\n", indent.c_str(), material->shininess.back);
-		printf_s("%s", indent.c_str());
-	}
-	if (const auto& texture = dynamic_cast<miniosgb::Texture*>(obj)) {
-		printf_s("\n%s  <Texture>\n", indent.c_str());
-		printf_s("%s  WrapS= 0x%X\n", indent.c_str(), texture->wrapS);
-		printf_s("%s  WrapT= 0x%X\n", indent.c_str(), texture->wrapT);
-		printf_s("%s  WrapR= 0x%X\n", indent.c_str(), texture->wrapR);
-		printf_s("%s", indent.c_str());
-	}
-	if (const auto& texture2D = dynamic_cast<miniosgb::Texture2D*>(obj)) {
-		printf_s("\n%s  <Texture2D>\n", indent.c_str());
-		printf_s("%s  Image: ", indent.c_str());
+			printf("%s    ]\n", indent.c_str());
+		}
+		printf("%s  ]\n", indent.c_str());
+		printf("%s", indent.c_str());
+	}
+	if (const auto& material = miniosgb::objectCast<miniosgb::Material>(obj)) {
+		printf("\n%s  <Material>\n", indent.c_str());
+		printf("%s    Ambient:\n", indent.c_str());
+		printf("%s      FrontAndBack= %d\n", indent.c_str(), material->ambient.frontAndBack);
+		printf("%s      Front= (%f, %f, %f, %f)\n", indent.c_str(), material->ambient.front.x, material->ambient.front.y, material->ambient.front.z, material->ambient.front.w);
+		printf("%s      Back= (%f, %f, %f, %f)\n", indent.c_str(), material->ambient.back.x, material->ambient.back.y, material->ambient.back.z, material->ambient.back.w);
+		printf("%s    Diffuse:\n", indent.c_str());
+		printf("%s      FrontAndBack= %d\n", indent.c_str(), material->diffuse.frontAndBack);
+		printf("%s      Front= (%f, %f, %f, %f)\n", indent.c_str(), material->diffuse.front.x, material->diffuse.front.y, material->diffuse.front.z, material->diffuse.front.w);
+		printf("%s      Back= (%f, %f, %f, %f)\n", indent.c_str(), material->diffuse.back.x, material->diffuse.back.y, material->diffuse.back.z, material->diffuse.back.w);
+		printf("%s    Specular:\n", indent.c_str());
+		printf("%s      FrontAndBack= %d\n", indent.c_str(), material->specular.frontAndBack);
+		printf("%s      Front= (%f, %f, %f, %f)\n", indent.c_str(), material->specular.front.x, material->specular.front.y, material->specular.front.z, material->specular.front.w);
+		printf("%s      Back= (%f, %f, %f, %f)\n", indent.c_str(), material->specular.back.x, material->specular.back.y, material->specular.back.z, material->specular.back.w);
+		printf("%s    Emission:\n", indent.c_str());
+		printf("%s      FrontAndBack= %d\n", indent.c_str(), material->emission.frontAndBack);
+		printf("%s      Front= (%f, %f, %f, %f)\n", indent.c_str(), material->emission.front.x, material->emission.front.y, material->emission.front.z, material->emission.front.w);
+		printf("%s      Back= (%f, %f, %f, %f)\n", indent.c_str(), material->emission.back.x, material->emission.back.y, material->emission.back.z, material->emission.back.w);
+		printf("%s    Shininess:\n", indent.c_str());
+		printf("%s      FrontAndBack= %d\n", indent.c_str(), material->shininess.frontAndBack);
+		printf("%s      Front= %f\n", indent.c_str(), material->shininess.front);
+		printf("%s      Back= %f\n", indent.c_str(), material->shininess.back);
+		printf("%s", indent.c_str());
+	}
+	if (const auto& texture = miniosgb::objectCast<miniosgb::Texture>(obj)) {
+		printf("\n%s  <Texture>\n", indent.c_str());
+		printf("%s  WrapS= 0x%X\n", indent.c_str(), (unsigned int)texture->wrapS);
+		printf("%s  WrapT= 0x%X\n", indent.c_str(), (unsigned int)texture->wrapT);
+		printf("%s  WrapR= 0x%X\n", indent.c_str(), (unsigned int)texture->wrapR);
+		printf("%s", indent.c_str());
+	}
+	if (const auto& texture2D = miniosgb::objectCast<miniosgb::Texture2D>(obj)) {
+		printf("\n%s  <Texture2D>\n", indent.c_str());
+		printf("%s  Image: ", indent.c_str());
 		DumpObject(texture2D->image.get(), level + 1);
-		printf_s("%s", indent.c_str());
+		printf("%s", indent.c_str());
 	}
-	if (const auto& image = dynamic_cast<miniosgb::Image*>(obj)) {
-		printf_s("\n%s  <Image>\n", indent.c_str());
-		printf_s("%s  Data= %p\n", indent.c_str(), image->data);
-		printf_s("%s  DataLength= %d\n", indent.c_str(), image->dataLength);
-		printf_s("%s", indent.c_str());
+	if (const auto& image = miniosgb::objectCast<miniosgb::Image>(obj)) {
+		printf("\n%s  <Image>\n", indent.c_str());
+		printf("%s  Data= %p\n", indent.c_str(), image->data);
+		printf("%s  DataLength= %d\n", indent.c_str(), image->dataLength);
+		printf("%s", indent.c_str());
 	}
-	printf_s("}\n");
+	printf("}\n");
 }